@@ -0,0 +1,252 @@
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "corpus_pack.h"
+
+
+int macke_fuzzer_pack_is_pack(const char* path)
+{
+	size_t len = strlen(path);
+	size_t suffixLen = sizeof(MACKE_FUZZER_PACK_SUFFIX) - 1;
+	return len > suffixLen && strcmp(path + len - suffixLen, MACKE_FUZZER_PACK_SUFFIX) == 0;
+}
+
+
+static char* IndexPath(const char* path)
+{
+	size_t len = strlen(path) + sizeof(MACKE_FUZZER_PACK_INDEX_SUFFIX);
+	char* ret = malloc(len);
+	if(ret)
+		snprintf(ret, len, "%s" MACKE_FUZZER_PACK_INDEX_SUFFIX, path);
+	return ret;
+}
+
+
+/* Map a whole file read-only and check its header */
+static const uint8_t* MapFile(const char* path, const char* magic, size_t* size)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MackeFuzzerPackHeader))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	const uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	const MackeFuzzerPackHeader* header = (const MackeFuzzerPackHeader*)map;
+	if(memcmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != MACKE_FUZZER_PACK_VERSION)
+	{
+		munmap((void*)map, st.st_size);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	return map;
+}
+
+
+int macke_fuzzer_pack_open(MackeFuzzerPack* pack, const char* path)
+{
+	memset(pack, 0, sizeof(*pack));
+
+	char* indexPath = IndexPath(path);
+	if(!indexPath)
+		return -1;
+
+	const uint8_t* index = MapFile(indexPath, MACKE_FUZZER_PACK_INDEX_MAGIC, &pack->indexSize);
+	free(indexPath);
+	if(!index)
+		return -1;
+
+	pack->data = MapFile(path, MACKE_FUZZER_PACK_MAGIC, &pack->dataSize);
+	if(!pack->data)
+	{
+		munmap((void*)index, pack->indexSize);
+		return -1;
+	}
+
+	pack->index = (const MackeFuzzerPackIndexEntry*)(index + sizeof(MackeFuzzerPackHeader));
+	/* A partially written trailing entry is ignored */
+	pack->count = (pack->indexSize - sizeof(MackeFuzzerPackHeader)) / sizeof(MackeFuzzerPackIndexEntry);
+	return 0;
+}
+
+
+const uint8_t* macke_fuzzer_pack_get(const MackeFuzzerPack* pack, size_t i, size_t* len)
+{
+	if(i >= pack->count)
+		return NULL;
+
+	const MackeFuzzerPackIndexEntry* entry = &pack->index[i];
+	if(entry->offset > pack->dataSize || entry->length > pack->dataSize - entry->offset)
+		return NULL;
+
+	*len = entry->length;
+	return pack->data + entry->offset;
+}
+
+
+void macke_fuzzer_pack_close(MackeFuzzerPack* pack)
+{
+	if(pack->data)
+		munmap((void*)pack->data, pack->dataSize);
+	if(pack->index)
+		munmap((void*)((const uint8_t*)pack->index - sizeof(MackeFuzzerPackHeader)), pack->indexSize);
+	memset(pack, 0, sizeof(*pack));
+}
+
+
+static int WriteAll(int fd, const void* buf, size_t len)
+{
+	const uint8_t* current = buf;
+	while(len > 0)
+	{
+		ssize_t ret = write(fd, current, len);
+		if(ret < 0)
+			return -1;
+		current += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+
+/* Open one of the pack files for appending and write the header into new files, or ones a writer died in */
+static int OpenForAppend(const char* path, const char* magic)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if(fd < 0)
+		return -1;
+
+	flock(fd, LOCK_EX);
+	struct stat st;
+	int ret = fstat(fd, &st);
+	if(ret == 0 && (size_t)st.st_size < sizeof(MackeFuzzerPackHeader))
+	{
+		MackeFuzzerPackHeader header;
+		memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = MACKE_FUZZER_PACK_VERSION;
+		header.reserved = 0;
+		ret = ftruncate(fd, 0);
+		if(ret == 0)
+			ret = WriteAll(fd, &header, sizeof(header));
+	}
+	flock(fd, LOCK_UN);
+
+	if(ret < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/**
+ * A writer that died while appending leaves a partial index entry behind, which would shift all entries appended after it.
+ * Cut the index back to its last whole entry that lies within the data file.
+ */
+static int RepairIndex(MackeFuzzerPackWriter* writer)
+{
+	/* Appending writers hold the data lock */
+	flock(writer->dataFd, LOCK_EX);
+
+	struct stat dataStat;
+	struct stat indexStat;
+	int ret = fstat(writer->dataFd, &dataStat) == 0 && fstat(writer->indexFd, &indexStat) == 0 ? 0 : -1;
+	if(ret == 0)
+	{
+		const off_t headerSize = sizeof(MackeFuzzerPackHeader);
+		const off_t entrySize = sizeof(MackeFuzzerPackIndexEntry);
+		off_t size = headerSize + (indexStat.st_size - headerSize) / entrySize * entrySize;
+		while(size > headerSize)
+		{
+			MackeFuzzerPackIndexEntry entry;
+			if(pread(writer->indexFd, &entry, sizeof(entry), size - entrySize) != (ssize_t)sizeof(entry))
+			{
+				ret = -1;
+				break;
+			}
+			if(entry.offset >= (uint64_t)headerSize && entry.offset <= (uint64_t)dataStat.st_size
+					&& entry.length <= (uint64_t)dataStat.st_size - entry.offset)
+				break;
+			size -= entrySize;
+		}
+		if(ret == 0 && size != indexStat.st_size)
+			ret = ftruncate(writer->indexFd, size);
+	}
+
+	flock(writer->dataFd, LOCK_UN);
+	return ret;
+}
+
+
+int macke_fuzzer_pack_writer_open(MackeFuzzerPackWriter* writer, const char* path)
+{
+	char* indexPath = IndexPath(path);
+	if(!indexPath)
+		return -1;
+
+	writer->dataFd = OpenForAppend(path, MACKE_FUZZER_PACK_MAGIC);
+	writer->indexFd = writer->dataFd < 0 ? -1 : OpenForAppend(indexPath, MACKE_FUZZER_PACK_INDEX_MAGIC);
+	free(indexPath);
+
+	if(writer->indexFd < 0)
+	{
+		if(writer->dataFd >= 0)
+			close(writer->dataFd);
+		return -1;
+	}
+
+	if(RepairIndex(writer) < 0)
+	{
+		macke_fuzzer_pack_writer_close(writer);
+		return -1;
+	}
+	return 0;
+}
+
+
+int macke_fuzzer_pack_append(MackeFuzzerPackWriter* writer, const void* data, size_t len)
+{
+	/* The data lock serializes concurrent writers, the entry is only published after its data is complete */
+	flock(writer->dataFd, LOCK_EX);
+
+	MackeFuzzerPackIndexEntry entry;
+	off_t offset = lseek(writer->dataFd, 0, SEEK_END);
+	int ret = offset < 0 ? -1 : 0;
+	if(ret == 0)
+	{
+		entry.offset = offset;
+		entry.length = len;
+		ret = WriteAll(writer->dataFd, data, len);
+	}
+	if(ret == 0)
+		ret = WriteAll(writer->indexFd, &entry, sizeof(entry));
+
+	flock(writer->dataFd, LOCK_UN);
+	return ret;
+}
+
+
+void macke_fuzzer_pack_writer_close(MackeFuzzerPackWriter* writer)
+{
+	close(writer->dataFd);
+	close(writer->indexFd);
+	writer->dataFd = writer->indexFd = -1;
+}
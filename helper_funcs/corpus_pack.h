@@ -0,0 +1,72 @@
+
+#ifndef __CORPUS_PACK_H
+#define __CORPUS_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Packed, append-only corpus.
+ * <name>.pack holds a header and the concatenated inputs,
+ * <name>.pack.idx holds a header and one (offset, length) entry per input.
+ * Both files are only ever appended to, readers map them and hand out pointers into the mapping.
+ */
+
+#define MACKE_FUZZER_PACK_SUFFIX       ".pack"
+#define MACKE_FUZZER_PACK_INDEX_SUFFIX ".idx"
+#define MACKE_FUZZER_PACK_MAGIC        "MKFZPACK"
+#define MACKE_FUZZER_PACK_INDEX_MAGIC  "MKFZPIDX"
+#define MACKE_FUZZER_PACK_VERSION      1
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} MackeFuzzerPackHeader;
+
+typedef struct
+{
+	uint64_t offset; /* Relative to the start of the data file */
+	uint64_t length;
+} MackeFuzzerPackIndexEntry;
+
+typedef struct
+{
+	const uint8_t* data;
+	size_t dataSize;
+	const MackeFuzzerPackIndexEntry* index;
+	size_t count;
+	size_t indexSize;
+} MackeFuzzerPack;
+
+typedef struct
+{
+	int dataFd;
+	int indexFd;
+} MackeFuzzerPackWriter;
+
+/* Returns whether path names a packed corpus */
+int macke_fuzzer_pack_is_pack(const char* path);
+
+/* Map a packed corpus, returns 0 on success */
+int macke_fuzzer_pack_open(MackeFuzzerPack* pack, const char* path);
+/* Returns a pointer into the mapping, NULL if the entry is out of range or truncated */
+const uint8_t* macke_fuzzer_pack_get(const MackeFuzzerPack* pack, size_t i, size_t* len);
+void macke_fuzzer_pack_close(MackeFuzzerPack* pack);
+
+/* Open a packed corpus for appending, creating it if needed and cutting off an entry a dead writer left behind, returns 0 on success */
+int macke_fuzzer_pack_writer_open(MackeFuzzerPackWriter* writer, const char* path);
+/* Append one input, returns 0 on success */
+int macke_fuzzer_pack_append(MackeFuzzerPackWriter* writer, const void* data, size_t len);
+void macke_fuzzer_pack_writer_close(MackeFuzzerPackWriter* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CORPUS_PACK_H
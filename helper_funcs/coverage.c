@@ -0,0 +1,117 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Coverage of the reproduce build, for the minimizer and --measure-coverage.
+ * Every guard gets its own byte in a shared mapping, so the parent can read the coverage of an input replayed in a forked child.
+ * Two instrumentations fill it:
+ * - -fsanitize-coverage=inline-8bit-counters, which works next to the sanitizer runtimes: they only bring a weak
+ *   __sanitizer_cov_8bit_counters_init. The counters live in the instrumented binary, macke_fuzzer_coverage_collect
+ *   copies them into the mapping after an exec.
+ * - -fsanitize-coverage=trace-pc-guard, whose callbacks set the byte of the guard directly. They are weak,
+ *   the sanitizer runtimes and fuzzer runtimes bring their own, and no guard registers here then.
+ */
+
+#define MAX_GUARDS (1 << 24)
+#define MAX_COUNTER_REGIONS 64
+
+typedef struct
+{
+	uint8_t* start;
+	uint8_t* stop;
+	size_t firstGuard;
+} CounterRegion;
+
+static uint8_t* coverageMap;
+static size_t numGuards;
+
+static CounterRegion counterRegions[MAX_COUNTER_REGIONS];
+static size_t numCounterRegions;
+
+
+static int MapCoverage(void)
+{
+	if(!coverageMap)
+	{
+		coverageMap = mmap(NULL, MAX_GUARDS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(coverageMap == MAP_FAILED)
+			coverageMap = NULL;
+	}
+	return coverageMap != NULL;
+}
+
+
+/* Called once per instrumented object, the sanitizer runtimes only define it weakly */
+void __sanitizer_cov_8bit_counters_init(uint8_t* start, uint8_t* stop)
+{
+	if(start == stop || !MapCoverage() || numCounterRegions == MAX_COUNTER_REGIONS)
+		return;
+
+	/* Guard 0 stays unused, like for trace-pc-guard */
+	size_t count = stop - start;
+	if(numGuards + 1 + count > MAX_GUARDS)
+		return;
+
+	CounterRegion* region = &counterRegions[numCounterRegions++];
+	region->start = start;
+	region->stop = stop;
+	region->firstGuard = numGuards + 1;
+	numGuards += count;
+}
+
+
+__attribute__((weak)) void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop)
+{
+	if(start == stop || *start || !MapCoverage())
+		return;
+
+	/* Guard 0 stays unused, it marks disabled guards */
+	for(uint32_t* guard = start; guard < stop && numGuards + 1 < MAX_GUARDS; ++guard)
+		*guard = ++numGuards;
+}
+
+
+__attribute__((weak)) void __sanitizer_cov_trace_pc_guard(uint32_t* guard)
+{
+	if(*guard)
+		coverageMap[*guard] = 1;
+}
+
+
+/* One byte per guard, indexed 1 to the returned count. NULL if the binary has no guards */
+uint8_t* macke_fuzzer_coverage_map(size_t* count)
+{
+	*count = numGuards;
+	return coverageMap;
+}
+
+
+/**
+ * Marks the counters that were hit since the last reset in the map and resets them.
+ * The counters wrap, an edge run a multiple of 256 times in one exec is missed like in libFuzzer.
+ */
+void macke_fuzzer_coverage_collect(void)
+{
+	for(size_t r = 0; r < numCounterRegions; ++r)
+	{
+		CounterRegion* region = &counterRegions[r];
+		for(uint8_t* counter = region->start; counter < region->stop; ++counter)
+		{
+			if(*counter)
+			{
+				coverageMap[region->firstGuard + (counter - region->start)] = 1;
+				*counter = 0;
+			}
+		}
+	}
+}
+
+
+/* Forgets what the counters recorded so far, the map is cleared by whoever reads it */
+void macke_fuzzer_coverage_reset(void)
+{
+	for(size_t r = 0; r < numCounterRegions; ++r)
+		memset(counterRegions[r].start, 0, counterRegions[r].stop - counterRegions[r].start);
+}
@@ -0,0 +1,36 @@
+
+#include <stdint.h>
+
+/**
+ * Runtime side of the directed-distance pass.
+ * Instrumented blocks add their distance to the targets to sum and count and lower min,
+ * the drivers reset the counters at the start of every exec. The counters are thread local like the exec.
+ */
+
+#define EXEC_COUNTER __thread __attribute__((tls_model("initial-exec")))
+
+EXEC_COUNTER uint64_t macke_fuzzer_distance_sum;
+EXEC_COUNTER uint64_t macke_fuzzer_distance_count;
+EXEC_COUNTER uint64_t macke_fuzzer_distance_min = UINT64_MAX;
+
+
+void macke_fuzzer_distance_reset(void)
+{
+	macke_fuzzer_distance_sum = 0;
+	macke_fuzzer_distance_count = 0;
+	macke_fuzzer_distance_min = UINT64_MAX;
+}
+
+
+/**
+ * Average distance of all blocks executed since the last reset, lower is closer to the targets.
+ * Returns -1 if no instrumented block was executed. min receives the smallest distance, 0 if a target was reached.
+ */
+double macke_fuzzer_distance_get(uint64_t* min)
+{
+	if(min)
+		*min = macke_fuzzer_distance_min;
+	if(!macke_fuzzer_distance_count)
+		return -1;
+	return (double)macke_fuzzer_distance_sum / macke_fuzzer_distance_count;
+}
@@ -0,0 +1,61 @@
+
+#include <string.h>
+
+#include "../src/Config.h"
+#include "driver_api.h"
+
+/**
+ * Reentrant entry points into the drivers, see driver_api.h.
+ */
+
+extern const MackeFuzzerDriverDesc DRIVER_ARRAY_ID[];
+
+/* In the order of the table, only emitted with -fuzz-target-weights */
+extern const double macke_fuzzer_driver_weights[] __attribute__((weak));
+
+/* Only emitted with -fuzz-dedup-targets */
+extern const MackeFuzzerDriverAlias macke_fuzzer_driver_aliases[] __attribute__((weak));
+
+
+const MackeFuzzerDriverDesc* macke_fuzzer_driver_table(void)
+{
+	return DRIVER_ARRAY_ID;
+}
+
+
+const MackeFuzzerDriverAlias* macke_fuzzer_driver_alias_table(void)
+{
+	static const MackeFuzzerDriverAlias noAliases[] = { { NULL, NULL } };
+	return macke_fuzzer_driver_aliases ? macke_fuzzer_driver_aliases : noAliases;
+}
+
+
+MackeFuzzerDriver macke_fuzzer_driver_find(const char* name)
+{
+	for(const MackeFuzzerDriverDesc* desc = DRIVER_ARRAY_ID; desc->name; ++desc)
+		if(strcmp(desc->name, name) == 0)
+			return desc;
+
+	for(const MackeFuzzerDriverAlias* alias = macke_fuzzer_driver_alias_table(); alias->alias; ++alias)
+		if(strcmp(alias->alias, name) == 0)
+			return macke_fuzzer_driver_find(alias->target);
+	return NULL;
+}
+
+
+double macke_fuzzer_driver_weight(MackeFuzzerDriver driver)
+{
+	if(macke_fuzzer_driver_weights)
+		return macke_fuzzer_driver_weights[driver - DRIVER_ARRAY_ID];
+
+	size_t numDrivers = 0;
+	for(const MackeFuzzerDriverDesc* desc = DRIVER_ARRAY_ID; desc->name; ++desc)
+		++numDrivers;
+	return 1.0 / numDrivers;
+}
+
+
+int macke_fuzzer_driver_run(MackeFuzzerDriver driver, const uint8_t* data, size_t size)
+{
+	return driver->driver(data, size);
+}
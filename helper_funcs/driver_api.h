@@ -0,0 +1,62 @@
+#ifndef __DRIVER_API_H
+#define __DRIVER_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Entry of the descriptor table insert-fuzzdriver emits when it generates drivers for all functions.
+ * A pointer to an entry is the handle of its driver. Unlike LLVMFuzzerTestOneInput, which calls whatever
+ * driver macke_fuzzer_ptr_driver selects, handles let threads of one process run different drivers at once.
+ */
+typedef struct
+{
+	const char* name;
+	int (*driver)(const uint8_t*, size_t);
+	char* (*generator)(size_t, size_t*);
+	const char* layout; /* Layout schema, see layout_schema.h */
+} MackeFuzzerDriverDesc;
+
+typedef const MackeFuzzerDriverDesc* MackeFuzzerDriver;
+
+/**
+ * Target without a driver of its own, because -fuzz-dedup-targets found it equivalent to another target.
+ * Inputs and crashes of the driver of target hold for the alias as well.
+ */
+typedef struct
+{
+	const char* alias;
+	const char* target;
+} MackeFuzzerDriverAlias;
+
+/* The NULL terminated table of all drivers in the binary */
+const MackeFuzzerDriverDesc* macke_fuzzer_driver_table(void);
+
+/* The NULL terminated table of all aliases, empty without -fuzz-dedup-targets */
+const MackeFuzzerDriverAlias* macke_fuzzer_driver_alias_table(void);
+
+/* Returns the driver of the function or of the target it is an alias of, or NULL if there is none */
+MackeFuzzerDriver macke_fuzzer_driver_find(const char* name);
+
+/**
+ * Share of the fuzzing time the driver is worth, from the weights of -fuzz-target-weights.
+ * Without weights every driver gets the same share.
+ */
+double macke_fuzzer_driver_weight(MackeFuzzerDriver driver);
+
+/**
+ * Run one input through the driver, from any thread.
+ * The per-exec state of the runtime - loop guard budget and distances - is thread local,
+ * the target itself has to be reentrant for concurrent calls.
+ */
+int macke_fuzzer_driver_run(MackeFuzzerDriver driver, const uint8_t* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DRIVER_API_H
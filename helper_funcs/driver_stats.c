@@ -0,0 +1,150 @@
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/Config.h"
+#include "driver_stats.h"
+
+/**
+ * Runtime side of drivers generated with -fuzz-stats.
+ * Without MACKE_FUZZER_STATS_ENV in the environment all hooks return right away.
+ */
+
+static MackeFuzzerStatsBlock* statsBlock;
+static int statsInitialized;
+
+
+static uint64_t Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Map the stats file, creating and initializing it if needed */
+static MackeFuzzerStatsBlock* MapStatsBlock(void)
+{
+	const char* path = getenv(MACKE_FUZZER_STATS_ENV);
+	if(!path || !*path)
+		return NULL;
+
+	int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if(fd < 0)
+		return NULL;
+
+	/* Several fuzzer processes may share one file */
+	flock(fd, LOCK_EX);
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || ((size_t)st.st_size < sizeof(MackeFuzzerStatsBlock) && ftruncate(fd, sizeof(MackeFuzzerStatsBlock)) < 0))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	MackeFuzzerStatsBlock* block = mmap(NULL, sizeof(MackeFuzzerStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(block == MAP_FAILED)
+		block = NULL;
+	else if(memcmp(block->magic, MACKE_FUZZER_STATS_MAGIC, sizeof(block->magic)) != 0)
+	{
+		block->version = MACKE_FUZZER_STATS_VERSION;
+		block->capacity = MACKE_FUZZER_STATS_CAPACITY;
+		memcpy(block->magic, MACKE_FUZZER_STATS_MAGIC, sizeof(block->magic));
+	}
+
+	flock(fd, LOCK_UN);
+	close(fd);
+	return block;
+}
+
+
+/* Find the entry of the driver or claim a free one */
+static MackeFuzzerStatsEntry* ClaimEntry(const char* name)
+{
+	for(uint32_t i = 0; i < statsBlock->capacity; ++i)
+	{
+		MackeFuzzerStatsEntry* entry = &statsBlock->entries[i];
+		uint32_t state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+		if(state == MACKE_FUZZER_STATS_FREE)
+		{
+			if(__atomic_compare_exchange_n(&entry->state, &state, MACKE_FUZZER_STATS_CLAIMED,
+						0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			{
+				strncpy(entry->name, name, MACKE_FUZZER_STATS_NAME_LEN - 1);
+				__atomic_store_n(&entry->state, MACKE_FUZZER_STATS_READY, __ATOMIC_RELEASE);
+				return entry;
+			}
+		}
+
+		/* Another process is writing the name right now */
+		while(state == MACKE_FUZZER_STATS_CLAIMED)
+			state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+		if(strncmp(entry->name, name, MACKE_FUZZER_STATS_NAME_LEN - 1) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+
+/* Called on driver entry, returns the start timestamp */
+uint64_t macke_fuzzer_stats_begin(const char* name, void** handle)
+{
+	if(!*handle)
+	{
+		if(!statsInitialized)
+		{
+			statsBlock = MapStatsBlock();
+			statsInitialized = 1;
+		}
+		if(!statsBlock)
+			return 0;
+		*handle = ClaimEntry(name);
+		if(!*handle)
+			return 0;
+	}
+	return Now();
+}
+
+
+/* Called after all arguments are decoded, returns the timestamp the target is entered at */
+uint64_t macke_fuzzer_stats_decoded(void* handle, uint64_t start, const uint8_t* data, size_t consumed, size_t pointerArgs)
+{
+	MackeFuzzerStatsEntry* entry = handle;
+	if(!entry)
+		return 0;
+
+	uint64_t escapes = 0;
+	const uint8_t* end = data + consumed;
+	for(const uint8_t* p = data; (p = memchr(p, (uint8_t)ESCAPE_CHAR, end - p)); ++p)
+		++escapes;
+
+	__atomic_fetch_add(&entry->execs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&entry->bytesDecoded, consumed, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&entry->pointerArgs, pointerArgs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&entry->escapeBytes, escapes, __ATOMIC_RELAXED);
+
+	uint64_t now = Now();
+	__atomic_fetch_add(&entry->decodeNanos, now - start, __ATOMIC_RELAXED);
+	return now;
+}
+
+
+/* Called after the target returned */
+void macke_fuzzer_stats_end(void* handle, uint64_t decodedAt)
+{
+	MackeFuzzerStatsEntry* entry = handle;
+	if(!entry)
+		return;
+
+	__atomic_fetch_add(&entry->targetNanos, Now() - decodedAt, __ATOMIC_RELAXED);
+}
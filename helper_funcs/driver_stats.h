@@ -0,0 +1,46 @@
+
+#ifndef __DRIVER_STATS_H
+#define __DRIVER_STATS_H
+
+#include <stdint.h>
+
+/**
+ * Layout of the shared stats block written by drivers generated with -fuzz-stats.
+ * The block is a mmap'd file named by MACKE_FUZZER_STATS_ENV, so a monitor can read it while the fuzzer runs.
+ * All counters are only ever increased with relaxed atomic adds.
+ */
+
+#define MACKE_FUZZER_STATS_ENV        "MACKE_FUZZER_STATS_FILE"
+#define MACKE_FUZZER_STATS_MAGIC      "MKFZSTAT"
+#define MACKE_FUZZER_STATS_VERSION    1
+#define MACKE_FUZZER_STATS_CAPACITY   1024
+#define MACKE_FUZZER_STATS_NAME_LEN   120
+
+/* Entry states */
+#define MACKE_FUZZER_STATS_FREE       0
+#define MACKE_FUZZER_STATS_CLAIMED    1
+#define MACKE_FUZZER_STATS_READY      2
+
+typedef struct
+{
+	uint32_t state;
+	uint32_t reserved;
+	char name[MACKE_FUZZER_STATS_NAME_LEN];
+
+	uint64_t execs;
+	uint64_t bytesDecoded;   /* Input bytes consumed by argument decoding */
+	uint64_t pointerArgs;    /* Buffers allocated for pointer arguments */
+	uint64_t escapeBytes;    /* Escape characters in the consumed input */
+	uint64_t decodeNanos;    /* Time spent decoding the arguments */
+	uint64_t targetNanos;    /* Time spent inside the fuzzed function */
+} MackeFuzzerStatsEntry;
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t capacity;
+	MackeFuzzerStatsEntry entries[MACKE_FUZZER_STATS_CAPACITY];
+} MackeFuzzerStatsBlock;
+
+#endif // __DRIVER_STATS_H
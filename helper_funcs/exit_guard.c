@@ -0,0 +1,153 @@
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Runtime side of the intercept-exit pass.
+ * The guarded drivers run their body through macke_fuzzer_exit_guard, exits of the target jump back to it
+ * and end only the exec. The loop guard ends slow execs the same way. Like the other per-exec state, the jump target is thread local.
+ * The guarded drivers register the buffers they decoded, the guard frees them when it ends the exec early,
+ * so leak detection does not report them. What the cleanups read, like the list of nested allocations,
+ * is kept in the frame of the guard, the stack of the body is gone after the jump.
+ */
+
+#define EXEC_STATE __thread __attribute__((tls_model("initial-exec")))
+
+/* Values passed to longjmp */
+#define JUMP_EXIT 1
+#define JUMP_STOP 2
+
+/* Drivers free at most one buffer per argument and their nested allocations, more are leaked on a jump */
+#define EXIT_GUARD_MAX_CLEANUPS 32
+
+/* Bytes a body can keep in the frame of its guard, the list of nested allocations needs 32 */
+#define EXIT_GUARD_STORAGE 64
+
+typedef struct
+{
+	void (*cleanup)(void*);
+	void* arg;
+} ExitGuardCleanup;
+
+/* Lives on the stack of macke_fuzzer_exit_guard */
+typedef struct
+{
+	jmp_buf target;
+	ExitGuardCleanup cleanups[EXIT_GUARD_MAX_CLEANUPS];
+	size_t numCleanups;
+	uint64_t storage[EXIT_GUARD_STORAGE / sizeof(uint64_t)];
+	size_t storageUsed; /* In words */
+} ExitGuardFrame;
+
+static EXEC_STATE ExitGuardFrame* exitTarget;
+static EXEC_STATE int exitStatus;
+static EXEC_STATE int exitIntercepted;
+
+/* Intercepted exits of all threads */
+static uint64_t exitCount;
+
+
+int macke_fuzzer_exit_guard(int (*body)(const uint8_t*, size_t), const uint8_t* data, size_t size)
+{
+	ExitGuardFrame frame;
+	ExitGuardFrame* outer = exitTarget;
+	exitIntercepted = 0;
+	frame.numCleanups = 0;
+	frame.storageUsed = 0;
+	memset(frame.storage, 0, sizeof(frame.storage));
+
+	/* No signal mask to restore, the target did not return through a signal handler */
+	int jumped = _setjmp(frame.target);
+	if(jumped)
+	{
+		exitTarget = outer;
+		/* The driver did not get to free its buffers */
+		while(frame.numCleanups > 0)
+		{
+			ExitGuardCleanup* cleanup = &frame.cleanups[--frame.numCleanups];
+			cleanup->cleanup(cleanup->arg);
+		}
+		if(jumped == JUMP_EXIT)
+			__atomic_fetch_add(&exitCount, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	exitTarget = &frame;
+	int ret = body(data, size);
+	exitTarget = outer;
+	return ret;
+}
+
+
+__attribute__((noreturn)) static void InterceptExit(int status)
+{
+	exitStatus = status;
+	exitIntercepted = 1;
+	longjmp(exitTarget->target, JUMP_EXIT);
+}
+
+
+/* Ends the exec with status 0 and without counting it as exit, returns if no guarded driver of this thread is running */
+void macke_fuzzer_exec_stop(void)
+{
+	if(exitTarget)
+		longjmp(exitTarget->target, JUMP_STOP);
+}
+
+
+/* Zeroed memory in the frame of the running guard, valid until the guard returns. Only guarded bodies call it */
+void* macke_fuzzer_exit_guard_storage(size_t size)
+{
+	size_t words = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	if(!exitTarget || exitTarget->storageUsed + words > EXIT_GUARD_STORAGE / sizeof(uint64_t))
+		abort();
+
+	void* ret = &exitTarget->storage[exitTarget->storageUsed];
+	exitTarget->storageUsed += words;
+	return ret;
+}
+
+
+/* Called by a guarded driver for every buffer it frees after the target returned, only used if it does not */
+void macke_fuzzer_exit_guard_cleanup(void (*cleanup)(void*), void* arg)
+{
+	if(exitTarget && exitTarget->numCleanups < EXIT_GUARD_MAX_CLEANUPS)
+		exitTarget->cleanups[exitTarget->numCleanups++] = (ExitGuardCleanup){ cleanup, arg };
+}
+
+
+/* Replaces exit in the target, outside of a driver it still ends the process */
+__attribute__((noreturn)) void macke_fuzzer_exit(int status)
+{
+	if(exitTarget)
+		InterceptExit(status);
+	exit(status);
+}
+
+
+/* Replaces _exit and _Exit */
+__attribute__((noreturn)) void macke_fuzzer__exit(int status)
+{
+	if(exitTarget)
+		InterceptExit(status);
+	_exit(status);
+}
+
+
+/* Returns whether the last exec of this thread ended in an intercepted exit, status receives its status */
+int macke_fuzzer_exit_status(int* status)
+{
+	if(exitIntercepted)
+		*status = exitStatus;
+	return exitIntercepted;
+}
+
+
+uint64_t macke_fuzzer_exit_count(void)
+{
+	return __atomic_load_n(&exitCount, __ATOMIC_RELAXED);
+}
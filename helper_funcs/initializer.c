@@ -1,4 +1,8 @@
 
+#ifdef __REPRODUCE_FUZZING
+#define _GNU_SOURCE /* dladdr, dl_iterate_phdr */
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -10,22 +14,23 @@
 #include <errno.h>
 
 #include "../src/Config.h"
+#include "corpus_pack.h"
+#include "driver_api.h"
+#include "layout_schema.h"
 
 typedef char* (*GeneratorFunc)(size_t, size_t*);
 
-typedef struct
-{
-	const char* name;
-	int (*driver)(const uint8_t*,size_t);
-	GeneratorFunc generator;
-} DRIVER_DESC_ID;
-
+/* Selects the driver LLVMFuzzerTestOneInput calls */
 extern int (*DRIVER_PTR_ID)(const uint8_t*, size_t);
 
-/* Zero terminated array */
-extern const DRIVER_DESC_ID DRIVER_ARRAY_ID[];
+/* Hash over the layouts of all drivers, equal for the fast and the asan build of a module */
+extern const uint64_t macke_fuzzer_layout_hash __attribute__((weak));
 
 static const char listOptionName[] = "--list-fuzz-drivers";
+static const char rankOptionName[] = "--rank-fuzz-drivers";
+static const char listAliasesOptionName[] = "--list-fuzz-aliases";
+static const char layoutOptionName[] = "--print-layout=";
+static const char layoutHashOptionName[] = "--print-layout-hash";
 static const char optionName[] = "--fuzz-driver=";
 static const char generatorOptionName[] = "--generate-for=";
 static const size_t optionNameLen = sizeof(optionName) - 1;
@@ -72,11 +77,25 @@ void WriteToFile(int fd, const char* content, size_t contentLen)
 	}
 }
 
+/* Outdir may also name a packed corpus, the seeds are appended to it then */
 void GenerateInput(const char* dir, GeneratorFunc generator, size_t maxLen)
 {
-	int dirfd = OpenValidatedDirectory(dir);
+	int usePack = macke_fuzzer_pack_is_pack(dir);
+	MackeFuzzerPackWriter packWriter;
+	int dirfd = -1;
 	int fd;
 
+	if(usePack)
+	{
+		if(macke_fuzzer_pack_writer_open(&packWriter, dir) != 0)
+		{
+			printf("Failed to open packed corpus '%s': %m\n", dir);
+			exit(1);
+		}
+	}
+	else
+		dirfd = OpenValidatedDirectory(dir);
+
 	char nameBuf[64];
 
 	char* buf;
@@ -95,6 +114,21 @@ void GenerateInput(const char* dir, GeneratorFunc generator, size_t maxLen)
 			break;
 		}
 
+		if(usePack)
+		{
+			if(macke_fuzzer_pack_append(&packWriter, buf, bufLen) != 0)
+				printf("Couldn't append input_%lu to '%s': %m\n", i, dir);
+			else
+				lastLen = bufLen;
+			free(buf);
+
+			if(i == 0)
+				i = 1;
+			else
+				i *= 2;
+			continue;
+		}
+
 		snprintf(nameBuf, sizeof(nameBuf), "input_%lu", i);
 		fd = openat(dirfd, nameBuf, O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, S_IRUSR | S_IRUSR | S_IRGRP | S_IROTH);
 		if(fd < 0)
@@ -118,6 +152,37 @@ void GenerateInput(const char* dir, GeneratorFunc generator, size_t maxLen)
 		else
 			i *= 2;
 	}
+	if(usePack)
+		macke_fuzzer_pack_writer_close(&packWriter);
+	exit(0);
+}
+
+
+static int CompareDriverWeights(const void* a, const void* b)
+{
+	double wa = macke_fuzzer_driver_weight(*(const MackeFuzzerDriver*)a);
+	double wb = macke_fuzzer_driver_weight(*(const MackeFuzzerDriver*)b);
+	return wa > wb ? -1 : wa < wb;
+}
+
+
+/* The drivers with their weights, highest first, for schedulers to split the cores by */
+void PrintDriverRanking(void)
+{
+	size_t numDrivers = 0;
+	for(const MackeFuzzerDriverDesc* desc = macke_fuzzer_driver_table(); desc->name; ++desc)
+		++numDrivers;
+
+	MackeFuzzerDriver* drivers = malloc((numDrivers ? numDrivers : 1) * sizeof(MackeFuzzerDriver));
+	if(!drivers)
+		exit(1);
+	for(size_t i = 0; i < numDrivers; ++i)
+		drivers[i] = &macke_fuzzer_driver_table()[i];
+	qsort(drivers, numDrivers, sizeof(MackeFuzzerDriver), CompareDriverWeights);
+
+	for(size_t i = 0; i < numDrivers; ++i)
+		printf("%s %.6f\n", drivers[i]->name, macke_fuzzer_driver_weight(drivers[i]));
+	free(drivers);
 	exit(0);
 }
 
@@ -131,15 +196,9 @@ int LLVMFuzzerInitialize(int* argc_ptr, char*** argv_ptr)
 	{
 		if(strncmp(argv[i], optionName, optionNameLen) == 0)
 		{
-			const char* requestedDriver = argv[i] + optionNameLen;
-			for(const DRIVER_DESC_ID* fddesc = DRIVER_ARRAY_ID; fddesc->name; ++fddesc)
-			{
-				if(strcmp(fddesc->name, requestedDriver) == 0)
-				{
-					DRIVER_PTR_ID = fddesc->driver;
-					break;
-				}
-			}
+			MackeFuzzerDriver driver = macke_fuzzer_driver_find(argv[i] + optionNameLen);
+			if(driver)
+				DRIVER_PTR_ID = driver->driver;
 		}
 		else if(strncmp(argv[i], generatorOptionName, generatorOptionNameLen) == 0)
 		{
@@ -162,28 +221,48 @@ int LLVMFuzzerInitialize(int* argc_ptr, char*** argv_ptr)
 			}
 
 			const char* requestedGenerator = argv[i] + generatorOptionNameLen;
-			GeneratorFunc generator = NULL;
-
-			for(const DRIVER_DESC_ID* fddesc = DRIVER_ARRAY_ID; fddesc->name; ++fddesc)
+			MackeFuzzerDriver driver = macke_fuzzer_driver_find(requestedGenerator);
+			if(!driver)
 			{
-				if(strcmp(fddesc->name, requestedGenerator) == 0)
-				{
-					generator = fddesc->generator;
-					break;
-				}
+				printf("Couldn't find generator for '%s'\n", requestedGenerator);
+				exit(1);
 			}
-
-			if(!generator)
+			GenerateInput(argv[i+1], driver->generator, maxLen);
+		}
+		else if(strncmp(argv[i], layoutOptionName, sizeof(layoutOptionName) - 1) == 0)
+		{
+			const char* requestedLayout = argv[i] + sizeof(layoutOptionName) - 1;
+			MackeFuzzerDriver driver = macke_fuzzer_driver_find(requestedLayout);
+			if(!driver)
 			{
-				printf("Couldn't find generator for '%s'\n", requestedGenerator);
+				printf("Couldn't find layout for '%s'\n", requestedLayout);
 				exit(1);
 			}
-			GenerateInput(argv[i+1], generator, maxLen);
+			fputs(driver->layout, stdout);
+			exit(0);
+		}
+		else if(strcmp(argv[i], layoutHashOptionName) == 0)
+		{
+			if(!&macke_fuzzer_layout_hash)
+			{
+				printf("Built without layout hash\n");
+				exit(1);
+			}
+			printf("%016llx\n", (unsigned long long)macke_fuzzer_layout_hash);
+			exit(0);
 		}
 		else if(strcmp(argv[i], listOptionName) == 0)
 		{
-			for(const DRIVER_DESC_ID* fddesc = DRIVER_ARRAY_ID; fddesc->name; ++fddesc)
-				puts(fddesc->name);
+			for(const MackeFuzzerDriverDesc* desc = macke_fuzzer_driver_table(); desc->name; ++desc)
+				puts(desc->name);
+			exit(0);
+		}
+		else if(strcmp(argv[i], rankOptionName) == 0)
+			PrintDriverRanking();
+		else if(strcmp(argv[i], listAliasesOptionName) == 0)
+		{
+			for(const MackeFuzzerDriverAlias* alias = macke_fuzzer_driver_alias_table(); alias->alias; ++alias)
+				printf("%s %s\n", alias->alias, alias->target);
 			exit(0);
 		}
 	}
@@ -246,47 +325,1731 @@ int main(int argc, char** argv)
 #endif
 
 
-/* Main for calling test case */
+/* Batch reproducer for crash triage, works on directories, lists of files and packed corpora */
 
 #ifdef __REPRODUCE_FUZZING
-int main(int argc, char** argv)
+#include <dirent.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+
+static const char reproduceDirOptionName[] = "--reproduce-dir=";
+static const char reproduceListOptionName[] = "--reproduce-list=";
+static const char reproducePackOptionName[] = "--reproduce-pack=";
+static const char reproduceTimeoutOptionName[] = "--reproduce-timeout=";
+static const char reproduceJobsOptionName[] = "--reproduce-jobs=";
+static const char reproduceOutOptionName[] = "--reproduce-out=";
+static const char asanReplayOptionName[] = "--asan-replay=";
+static const char asanReplayBatchOptionName[] = "--asan-replay-batch=";
+static const char asanReplayIntervalOptionName[] = "--asan-replay-interval=";
+static const char expectLayoutHashOptionName[] = "--expect-layout-hash=";
+static const char replayThreadsOptionName[] = "--replay-threads=";
+static const char replayRoundsOptionName[] = "--replay-rounds=";
+static const char minimizeOptionName[] = "--minimize-to=";
+static const char minimizeRunsOptionName[] = "--minimize-runs=";
+static const char measureCoverageOptionName[] = "--measure-coverage=";
+
+#define REPRODUCE_HASH_FRAMES 8
+#define REPRODUCE_MAX_FRAMES 64
+#define REPRODUCE_MAX_SEGMENTS 256
+
+typedef enum
 {
-	/* Initialize driver to be used */
-	LLVMFuzzerInitialize(&argc, &argv);
+	REPRODUCE_OK,
+	REPRODUCE_CRASH,
+	REPRODUCE_TIMEOUT,
+	REPRODUCE_EXIT,
+	REPRODUCE_SLOW     /* Stopped by the loop guard */
+} ReproduceResult;
 
-	/* Read from stdin into buffer */
-	const size_t initialBufSize = 0x1000;
-	size_t bufAlloc = initialBufSize;
-	size_t bufUsage = 0;
-	ssize_t bytesRead;
-	char* buf = malloc(bufAlloc);
+static const char* reproduceResultNames[] = { "ok", "crash", "timeout", "exit", "slow" };
 
-	while(1)
+typedef struct
+{
+	char* path;
+	const uint8_t* data; /* Entries of a packed corpus are already mapped */
+	size_t size;
+	ReproduceResult result;
+	int code;           /* Signal number for crashes and timeouts, exit code otherwise */
+	uint64_t stackHash; /* 0 if no stack could be recorded */
+	size_t duplicateOf; /* Index of the first input with the same stack hash, or own index */
+	double distance;    /* Average distance to the targets of -directed-distance, -1 if unknown */
+	uint64_t minDistance;
+} ReproduceEntry;
+
+/* Sent by the child when its exec ends, unless it was killed */
+typedef struct
+{
+	uint64_t stackHash; /* 0 if the exec returned */
+	double distance;
+	uint64_t minDistance;
+} ReproduceReport;
+
+typedef struct
+{
+	pid_t pid;
+	int reportFd;
+	size_t entry;
+} ReproduceJob;
+
+/* Pipe the crashing child reports its stack hash to */
+static int reproduceReportFd = -1;
+
+
+/* Returns the argument of an option with the given prefix, or NULL */
+static const char* FindOption(int argc, char** argv, const char* option)
+{
+	size_t optionLen = strlen(option);
+	for(int i = 1; i < argc; ++i)
+		if(strncmp(argv[i], option, optionLen) == 0)
+			return argv[i] + optionLen;
+	return NULL;
+}
+
+
+static size_t ParseNumberOption(const char* arg, const char* option)
+{
+	char* end;
+	errno = 0;
+	size_t ret = strtoull(arg, &end, 10);
+	if(errno || *end || !*arg)
 	{
-		bytesRead = read(STDIN_FILENO, buf + bufUsage, bufAlloc - bufUsage);
-		if(bytesRead < 0)
+		printf("%s argument has invalid format (no number)\n", option);
+		exit(1);
+	}
+	return ret;
+}
+
+
+/* Loaded segment of an object, recorded before the exec since dladdr is not async-signal-safe */
+typedef struct
+{
+	uintptr_t start;
+	uintptr_t end;
+	uintptr_t base;
+	int sanitizer; /* Part of a shared sanitizer runtime */
+} LoadedSegment;
+
+static LoadedSegment loadedSegments[REPRODUCE_MAX_SEGMENTS];
+static size_t numLoadedSegments;
+
+
+static int IsSanitizerRuntime(const char* path)
+{
+	return strstr(path, "libclang_rt.") || strstr(path, "libasan") || strstr(path, "libubsan")
+		|| strstr(path, "liblsan") || strstr(path, "libmsan") || strstr(path, "libtsan");
+}
+
+
+static int RecordSegments(struct dl_phdr_info* info, size_t size, void* data)
+{
+	(void)size;
+	(void)data;
+	for(size_t i = 0; i < info->dlpi_phnum && numLoadedSegments < REPRODUCE_MAX_SEGMENTS; ++i)
+	{
+		const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+		if(phdr->p_type != PT_LOAD)
+			continue;
+
+		LoadedSegment* segment = &loadedSegments[numLoadedSegments++];
+		segment->start = info->dlpi_addr + phdr->p_vaddr;
+		segment->end = segment->start + phdr->p_memsz;
+		segment->base = info->dlpi_addr;
+		segment->sanitizer = info->dlpi_name && IsSanitizerRuntime(info->dlpi_name);
+	}
+	return 0;
+}
+
+
+/* Called before the exec, so StackHash does not need the loader from inside a signal handler */
+static void PrepareStackHash(void)
+{
+	/* The first backtrace loads libgcc, which allocates */
+	void* frame;
+	backtrace(&frame, 1);
+
+	numLoadedSegments = 0;
+	dl_iterate_phdr(RecordSegments, NULL);
+}
+
+
+static const LoadedSegment* FindSegment(uintptr_t address)
+{
+	for(size_t i = 0; i < numLoadedSegments; ++i)
+		if(address >= loadedSegments[i].start && address < loadedSegments[i].end)
+			return &loadedSegments[i];
+	return NULL;
+}
+
+
+/* Whether a frame lies in a sanitizer runtime linked into the executable, only known by its symbol */
+static int IsSanitizerSymbol(void* frame)
+{
+	static const char* prefixes[] = { "__asan", "__sanitizer", "__ubsan", "__lsan", "__interceptor_" };
+
+	Dl_info info;
+	if(!dladdr(frame, &info) || !info.dli_sname)
+		return 0;
+	/* Internal functions are C++, look for the namespace inside the mangled name */
+	for(size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i)
+		if(strstr(info.dli_sname, prefixes[i]))
+			return 1;
+	return 0;
+}
+
+
+/**
+ * Hash the innermost frames of the current stack, skipping frames of the sanitizer runtimes.
+ * Addresses are taken relative to the object they belong to, so the hash is stable under ASLR.
+ * Inside a signal handler only the segments recorded by PrepareStackHash are used; a sanitizer
+ * linked into the executable can only be told apart by the symbols, which needs dladdr.
+ */
+__attribute__((noinline)) static uint64_t StackHash(int inSignal)
+{
+	void* frames[REPRODUCE_MAX_FRAMES];
+	int numFrames = backtrace(frames, REPRODUCE_MAX_FRAMES);
+
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int hashed = 0;
+	/* Skip this function and the handler calling it */
+	for(int i = 2; i < numFrames && hashed < REPRODUCE_HASH_FRAMES; ++i)
+	{
+		uintptr_t offset = (uintptr_t)frames[i];
+		const LoadedSegment* segment = FindSegment(offset);
+		if(segment && segment->sanitizer)
+			continue;
+		if(!inSignal && IsSanitizerSymbol(frames[i]))
+			continue;
+
+		if(segment)
+			offset -= segment->base;
+		else if(!inSignal)
 		{
-			printf("read error...\n");
-			exit(1);
+			/* Loaded after PrepareStackHash */
+			Dl_info info;
+			if(dladdr(frames[i], &info) && info.dli_fbase)
+				offset -= (uintptr_t)info.dli_fbase;
 		}
-		if(bytesRead == 0)
-			break;
 
-		bufUsage += bytesRead;
-		if(bufAlloc - bufUsage < 0x10)
+		for(size_t b = 0; b < sizeof(offset); ++b)
 		{
-			size_t newAlloc = bufAlloc * 2;
-			char* newBuf = realloc(buf, newAlloc);
-			if(!newBuf)
-				exit(1);
-			buf = newBuf;
-			bufAlloc = newAlloc;
+			hash ^= (offset >> (8 * b)) & 0xFF;
+			hash *= 0x100000001b3ULL;
 		}
+		++hashed;
 	}
+	return hash ? hash : 1;
+}
 
-	/* Give fuzzy input to driver */
-	DRIVER_PTR_ID((const uint8_t*)buf, bufUsage);
-	free(buf);
+
+/* Provided by distance.c, if linked */
+extern double macke_fuzzer_distance_get(uint64_t* min) __attribute__((weak));
+
+/* Provided by exit_guard.c, if the module was built with intercept-exit */
+extern int macke_fuzzer_exit_status(int* status) __attribute__((weak));
+extern uint64_t macke_fuzzer_exit_count(void) __attribute__((weak));
+
+/* Provided by loop_guard.c, if the module was built with loop-guard */
+extern void macke_fuzzer_loop_guard_use_signal(void) __attribute__((weak));
+extern uint64_t macke_fuzzer_loop_guard_exceeded_count(void) __attribute__((weak));
+
+/* Provided by coverage.c, referenced strongly so its counter callbacks replace the weak ones of the sanitizer runtimes */
+extern uint8_t* macke_fuzzer_coverage_map(size_t* count);
+extern void macke_fuzzer_coverage_collect(void);
+extern void macke_fuzzer_coverage_reset(void);
+
+
+/* Exit status of the exec that just returned, an exit intercepted by the guard is reported like a real one */
+static int ExecStatus(void)
+{
+	int status = 0;
+	if(macke_fuzzer_exit_status && macke_fuzzer_exit_status(&status))
+		return status;
 	return 0;
 }
+
+
+static void Report(uint64_t stackHash)
+{
+	ReproduceReport report = { stackHash, -1, UINT64_MAX };
+	if(macke_fuzzer_distance_get)
+		report.distance = macke_fuzzer_distance_get(&report.minDistance);
+	if(write(reproduceReportFd, &report, sizeof(report)) != sizeof(report))
+		_exit(1);
+}
+
+
+static void ReportStackHash(int inSignal)
+{
+	Report(StackHash(inSignal));
+}
+
+
+static void ReproduceCrashHandler(int sig)
+{
+	ReportStackHash(1);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+/* Sanitizers report most errors outside a signal handler, and their own reports are not signal-safe either */
+static void ReproduceDeathCallback(void)
+{
+	ReportStackHash(0);
+}
+
+/* Provided by the sanitizer runtimes, if linked */
+extern void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+
+/* Install crash handlers without replacing the ones installed by a sanitizer */
+static void InstallCrashHandlers(void)
+{
+	static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTRAP };
+
+	PrepareStackHash();
+
+	for(size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); ++i)
+	{
+		struct sigaction old;
+		if(sigaction(crashSignals[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+			signal(crashSignals[i], ReproduceCrashHandler);
+	}
+
+	if(__sanitizer_set_death_callback)
+		__sanitizer_set_death_callback(ReproduceDeathCallback);
+}
+
+
+/* Runs in the forked child - never returns */
+static void ReproduceChild(const ReproduceEntry* entry, unsigned timeout)
+{
+	/* The parent tells slow execs from crashes by the signal */
+	if(macke_fuzzer_loop_guard_use_signal)
+		macke_fuzzer_loop_guard_use_signal();
+
+	int devNull = open("/dev/null", O_WRONLY);
+	if(devNull >= 0)
+	{
+		dup2(devNull, STDOUT_FILENO);
+		dup2(devNull, STDERR_FILENO);
+		close(devNull);
+	}
+
+	/* The mapping of a packed corpus is inherited from the parent */
+	if(entry->data)
+	{
+		InstallCrashHandlers();
+		alarm(timeout);
+
+		macke_fuzzer_coverage_reset();
+		DRIVER_PTR_ID(entry->data, entry->size);
+		macke_fuzzer_coverage_collect();
+		Report(0);
+		_exit(ExecStatus());
+	}
+
+	const char* path = entry->path;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		_exit(127);
+
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+		_exit(127);
+
+	const uint8_t* data = NULL;
+	if(st.st_size > 0)
+	{
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED)
+			_exit(127);
+	}
+	close(fd);
+
+	InstallCrashHandlers();
+	alarm(timeout);
+
+	macke_fuzzer_coverage_reset();
+	DRIVER_PTR_ID(data, st.st_size);
+	macke_fuzzer_coverage_collect();
+	Report(0);
+	_exit(ExecStatus());
+}
+
+
+static void AddEntry(char* path, ReproduceEntry** entries, size_t* numEntries, size_t* allocEntries)
+{
+	if(*numEntries == *allocEntries)
+	{
+		*allocEntries = *allocEntries ? *allocEntries * 2 : 256;
+		*entries = realloc(*entries, *allocEntries * sizeof(ReproduceEntry));
+		if(!*entries)
+			exit(1);
+	}
+	ReproduceEntry* entry = &(*entries)[(*numEntries)++];
+	memset(entry, 0, sizeof(*entry));
+	entry->path = path;
+}
+
+
+static void CollectDirectory(const char* dir, ReproduceEntry** entries, size_t* numEntries, size_t* allocEntries)
+{
+	DIR* d = opendir(dir);
+	if(!d)
+	{
+		printf("Failed to open directory '%s': %m\n", dir);
+		exit(1);
+	}
+
+	struct dirent* ent;
+	while((ent = readdir(d)))
+	{
+		if(ent->d_name[0] == '.')
+			continue;
+
+		size_t len = strlen(dir) + strlen(ent->d_name) + 2;
+		char* path = malloc(len);
+		snprintf(path, len, "%s/%s", dir, ent->d_name);
+
+		struct stat st;
+		if(stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+		{
+			free(path);
+			continue;
+		}
+		AddEntry(path, entries, numEntries, allocEntries);
+	}
+	closedir(d);
+}
+
+
+static void CollectList(const char* listFile, ReproduceEntry** entries, size_t* numEntries, size_t* allocEntries)
+{
+	FILE* f = fopen(listFile, "r");
+	if(!f)
+	{
+		printf("Failed to open list '%s': %m\n", listFile);
+		exit(1);
+	}
+
+	char* line = NULL;
+	size_t lineAlloc = 0;
+	ssize_t lineLen;
+	while((lineLen = getline(&line, &lineAlloc, f)) > 0)
+	{
+		while(lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r'))
+			line[--lineLen] = 0;
+		if(lineLen == 0)
+			continue;
+		AddEntry(strdup(line), entries, numEntries, allocEntries);
+	}
+	free(line);
+	fclose(f);
+}
+
+
+static void CollectPack(const char* packPath, MackeFuzzerPack* pack, ReproduceEntry** entries, size_t* numEntries, size_t* allocEntries)
+{
+	if(macke_fuzzer_pack_open(pack, packPath) != 0)
+	{
+		printf("'%s' is no packed corpus\n", packPath);
+		exit(1);
+	}
+
+	for(size_t i = 0; i < pack->count; ++i)
+	{
+		size_t len;
+		const uint8_t* data = macke_fuzzer_pack_get(pack, i, &len);
+		if(!data)
+			continue;
+
+		size_t nameLen = strlen(packPath) + 24;
+		char* name = malloc(nameLen);
+		snprintf(name, nameLen, "%s:%lu", packPath, i);
+		AddEntry(name, entries, numEntries, allocEntries);
+
+		(*entries)[*numEntries - 1].data = data;
+		(*entries)[*numEntries - 1].size = len;
+	}
+}
+
+
+static void StartJob(ReproduceJob* job, ReproduceEntry* entries, size_t entry, unsigned timeout)
+{
+	int fds[2];
+	if(pipe(fds) < 0)
+	{
+		printf("pipe failed: %m\n");
+		exit(1);
+	}
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		printf("fork failed: %m\n");
+		exit(1);
+	}
+	if(pid == 0)
+	{
+		close(fds[0]);
+		reproduceReportFd = fds[1];
+		ReproduceChild(&entries[entry], timeout);
+	}
+
+	close(fds[1]);
+	job->pid = pid;
+	job->reportFd = fds[0];
+	job->entry = entry;
+}
+
+
+static void FinishJob(ReproduceJob* job, ReproduceEntry* entries, int status)
+{
+	ReproduceEntry* entry = &entries[job->entry];
+
+	ReproduceReport report;
+	if(read(job->reportFd, &report, sizeof(report)) != sizeof(report))
+	{
+		report.stackHash = 0;
+		report.distance = -1;
+		report.minDistance = UINT64_MAX;
+	}
+	close(job->reportFd);
+	job->pid = 0;
+
+	uint64_t hash = report.stackHash;
+	entry->stackHash = hash;
+	entry->distance = report.distance;
+	entry->minDistance = report.minDistance;
+	if(WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+	{
+		entry->result = REPRODUCE_TIMEOUT;
+		entry->code = SIGALRM;
+	}
+	else if(WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU)
+	{
+		entry->result = REPRODUCE_SLOW;
+		entry->code = SIGXCPU;
+	}
+	else if(WIFSIGNALED(status))
+	{
+		entry->result = REPRODUCE_CRASH;
+		entry->code = WTERMSIG(status);
+	}
+	else if(hash) /* Sanitizer report, ended with exit() */
+	{
+		entry->result = REPRODUCE_CRASH;
+		entry->code = WEXITSTATUS(status);
+	}
+	else if(WEXITSTATUS(status) != 0)
+	{
+		entry->result = REPRODUCE_EXIT;
+		entry->code = WEXITSTATUS(status);
+	}
+	else
+		entry->result = REPRODUCE_OK;
+}
+
+
+/* Run every entry in its own forked child, at most numJobs at once */
+static void RunEntries(ReproduceEntry* entries, size_t numEntries, long numJobs, unsigned timeout)
+{
+	/* Load the unwinder before any handler needs it */
+	{
+		void* frame;
+		backtrace(&frame, 1);
+	}
+
+	ReproduceJob* jobs = calloc(numJobs, sizeof(ReproduceJob));
+	size_t next = 0;
+	long running = 0;
+	while(next < numEntries || running > 0)
+	{
+		for(long j = 0; j < numJobs && next < numEntries; ++j)
+		{
+			if(jobs[j].pid)
+				continue;
+			StartJob(&jobs[j], entries, next++, timeout);
+			++running;
+		}
+
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if(pid < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			printf("waitpid failed: %m\n");
+			exit(1);
+		}
+
+		for(long j = 0; j < numJobs; ++j)
+		{
+			if(jobs[j].pid == pid)
+			{
+				FinishJob(&jobs[j], entries, status);
+				--running;
+				break;
+			}
+		}
+	}
+	free(jobs);
+}
+
+
+/* Quoted if it contains a separator, quote or line break, quotes doubled */
+static void WriteCsvField(FILE* out, const char* field)
+{
+	if(!strpbrk(field, ",\"\r\n"))
+	{
+		fputs(field, out);
+		return;
+	}
+
+	fputc('"', out);
+	for(const char* c = field; *c; ++c)
+	{
+		if(*c == '"')
+			fputc('"', out);
+		fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+
+/* Quoted JSON string, file names may contain anything but NUL */
+static void WriteJsonString(FILE* out, const char* str)
+{
+	fputc('"', out);
+	for(const unsigned char* c = (const unsigned char*)str; *c; ++c)
+	{
+		if(*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if(*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+
+static void WriteReproduceSummary(FILE* out, int json, ReproduceEntry* entries, size_t numEntries)
+{
+	if(json)
+		fprintf(out, "[\n");
+	else
+		fprintf(out, "file,result,code,stack_hash,duplicate_of,distance,min_distance\n");
+
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		ReproduceEntry* e = &entries[i];
+		const char* dup = e->duplicateOf != i ? entries[e->duplicateOf].path : "";
+
+		/* Empty (or null) without distance instrumentation or when no instrumented block ran */
+		char distance[32] = "", minDistance[32] = "";
+		if(e->distance >= 0)
+		{
+			snprintf(distance, sizeof(distance), "%.2f", e->distance);
+			snprintf(minDistance, sizeof(minDistance), "%llu", (unsigned long long)e->minDistance);
+		}
+
+		if(json)
+		{
+			fprintf(out, "  {\"file\": ");
+			WriteJsonString(out, e->path);
+			fprintf(out, ", \"result\": \"%s\", \"code\": %d, \"stack_hash\": \"%016llx\", \"duplicate_of\": ",
+					reproduceResultNames[e->result], e->code, (unsigned long long)e->stackHash);
+			WriteJsonString(out, dup);
+			fprintf(out, ", \"distance\": %s, \"min_distance\": %s}%s\n",
+					*distance ? distance : "null", *minDistance ? minDistance : "null",
+					i + 1 < numEntries ? "," : "");
+		}
+		else
+		{
+			WriteCsvField(out, e->path);
+			fprintf(out, ",%s,%d,%016llx,", reproduceResultNames[e->result], e->code, (unsigned long long)e->stackHash);
+			WriteCsvField(out, dup);
+			fprintf(out, ",%s,%s\n", distance, minDistance);
+		}
+	}
+
+	if(json)
+		fprintf(out, "]\n");
+}
+
+
+static const ReproduceEntry* sortEntries;
+
+static int CompareByStackHash(const void* a, const void* b)
+{
+	const ReproduceEntry* ea = &sortEntries[*(const size_t*)a];
+	const ReproduceEntry* eb = &sortEntries[*(const size_t*)b];
+	if(ea->result != eb->result)
+		return ea->result < eb->result ? -1 : 1;
+	if(ea->stackHash != eb->stackHash)
+		return ea->stackHash < eb->stackHash ? -1 : 1;
+	return *(const size_t*)a < *(const size_t*)b ? -1 : 1;
+}
+
+
+/**
+ * Run every input of a directory or list in its own forked child, spread over all cores.
+ * Crashes are deduplicated by the hash of their innermost stack frames.
+ */
+static int ReproduceBatch(int argc, char** argv)
+{
+	const char* dir = FindOption(argc, argv, reproduceDirOptionName);
+	const char* list = FindOption(argc, argv, reproduceListOptionName);
+	const char* packPath = FindOption(argc, argv, reproducePackOptionName);
+	const char* timeoutArg = FindOption(argc, argv, reproduceTimeoutOptionName);
+	const char* jobsArg = FindOption(argc, argv, reproduceJobsOptionName);
+	const char* outPath = FindOption(argc, argv, reproduceOutOptionName);
+
+	unsigned timeout = timeoutArg ? ParseNumberOption(timeoutArg, reproduceTimeoutOptionName) : 10;
+	long numJobs = jobsArg ? (long)ParseNumberOption(jobsArg, reproduceJobsOptionName) : sysconf(_SC_NPROCESSORS_ONLN);
+	if(numJobs < 1)
+		numJobs = 1;
+
+	ReproduceEntry* entries = NULL;
+	size_t numEntries = 0;
+	size_t allocEntries = 0;
+	if(dir)
+		CollectDirectory(dir, &entries, &numEntries, &allocEntries);
+	if(list)
+		CollectList(list, &entries, &numEntries, &allocEntries);
+	MackeFuzzerPack pack = { 0 };
+	if(packPath)
+		CollectPack(packPath, &pack, &entries, &numEntries, &allocEntries);
+
+	RunEntries(entries, numEntries, numJobs, timeout);
+
+	/* Deduplicate crashes by their stack hash - sorting keeps the first input of each hash in front */
+	size_t counts[sizeof(reproduceResultNames) / sizeof(reproduceResultNames[0])] = { 0 };
+	size_t uniqueCrashes = 0;
+	size_t reachedTargets = 0;
+	size_t* order = malloc(numEntries * sizeof(size_t));
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		order[i] = i;
+		entries[i].duplicateOf = i;
+		++counts[entries[i].result];
+		if(entries[i].distance >= 0 && entries[i].minDistance == 0)
+			++reachedTargets;
+	}
+	sortEntries = entries;
+	qsort(order, numEntries, sizeof(size_t), CompareByStackHash);
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		ReproduceEntry* e = &entries[order[i]];
+		if(e->result != REPRODUCE_CRASH)
+			continue;
+		ReproduceEntry* prev = i ? &entries[order[i - 1]] : NULL;
+		if(prev && prev->result == REPRODUCE_CRASH && prev->stackHash == e->stackHash)
+			e->duplicateOf = prev->duplicateOf;
+		else
+			++uniqueCrashes;
+	}
+	free(order);
+
+	FILE* out = stdout;
+	if(outPath)
+	{
+		out = fopen(outPath, "w");
+		if(!out)
+		{
+			printf("Failed to open '%s': %m\n", outPath);
+			exit(1);
+		}
+	}
+	size_t outPathLen = outPath ? strlen(outPath) : 0;
+	int json = outPathLen >= 5 && strcmp(outPath + outPathLen - 5, ".json") == 0;
+	WriteReproduceSummary(out, json, entries, numEntries);
+	if(out != stdout)
+		fclose(out);
+
+	fprintf(stderr, "%lu inputs: %lu ok, %lu crashes (%lu unique), %lu timeouts, %lu slow, %lu exits\n",
+			numEntries, counts[REPRODUCE_OK], counts[REPRODUCE_CRASH], uniqueCrashes,
+			counts[REPRODUCE_TIMEOUT], counts[REPRODUCE_SLOW], counts[REPRODUCE_EXIT]);
+	if(macke_fuzzer_distance_get)
+		fprintf(stderr, "%lu inputs reached the targets\n", reachedTargets);
+
+	for(size_t i = 0; i < numEntries; ++i)
+		free(entries[i].path);
+	free(entries);
+	if(packPath)
+		macke_fuzzer_pack_close(&pack);
+
+	return 0;
+}
+
+
+static int CompareStrings(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+static int CompareUint64(const void* a, const void* b)
+{
+	uint64_t va = *(const uint64_t*)a;
+	uint64_t vb = *(const uint64_t*)b;
+	return va < vb ? -1 : va > vb;
+}
+
+
+/**
+ * Replay the inputs a fast build found on this asan build of the same module.
+ * Every --asan-replay directory - the corpus of libFuzzer or the queue of afl - is scanned for inputs
+ * not replayed yet, which run in batches of --asan-replay-batch like --reproduce-dir does.
+ * With --asan-replay-interval the directories are rescanned until the process is killed.
+ */
+static int AsanReplay(int argc, char** argv)
+{
+	const char* batchArg = FindOption(argc, argv, asanReplayBatchOptionName);
+	const char* intervalArg = FindOption(argc, argv, asanReplayIntervalOptionName);
+	const char* timeoutArg = FindOption(argc, argv, reproduceTimeoutOptionName);
+	const char* jobsArg = FindOption(argc, argv, reproduceJobsOptionName);
+	const char* expectedHashArg = FindOption(argc, argv, expectLayoutHashOptionName);
+
+	size_t batchSize = batchArg ? ParseNumberOption(batchArg, asanReplayBatchOptionName) : 256;
+	unsigned interval = intervalArg ? ParseNumberOption(intervalArg, asanReplayIntervalOptionName) : 0;
+	unsigned timeout = timeoutArg ? ParseNumberOption(timeoutArg, reproduceTimeoutOptionName) : 10;
+	long numJobs = jobsArg ? (long)ParseNumberOption(jobsArg, reproduceJobsOptionName) : sysconf(_SC_NPROCESSORS_ONLN);
+	if(numJobs < 1)
+		numJobs = 1;
+	if(batchSize < 1)
+		batchSize = 1;
+
+	/* Inputs of a build with other drivers or layouts would be decoded into garbage */
+	if(expectedHashArg)
+	{
+		char* end;
+		errno = 0;
+		unsigned long long expected = strtoull(expectedHashArg, &end, 16);
+		if(errno || *end || !*expectedHashArg)
+		{
+			printf("%s argument has invalid format (no hex number)\n", expectLayoutHashOptionName);
+			exit(1);
+		}
+		if(!&macke_fuzzer_layout_hash)
+		{
+			printf("Built without layout hash, can not check it\n");
+			exit(1);
+		}
+		if(expected != macke_fuzzer_layout_hash)
+		{
+			printf("Layout hash %016llx does not match the expected %016llx, the builds come from different modules\n",
+					(unsigned long long)macke_fuzzer_layout_hash, expected);
+			exit(1);
+		}
+	}
+
+	/* Paths replayed in earlier rounds, sorted */
+	char** seen = NULL;
+	size_t numSeen = 0;
+	/* Stack hashes of all crashes reported so far, sorted */
+	uint64_t* crashes = NULL;
+	size_t numCrashes = 0;
+
+	for(unsigned round = 1; ; ++round)
+	{
+		ReproduceEntry* scanned = NULL;
+		size_t numScanned = 0;
+		size_t allocScanned = 0;
+		size_t optionLen = strlen(asanReplayOptionName);
+		for(int i = 1; i < argc; ++i)
+			if(strncmp(argv[i], asanReplayOptionName, optionLen) == 0)
+				CollectDirectory(argv[i] + optionLen, &scanned, &numScanned, &allocScanned);
+
+		/* Keep only new inputs */
+		ReproduceEntry* entries = malloc((numScanned ? numScanned : 1) * sizeof(ReproduceEntry));
+		size_t numEntries = 0;
+		for(size_t i = 0; i < numScanned; ++i)
+		{
+			char* path = scanned[i].path;
+			if(numSeen && bsearch(&path, seen, numSeen, sizeof(char*), CompareStrings))
+				free(path);
+			else
+				entries[numEntries++] = scanned[i];
+		}
+		free(scanned);
+
+		size_t newCrashes = 0, counts[sizeof(reproduceResultNames) / sizeof(reproduceResultNames[0])] = { 0 };
+		for(size_t start = 0; start < numEntries; start += batchSize)
+		{
+			size_t count = numEntries - start < batchSize ? numEntries - start : batchSize;
+			RunEntries(entries + start, count, numJobs, timeout);
+
+			for(size_t i = start; i < start + count; ++i)
+			{
+				ReproduceEntry* e = &entries[i];
+				++counts[e->result];
+				if(e->result != REPRODUCE_CRASH)
+					continue;
+				if(numCrashes && bsearch(&e->stackHash, crashes, numCrashes, sizeof(uint64_t), CompareUint64))
+					continue;
+
+				printf("crash,%s,%d,%016llx\n", e->path, e->code, (unsigned long long)e->stackHash);
+				fflush(stdout);
+				crashes = realloc(crashes, (numCrashes + 1) * sizeof(uint64_t));
+				crashes[numCrashes++] = e->stackHash;
+				qsort(crashes, numCrashes, sizeof(uint64_t), CompareUint64);
+				++newCrashes;
+			}
+		}
+
+		if(numEntries)
+		{
+			seen = realloc(seen, (numSeen + numEntries) * sizeof(char*));
+			for(size_t i = 0; i < numEntries; ++i)
+				seen[numSeen++] = entries[i].path;
+			qsort(seen, numSeen, sizeof(char*), CompareStrings);
+		}
+		free(entries);
+
+		fprintf(stderr, "Round %u: %lu new inputs, %lu crashes (%lu new), %lu timeouts, %lu slow, %lu exits\n",
+				round, numEntries, counts[REPRODUCE_CRASH], newCrashes,
+				counts[REPRODUCE_TIMEOUT], counts[REPRODUCE_SLOW], counts[REPRODUCE_EXIT]);
+
+		if(!interval)
+			break;
+		sleep(interval);
+	}
+
+	for(size_t i = 0; i < numSeen; ++i)
+		free(seen[i]);
+	free(seen);
+	free(crashes);
+	return numCrashes ? 2 : 0;
+}
+#endif
+
+/* In-process replay of a whole corpus on many threads, for throughput and latency measurements */
+
+#ifdef __REPRODUCE_FUZZING
+typedef struct
+{
+	MackeFuzzerDriver driver;
+	const ReproduceEntry* entries;
+	size_t numEntries;
+	size_t numExecs;     /* Every entry once per round */
+	size_t next;         /* Next exec to run, taken atomically by the threads */
+	uint64_t* latencies; /* Per exec, in nanoseconds */
+} ReplayState;
+
+/* Input the thread is running, named if it crashes */
+static __thread const char* replayCurrentInput;
+
+
+static uint64_t ReplayNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void ReplayNameInput(void)
+{
+	static const char prefix[] = "==MACKE== crash while replaying ";
+	const char* input = replayCurrentInput ? replayCurrentInput : "no input";
+	if(write(STDERR_FILENO, prefix, sizeof(prefix) - 1) < 0 || write(STDERR_FILENO, input, strlen(input)) < 0
+			|| write(STDERR_FILENO, "\n", 1) < 0)
+		return;
+}
+
+
+static void ReplayCrashHandler(int sig)
+{
+	ReplayNameInput();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+static void* ReplayThread(void* arg)
+{
+	ReplayState* state = arg;
+	size_t exec;
+	while((exec = __atomic_fetch_add(&state->next, 1, __ATOMIC_RELAXED)) < state->numExecs)
+	{
+		const ReproduceEntry* entry = &state->entries[exec % state->numEntries];
+		replayCurrentInput = entry->path;
+
+		uint64_t start = ReplayNow();
+		macke_fuzzer_driver_run(state->driver, entry->data, entry->size);
+		state->latencies[exec] = ReplayNow() - start;
+	}
+	replayCurrentInput = NULL;
+	return NULL;
+}
+
+
+static int CompareLatencies(const void* a, const void* b)
+{
+	uint64_t la = *(const uint64_t*)a;
+	uint64_t lb = *(const uint64_t*)b;
+	return la < lb ? -1 : la > lb;
+}
+
+
+/* Map the files of all entries not mapped yet, returns which entries have to be unmapped */
+static char* MapEntries(ReproduceEntry* entries, size_t numEntries)
+{
+	char* mapped = calloc(numEntries, 1);
+	if(!mapped)
+		exit(1);
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		ReproduceEntry* e = &entries[i];
+		if(e->data)
+			continue;
+
+		int fd = open(e->path, O_RDONLY);
+		struct stat st;
+		if(fd < 0 || fstat(fd, &st) < 0)
+		{
+			printf("Failed to open '%s': %m\n", e->path);
+			exit(1);
+		}
+		e->size = st.st_size;
+		if(st.st_size > 0)
+		{
+			void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(data == MAP_FAILED)
+			{
+				printf("Failed to map '%s': %m\n", e->path);
+				exit(1);
+			}
+			e->data = data;
+			mapped[i] = 1;
+		}
+		close(fd);
+	}
+	return mapped;
+}
+
+
+/**
+ * Run every input of a directory, list or packed corpus --replay-rounds times on --replay-threads threads
+ * of this process, through the reentrant driver API. Reports execs per second and the latency percentiles of the execs.
+ * A crash ends the whole replay, naming the input - use --reproduce-dir without threads to triage it.
+ */
+static int ReplayThreaded(int argc, char** argv)
+{
+	const char* driverName = FindOption(argc, argv, optionName);
+	const char* threadsArg = FindOption(argc, argv, replayThreadsOptionName);
+	const char* roundsArg = FindOption(argc, argv, replayRoundsOptionName);
+	const char* dir = FindOption(argc, argv, reproduceDirOptionName);
+	const char* list = FindOption(argc, argv, reproduceListOptionName);
+	const char* packPath = FindOption(argc, argv, reproducePackOptionName);
+	const char* outPath = FindOption(argc, argv, reproduceOutOptionName);
+
+	MackeFuzzerDriver driver = driverName ? macke_fuzzer_driver_find(driverName) : NULL;
+	if(!driver)
+	{
+		printf("%s needs the driver to replay with %s<function>\n", replayThreadsOptionName, optionName);
+		exit(1);
+	}
+
+	long numThreads = ParseNumberOption(threadsArg, replayThreadsOptionName);
+	size_t rounds = roundsArg ? ParseNumberOption(roundsArg, replayRoundsOptionName) : 1;
+	if(numThreads < 1)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(rounds < 1)
+		rounds = 1;
+
+	ReproduceEntry* entries = NULL;
+	size_t numEntries = 0;
+	size_t allocEntries = 0;
+	if(dir)
+		CollectDirectory(dir, &entries, &numEntries, &allocEntries);
+	if(list)
+		CollectList(list, &entries, &numEntries, &allocEntries);
+	MackeFuzzerPack pack = { 0 };
+	if(packPath)
+		CollectPack(packPath, &pack, &entries, &numEntries, &allocEntries);
+
+	if(!numEntries)
+	{
+		printf("No inputs to replay\n");
+		exit(1);
+	}
+
+	/* Map all files up front, so only the execs are measured */
+	char* mapped = MapEntries(entries, numEntries);
+
+	ReplayState state;
+	state.driver = driver;
+	state.entries = entries;
+	state.numEntries = numEntries;
+	state.numExecs = numEntries * rounds;
+	state.next = 0;
+	state.latencies = malloc(state.numExecs * sizeof(uint64_t));
+	if(!state.latencies)
+		exit(1);
+	if((size_t)numThreads > state.numExecs)
+		numThreads = state.numExecs;
+
+	static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTRAP };
+	for(size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); ++i)
+	{
+		struct sigaction old;
+		if(sigaction(crashSignals[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+			signal(crashSignals[i], ReplayCrashHandler);
+	}
+	if(__sanitizer_set_death_callback)
+		__sanitizer_set_death_callback(ReplayNameInput);
+
+	uint64_t start = ReplayNow();
+	pthread_t* threads = malloc(numThreads * sizeof(pthread_t));
+	for(long t = 0; t < numThreads; ++t)
+	{
+		if(pthread_create(&threads[t], NULL, ReplayThread, &state) != 0)
+		{
+			printf("pthread_create failed\n");
+			exit(1);
+		}
+	}
+	for(long t = 0; t < numThreads; ++t)
+		pthread_join(threads[t], NULL);
+	double seconds = (ReplayNow() - start) / 1e9;
+	free(threads);
+
+	/* Per input, before the latencies are sorted */
+	if(outPath)
+	{
+		FILE* out = fopen(outPath, "w");
+		if(!out)
+		{
+			printf("Failed to open '%s': %m\n", outPath);
+			exit(1);
+		}
+		fprintf(out, "file,execs,mean_ns,max_ns\n");
+		for(size_t i = 0; i < numEntries; ++i)
+		{
+			uint64_t sum = 0, max = 0;
+			for(size_t r = 0; r < rounds; ++r)
+			{
+				uint64_t latency = state.latencies[r * numEntries + i];
+				sum += latency;
+				if(latency > max)
+					max = latency;
+			}
+			WriteCsvField(out, entries[i].path);
+			fprintf(out, ",%lu,%llu,%llu\n", rounds,
+					(unsigned long long)(sum / rounds), (unsigned long long)max);
+		}
+		fclose(out);
+	}
+
+	qsort(state.latencies, state.numExecs, sizeof(uint64_t), CompareLatencies);
+	static const double percentiles[] = { 50, 90, 99, 99.9 };
+	fprintf(stderr, "%lu execs of %lu inputs on %ld threads in %.3f s: %.0f execs/s\n",
+			state.numExecs, numEntries, numThreads, seconds, seconds > 0 ? state.numExecs / seconds : 0);
+	fprintf(stderr, "latency ns: min %llu", (unsigned long long)state.latencies[0]);
+	for(size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i)
+		fprintf(stderr, ", p%g %llu", percentiles[i],
+				(unsigned long long)state.latencies[(size_t)(percentiles[i] / 100 * (state.numExecs - 1))]);
+	fprintf(stderr, ", max %llu\n", (unsigned long long)state.latencies[state.numExecs - 1]);
+	if(macke_fuzzer_exit_count && macke_fuzzer_exit_count())
+		fprintf(stderr, "%llu execs ended in an intercepted exit\n", (unsigned long long)macke_fuzzer_exit_count());
+	if(macke_fuzzer_loop_guard_exceeded_count && macke_fuzzer_loop_guard_exceeded_count())
+		fprintf(stderr, "%llu execs stopped by the loop guard\n", (unsigned long long)macke_fuzzer_loop_guard_exceeded_count());
+
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		if(mapped[i])
+			munmap((void*)entries[i].data, entries[i].size);
+		free(entries[i].path);
+	}
+	free(mapped);
+	free(entries);
+	free(state.latencies);
+	if(packPath)
+		macke_fuzzer_pack_close(&pack);
+	return 0;
+}
+
+/* Coverage of one input as the sorted indices of its guards */
+typedef struct
+{
+	uint32_t* guards;
+	size_t numGuards;
+} MinimizeCoverage;
+
+typedef struct
+{
+	const MackeFuzzerSchema* schema;
+	MackeFuzzerSplitInput input;
+	MinimizeCoverage required; /* Reached by the original input, every accepted candidate reaches it too */
+	MinimizeCoverage current;  /* Of the last accepted candidate */
+	size_t runs;
+	size_t maxRuns;
+	unsigned timeout;
+} MinimizeState;
+
+typedef struct
+{
+	uint8_t* data;
+	size_t size;
+	MinimizeCoverage coverage;
+	int kept;
+} MinimizedInput;
+
+
+/* Replay the input in a forked child like --reproduce-dir does, its coverage is read from the shared map */
+static ReproduceResult MinimizeRun(const uint8_t* data, size_t size, unsigned timeout, MinimizeCoverage* coverage)
+{
+	static const uint8_t empty = 0;
+	size_t numGuards = 0;
+	uint8_t* map = macke_fuzzer_coverage_map(&numGuards);
+	if(map)
+		memset(map, 0, numGuards + 1);
+
+	ReproduceEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.data = size ? data : &empty;
+	entry.size = size;
+	RunEntries(&entry, 1, 1, timeout);
+
+	coverage->numGuards = 0;
+	for(size_t g = 1; map && g <= numGuards; ++g)
+	{
+		if(!map[g])
+			continue;
+		coverage->guards = realloc(coverage->guards, (coverage->numGuards + 1) * sizeof(uint32_t));
+		if(!coverage->guards)
+			exit(1);
+		coverage->guards[coverage->numGuards++] = g;
+	}
+	return entry.result;
+}
+
+
+static int CoverageIncludes(const MinimizeCoverage* coverage, const MinimizeCoverage* required)
+{
+	size_t c = 0;
+	for(size_t r = 0; r < required->numGuards; ++r)
+	{
+		while(c < coverage->numGuards && coverage->guards[c] < required->guards[r])
+			++c;
+		if(c == coverage->numGuards || coverage->guards[c] != required->guards[r])
+			return 0;
+	}
+	return 1;
+}
+
+
+/* Join the split input with its hidden elements left out, accept it if it still reaches the required coverage */
+static int MinimizeTry(MinimizeState* state)
+{
+	size_t size;
+	uint8_t* data = macke_fuzzer_input_join(state->schema, &state->input, &size);
+	MinimizeCoverage coverage = { NULL, 0 };
+	++state->runs;
+
+	int accepted = MinimizeRun(data, size, state->timeout, &coverage) == REPRODUCE_OK
+			&& CoverageIncludes(&coverage, &state->required);
+	free(data);
+
+	if(accepted)
+	{
+		free(state->current.guards);
+		state->current = coverage;
+	}
+	else
+		free(coverage.guards);
+	return accepted;
+}
+
+
+/**
+ * Remove ever smaller chunks of elements, starting at the end of the buffer,
+ * then shrink the nested buffers of the elements that are left
+ */
+static void MinimizeBuffer(MinimizeState* state, MackeFuzzerBuffer* buffer)
+{
+	for(size_t chunk = buffer->numElements; chunk > 0; chunk /= 2)
+	{
+		for(size_t end = buffer->numElements; end >= chunk && state->runs < state->maxRuns; end -= chunk)
+		{
+			if(buffer->numElements - chunk < buffer->minElements)
+				break;
+
+			buffer->hiddenFirst = end - chunk;
+			buffer->hiddenCount = chunk;
+			if(MinimizeTry(state))
+				macke_fuzzer_buffer_remove(buffer, end - chunk, chunk);
+			buffer->hiddenCount = 0;
+		}
+	}
+
+	for(size_t i = 0; i < buffer->numChildren; ++i)
+		MinimizeBuffer(state, &buffer->children[i]);
+}
+
+
+static uint64_t HashInput(const uint8_t* data, size_t size)
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+/**
+ * Minimize a corpus with the layout of the driver instead of as opaque bytes.
+ * Every input is rewritten canonically - escapes only where needed, nothing the driver does not read -
+ * then every array and nested buffer is shrunk on its own as long as the input still reaches the coverage
+ * it had. Out of the shrunk inputs, a greedy covering set is written to --minimize-to.
+ * Coverage comes from -fsanitize-coverage=inline-8bit-counters or trace-pc-guard and coverage.c,
+ * without them the inputs are only rewritten canonically.
+ */
+static int MinimizeCorpus(int argc, char** argv)
+{
+	const char* driverName = FindOption(argc, argv, optionName);
+	const char* outDir = FindOption(argc, argv, minimizeOptionName);
+	const char* runsArg = FindOption(argc, argv, minimizeRunsOptionName);
+	const char* timeoutArg = FindOption(argc, argv, reproduceTimeoutOptionName);
+	const char* dir = FindOption(argc, argv, reproduceDirOptionName);
+	const char* list = FindOption(argc, argv, reproduceListOptionName);
+	const char* packPath = FindOption(argc, argv, reproducePackOptionName);
+
+	MackeFuzzerDriver driver = driverName ? macke_fuzzer_driver_find(driverName) : NULL;
+	if(!driver)
+	{
+		printf("%s needs the driver to minimize for with %s<function>\n", minimizeOptionName, optionName);
+		exit(1);
+	}
+
+	MackeFuzzerSchema schema;
+	if(macke_fuzzer_schema_parse(&schema, driver->layout) != 0)
+	{
+		printf("Invalid layout of '%s'\n", driverName);
+		exit(1);
+	}
+
+	if(mkdir(outDir, 0755) != 0 && errno != EEXIST)
+	{
+		printf("Failed to create '%s': %m\n", outDir);
+		exit(1);
+	}
+
+	size_t maxRuns = runsArg ? ParseNumberOption(runsArg, minimizeRunsOptionName) : 1000;
+	unsigned timeout = timeoutArg ? ParseNumberOption(timeoutArg, reproduceTimeoutOptionName) : 10;
+
+	size_t totalGuards = 0;
+	if(!macke_fuzzer_coverage_map(&totalGuards) || !totalGuards)
+		fprintf(stderr, "Warning: built without -fsanitize-coverage=inline-8bit-counters, the inputs are only rewritten canonically\n");
+
+	ReproduceEntry* entries = NULL;
+	size_t numEntries = 0;
+	size_t allocEntries = 0;
+	if(dir)
+		CollectDirectory(dir, &entries, &numEntries, &allocEntries);
+	if(list)
+		CollectList(list, &entries, &numEntries, &allocEntries);
+	MackeFuzzerPack pack = { 0 };
+	if(packPath)
+		CollectPack(packPath, &pack, &entries, &numEntries, &allocEntries);
+	char* mapped = MapEntries(entries, numEntries);
+
+	MinimizedInput* inputs = calloc(numEntries ? numEntries : 1, sizeof(MinimizedInput));
+	if(!inputs)
+		exit(1);
+
+	size_t numInputs = 0, bytesBefore = 0, failed = 0;
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		ReproduceEntry* e = &entries[i];
+		bytesBefore += e->size;
+
+		MinimizeState state;
+		memset(&state, 0, sizeof(state));
+		state.schema = &schema;
+		state.maxRuns = maxRuns;
+		state.timeout = timeout;
+
+		/* Inputs that do not end normally are no corpus entries, triage them with --reproduce-dir */
+		ReproduceResult result = MinimizeRun(e->data, e->size, timeout, &state.required);
+		if(result != REPRODUCE_OK)
+		{
+			fprintf(stderr, "Left out %s: %s\n", e->path, reproduceResultNames[result]);
+			free(state.required.guards);
+			++failed;
+			continue;
+		}
+
+		/* Keep the original if even the canonical form loses coverage, the driver is not deterministic then */
+		macke_fuzzer_input_split(&schema, e->data, e->size, &state.input);
+		MinimizedInput* input = &inputs[numInputs++];
+		if(MinimizeTry(&state))
+		{
+			for(size_t a = 0; a < state.input.numArgs && totalGuards; ++a)
+				MinimizeBuffer(&state, &state.input.args[a]);
+			input->data = macke_fuzzer_input_join(&schema, &state.input, &input->size);
+			input->coverage = state.current;
+		}
+		else
+		{
+			input->data = malloc(e->size ? e->size : 1);
+			if(!input->data)
+				exit(1);
+			memcpy(input->data, e->data, e->size);
+			input->size = e->size;
+			input->coverage = state.required;
+			state.required.guards = NULL;
+		}
+
+		macke_fuzzer_input_free(&state.input);
+		free(state.required.guards);
+	}
+
+	/* Greedy covering set: take the input adding the most guards, the smaller one on a tie */
+	uint8_t* covered = calloc(totalGuards + 1, 1);
+	if(!covered)
+		exit(1);
+	size_t numKept = 0, bytesAfter = 0, numCovered = 0;
+	while(1)
+	{
+		size_t best = numInputs, bestNew = 0;
+		for(size_t i = 0; i < numInputs; ++i)
+		{
+			if(inputs[i].kept)
+				continue;
+			size_t numNew = 0;
+			for(size_t g = 0; g < inputs[i].coverage.numGuards; ++g)
+				numNew += !covered[inputs[i].coverage.guards[g]];
+			if(best == numInputs || numNew > bestNew || (numNew == bestNew && inputs[i].size < inputs[best].size))
+			{
+				best = i;
+				bestNew = numNew;
+			}
+		}
+		/* Without coverage every distinct input is kept */
+		if(best == numInputs || (totalGuards && !bestNew))
+			break;
+
+		inputs[best].kept = 1;
+		for(size_t g = 0; g < inputs[best].coverage.numGuards; ++g)
+			covered[inputs[best].coverage.guards[g]] = 1;
+		numCovered += bestNew;
+	}
+
+	for(size_t i = 0; i < numInputs; ++i)
+	{
+		if(inputs[i].kept)
+		{
+			/* Named by content, equal inputs end up in one file */
+			char path[4096];
+			snprintf(path, sizeof(path), "%s/%016llx", outDir, (unsigned long long)HashInput(inputs[i].data, inputs[i].size));
+			int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if(fd < 0 && errno == EEXIST)
+			{
+				free(inputs[i].data);
+				free(inputs[i].coverage.guards);
+				continue;
+			}
+			if(fd < 0)
+			{
+				printf("Failed to create '%s': %m\n", path);
+				exit(1);
+			}
+			WriteToFile(fd, (const char*)inputs[i].data, inputs[i].size);
+			close(fd);
+			++numKept;
+			bytesAfter += inputs[i].size;
+		}
+		free(inputs[i].data);
+		free(inputs[i].coverage.guards);
+	}
+
+	fprintf(stderr, "%lu inputs with %lu bytes minimized to %lu inputs with %lu bytes", numEntries, bytesBefore, numKept, bytesAfter);
+	if(totalGuards)
+		fprintf(stderr, ", covering %lu of %lu guards", numCovered, totalGuards);
+	if(failed)
+		fprintf(stderr, ", %lu inputs left out", failed);
+	fprintf(stderr, "\n");
+
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		if(mapped[i])
+			munmap((void*)entries[i].data, entries[i].size);
+		free(entries[i].path);
+	}
+	free(covered);
+	free(inputs);
+	free(mapped);
+	free(entries);
+	macke_fuzzer_schema_free(&schema);
+	if(packPath)
+		macke_fuzzer_pack_close(&pack);
+	return failed ? 2 : 0;
+}
+
+
+/**
+ * Header of the file --measure-coverage writes. The driver name follows it, without NUL,
+ * then the bitmap: bit (g - 1) % 8 of byte (g - 1) / 8 is set if guard g was reached, in host byte order.
+ * Guards are numbered per binary, only bitmaps of the same binary can be merged.
+ */
+typedef struct
+{
+	char magic[8];       /* MACKECOV */
+	uint32_t version;
+	uint32_t nameLen;
+	uint64_t numGuards;
+	uint64_t numInputs;
+	uint64_t numCovered;
+} CoverageHeader;
+
+
+/* Add the guards set in map to bitmap, returns how many were new */
+static size_t MergeCoverage(const uint8_t* map, size_t numGuards, uint8_t* bitmap)
+{
+	size_t numNew = 0;
+	for(size_t g = 1; g <= numGuards; ++g)
+	{
+		if(!map[g])
+			continue;
+		uint8_t bit = 1 << ((g - 1) % 8);
+		if(!(bitmap[(g - 1) / 8] & bit))
+		{
+			bitmap[(g - 1) / 8] |= bit;
+			++numNew;
+		}
+	}
+	return numNew;
+}
+
+
+/**
+ * Replay a corpus directory or packed corpus through the driver in this process and write the guards
+ * of -fsanitize-coverage=inline-8bit-counters or trace-pc-guard it reached as bitmap, see CoverageHeader.
+ * With --reproduce-out, also writes how many guards every input reached and how many of them were new.
+ * A crash ends the measurement naming the input, triage it with --reproduce-dir.
+ */
+static int MeasureCoverage(int argc, char** argv)
+{
+	const char* driverName = FindOption(argc, argv, optionName);
+	const char* csvPath = FindOption(argc, argv, reproduceOutOptionName);
+	const char* corpus = NULL;
+	const char* outPath = NULL;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strncmp(argv[i], measureCoverageOptionName, sizeof(measureCoverageOptionName) - 1) == 0)
+		{
+			corpus = argv[i] + sizeof(measureCoverageOptionName) - 1;
+			outPath = i + 1 < argc ? argv[i + 1] : NULL;
+		}
+	}
+
+	if(!outPath)
+	{
+		printf("Usage: %s %s<function> %s<corpus> <out>\n", argv[0], optionName, measureCoverageOptionName);
+		exit(1);
+	}
+
+	MackeFuzzerDriver driver = driverName ? macke_fuzzer_driver_find(driverName) : NULL;
+	if(!driver)
+	{
+		printf("%s needs the driver to measure with %s<function>\n", measureCoverageOptionName, optionName);
+		exit(1);
+	}
+
+	size_t numGuards = 0;
+	uint8_t* map = macke_fuzzer_coverage_map(&numGuards);
+	if(!map || !numGuards)
+	{
+		printf("Built without -fsanitize-coverage=inline-8bit-counters, there is no coverage to measure\n");
+		exit(1);
+	}
+
+	ReproduceEntry* entries = NULL;
+	size_t numEntries = 0;
+	size_t allocEntries = 0;
+	MackeFuzzerPack pack = { 0 };
+	struct stat st;
+	int isPack = stat(corpus, &st) == 0 && !S_ISDIR(st.st_mode);
+	if(isPack)
+		CollectPack(corpus, &pack, &entries, &numEntries, &allocEntries);
+	else
+		CollectDirectory(corpus, &entries, &numEntries, &allocEntries);
+	char* mapped = MapEntries(entries, numEntries);
+
+	FILE* csv = NULL;
+	if(csvPath)
+	{
+		csv = fopen(csvPath, "w");
+		if(!csv)
+		{
+			printf("Failed to open '%s': %m\n", csvPath);
+			exit(1);
+		}
+		fprintf(csv, "file,guards,new_guards\n");
+	}
+
+	uint8_t* bitmap = calloc((numGuards + 7) / 8, 1);
+	if(!bitmap)
+		exit(1);
+
+	static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTRAP };
+	for(size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); ++i)
+	{
+		struct sigaction old;
+		if(sigaction(crashSignals[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+			signal(crashSignals[i], ReplayCrashHandler);
+	}
+	if(__sanitizer_set_death_callback)
+		__sanitizer_set_death_callback(ReplayNameInput);
+
+	/* Guards the initialization reached count as well, every input runs through them */
+	macke_fuzzer_coverage_collect();
+	size_t numCovered = MergeCoverage(map, numGuards, bitmap);
+	uint64_t start = ReplayNow();
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		/* Per input coverage needs a clean map, the total does not */
+		if(csv)
+			memset(map + 1, 0, numGuards);
+
+		replayCurrentInput = entries[i].path;
+		macke_fuzzer_driver_run(driver, entries[i].data, entries[i].size);
+		/* After every input, before the counters wrap */
+		macke_fuzzer_coverage_collect();
+
+		if(csv)
+		{
+			size_t numReached = 0;
+			for(size_t g = 1; g <= numGuards; ++g)
+				numReached += map[g];
+			size_t numNew = MergeCoverage(map, numGuards, bitmap);
+			numCovered += numNew;
+			WriteCsvField(csv, entries[i].path);
+			fprintf(csv, ",%lu,%lu\n", numReached, numNew);
+		}
+	}
+	replayCurrentInput = NULL;
+	if(!csv)
+		numCovered += MergeCoverage(map, numGuards, bitmap);
+	double seconds = (ReplayNow() - start) / 1e9;
+
+	int fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		printf("Failed to create '%s': %m\n", outPath);
+		exit(1);
+	}
+	CoverageHeader header = { { 0 }, 1, strlen(driver->name), numGuards, numEntries, numCovered };
+	memcpy(header.magic, "MACKECOV", sizeof(header.magic));
+	WriteToFile(fd, (const char*)&header, sizeof(header));
+	WriteToFile(fd, driver->name, header.nameLen);
+	WriteToFile(fd, (const char*)bitmap, (numGuards + 7) / 8);
+	close(fd);
+
+	fprintf(stderr, "%lu inputs of %s covered %lu of %lu guards (%.1f%%) in %.3f s\n", numEntries, driver->name,
+			numCovered, numGuards, 100.0 * numCovered / numGuards, seconds);
+	if(macke_fuzzer_exit_count && macke_fuzzer_exit_count())
+		fprintf(stderr, "%llu execs ended in an intercepted exit\n", (unsigned long long)macke_fuzzer_exit_count());
+	if(macke_fuzzer_loop_guard_exceeded_count && macke_fuzzer_loop_guard_exceeded_count())
+		fprintf(stderr, "%llu execs stopped by the loop guard\n", (unsigned long long)macke_fuzzer_loop_guard_exceeded_count());
+
+	for(size_t i = 0; i < numEntries; ++i)
+	{
+		if(mapped[i])
+			munmap((void*)entries[i].data, entries[i].size);
+		free(entries[i].path);
+	}
+	if(csv)
+		fclose(csv);
+	free(bitmap);
+	free(mapped);
+	free(entries);
+	if(isPack)
+		macke_fuzzer_pack_close(&pack);
+	return 0;
+}
+#endif
+
+/* Main for calling test case */
+
+#ifdef __REPRODUCE_FUZZING
+int main(int argc, char** argv)
+{
+	/* Initialize driver to be used */
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	/* Measure the throughput of the driver on a whole corpus */
+	if(FindOption(argc, argv, replayThreadsOptionName))
+		return ReplayThreaded(argc, argv);
+
+	/* Shrink a whole corpus to a covering set of canonical inputs */
+	if(FindOption(argc, argv, minimizeOptionName))
+		return MinimizeCorpus(argc, argv);
+
+	/* Coverage of a whole corpus, in this process */
+	if(FindOption(argc, argv, measureCoverageOptionName))
+		return MeasureCoverage(argc, argv);
+
+	/* Triage a whole directory or list of inputs instead of stdin */
+	if(FindOption(argc, argv, reproduceDirOptionName) || FindOption(argc, argv, reproduceListOptionName)
+			|| FindOption(argc, argv, reproducePackOptionName))
+		return ReproduceBatch(argc, argv);
+
+	/* Replay the inputs of the fast build on this asan build */
+	if(FindOption(argc, argv, asanReplayOptionName))
+		return AsanReplay(argc, argv);
+
+	/* Read from stdin into buffer */
+	const size_t initialBufSize = 0x1000;
+	size_t bufAlloc = initialBufSize;
+	size_t bufUsage = 0;
+	ssize_t bytesRead;
+	char* buf = malloc(bufAlloc);
+
+	while(1)
+	{
+		bytesRead = read(STDIN_FILENO, buf + bufUsage, bufAlloc - bufUsage);
+		if(bytesRead < 0)
+		{
+			printf("read error...\n");
+			exit(1);
+		}
+		if(bytesRead == 0)
+			break;
+
+		bufUsage += bytesRead;
+		if(bufAlloc - bufUsage < 0x10)
+		{
+			size_t newAlloc = bufAlloc * 2;
+			char* newBuf = realloc(buf, newAlloc);
+			if(!newBuf)
+				exit(1);
+			buf = newBuf;
+			bufAlloc = newAlloc;
+		}
+	}
+
+	/* Give fuzzy input to driver */
+	DRIVER_PTR_ID((const uint8_t*)buf, bufUsage);
+	free(buf);
+	return ExecStatus();
+}
 #endif
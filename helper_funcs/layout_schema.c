@@ -0,0 +1,709 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout_schema.h"
+#include "../src/Config.h"
+
+/* From buffer_extract.c */
+size_t macke_fuzzer_array_byte_size(const uint8_t* src, size_t max);
+const uint8_t* macke_fuzzer_array_extract(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen);
+
+
+typedef struct
+{
+	uint64_t node;
+	uint64_t offset;
+	uint64_t kind;
+	uint64_t pointee;
+} SchemaField;
+
+
+static void* Grow(void* ptr, size_t count, size_t* alloc, size_t elemSize)
+{
+	if(count < *alloc)
+		return ptr;
+	*alloc = *alloc ? *alloc * 2 : 8;
+	ptr = realloc(ptr, *alloc * elemSize);
+	if(!ptr)
+		abort();
+	return ptr;
+}
+
+
+static MackeFuzzerArgKind ParseKind(const char* kind, int* ok)
+{
+	*ok = 1;
+	if(strcmp(kind, "value") == 0)
+		return MACKE_FUZZER_ARG_VALUE;
+	if(strcmp(kind, "array") == 0)
+		return MACKE_FUZZER_ARG_ARRAY;
+	if(strcmp(kind, "length") == 0)
+		return MACKE_FUZZER_ARG_LENGTH;
+	if(strcmp(kind, "sret") == 0)
+		return MACKE_FUZZER_ARG_SRET;
+	if(strcmp(kind, "callback") == 0)
+		return MACKE_FUZZER_ARG_CALLBACK;
+	if(strcmp(kind, "pinned") == 0)
+		return MACKE_FUZZER_ARG_PINNED;
+	*ok = 0;
+	return MACKE_FUZZER_ARG_VALUE;
+}
+
+
+/* Parse the optional flags behind the size of an arg line */
+static int ParseArgFlags(char* flags, MackeFuzzerSchemaArg* arg, uint64_t* nestedNode)
+{
+	char* save;
+	for(char* tok = strtok_r(flags, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save))
+	{
+		if(strcmp(tok, "string") == 0)
+			arg->isString = 1;
+		else if(strcmp(tok, "pair") == 0)
+		{
+			char* value = strtok_r(NULL, " \t", &save);
+			if(!value)
+				return -1;
+			arg->hasPair = 1;
+			arg->pairedArg = strtoul(value, NULL, 10);
+		}
+		else if(strcmp(tok, "nested") == 0)
+		{
+			char* value = strtok_r(NULL, " \t", &save);
+			if(!value)
+				return -1;
+			*nestedNode = strtoull(value, NULL, 10);
+		}
+		else if(strcmp(tok, "value") == 0)
+		{
+			char* value = strtok_r(NULL, " \t", &save);
+			if(!value || strlen(value) != 2 * arg->size || arg->pinnedBytes)
+				return -1;
+			arg->pinnedBytes = malloc(arg->size ? arg->size : 1);
+			if(!arg->pinnedBytes)
+				abort();
+			for(size_t i = 0; i < arg->size; ++i)
+			{
+				char digits[3] = { value[2 * i], value[2 * i + 1], 0 };
+				char* end;
+				arg->pinnedBytes[i] = strtoul(digits, &end, 16);
+				if(*end)
+					return -1;
+			}
+		}
+		else
+			return -1;
+	}
+	return 0;
+}
+
+
+int macke_fuzzer_schema_parse(MackeFuzzerSchema* schema, const char* text)
+{
+	memset(schema, 0, sizeof(*schema));
+
+	size_t allocArgs = 0, allocNodes = 0, allocFields = 0, numFields = 0;
+	uint64_t* nestedNodes = NULL; /* Per arg, resolved once all nodes are known */
+	SchemaField* fields = NULL;
+	int version = 0;
+
+	char* copy = strdup(text);
+	if(!copy)
+		abort();
+
+	char* save;
+	for(char* line = strtok_r(copy, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+	{
+		char word[64], name[512], kind[32];
+		uint64_t a, b, c;
+		int consumed = 0;
+
+		if(line[0] == '#' || sscanf(line, "%63s", word) != 1)
+			continue;
+
+		if(strcmp(word, MACKE_FUZZER_SCHEMA_MAGIC) == 0 && sscanf(line, "%*s %d", &version) == 1)
+			continue;
+		if(strcmp(word, "function") == 0 && sscanf(line, "%*s %511s", name) == 1)
+		{
+			free(schema->function);
+			schema->function = strdup(name);
+			continue;
+		}
+		if(strcmp(word, "max-depth") == 0 && sscanf(line, "%*s %u", &schema->maxDepth) == 1)
+			continue;
+
+		if(strcmp(word, "arg") == 0 && sscanf(line, "%*s %511s %31s %llu %n", name, kind, (unsigned long long*)&a, &consumed) == 3)
+		{
+			int ok;
+			size_t argNo = schema->numArgs;
+			schema->args = Grow(schema->args, argNo, &allocArgs, sizeof(MackeFuzzerSchemaArg));
+			nestedNodes = realloc(nestedNodes, allocArgs * sizeof(uint64_t));
+			if(!nestedNodes)
+				abort();
+
+			MackeFuzzerSchemaArg* arg = &schema->args[argNo];
+			memset(arg, 0, sizeof(*arg));
+			arg->kind = ParseKind(kind, &ok);
+			arg->name = strdup(name);
+			arg->size = a;
+			nestedNodes[argNo] = UINT64_MAX;
+			++schema->numArgs;
+
+			if(ok && ParseArgFlags(line + consumed, arg, &nestedNodes[argNo]) == 0)
+				continue;
+		}
+		else if(strcmp(word, "node") == 0 && sscanf(line, "%*s %llu %llu", (unsigned long long*)&a, (unsigned long long*)&b) == 2
+				&& a == schema->numNodes)
+		{
+			schema->nodes = Grow(schema->nodes, schema->numNodes, &allocNodes, sizeof(MackeFuzzerLayout));
+			memset(&schema->nodes[schema->numNodes], 0, sizeof(MackeFuzzerLayout));
+			schema->nodes[schema->numNodes].elementSize = b;
+			++schema->numNodes;
+			continue;
+		}
+		else if(strcmp(word, "field") == 0 && sscanf(line, "%*s %llu %llu %31s", (unsigned long long*)&a, (unsigned long long*)&b, kind) == 3)
+		{
+			fields = Grow(fields, numFields, &allocFields, sizeof(SchemaField));
+			SchemaField* field = &fields[numFields];
+			field->node = a;
+			field->offset = b;
+			field->pointee = 0;
+			if(strcmp(kind, "function") == 0)
+			{
+				field->kind = MACKE_FUZZER_FIELD_FUNCTION;
+				++numFields;
+				continue;
+			}
+			if(strcmp(kind, "data") == 0 && sscanf(line, "%*s %*s %*s %*s %llu", (unsigned long long*)&c) == 1)
+			{
+				field->kind = MACKE_FUZZER_FIELD_DATA;
+				field->pointee = c;
+				++numFields;
+				continue;
+			}
+		}
+
+		fprintf(stderr, "Invalid layout schema line: %s\n", line);
+		goto error;
+	}
+
+	if(version != MACKE_FUZZER_SCHEMA_VERSION || !schema->function)
+	{
+		fprintf(stderr, "Layout schema has no '" MACKE_FUZZER_SCHEMA_MAGIC " %d' header or no function\n", MACKE_FUZZER_SCHEMA_VERSION);
+		goto error;
+	}
+
+	/* Group the fields by node, the nodes reference their fields as one array */
+	schema->fields = calloc(numFields ? numFields : 1, sizeof(MackeFuzzerField));
+	if(!schema->fields)
+		abort();
+	size_t next = 0;
+	for(size_t n = 0; n < schema->numNodes; ++n)
+	{
+		schema->nodes[n].fields = &schema->fields[next];
+		for(size_t f = 0; f < numFields; ++f)
+		{
+			if(fields[f].node != n)
+				continue;
+			if(fields[f].kind == MACKE_FUZZER_FIELD_DATA && fields[f].pointee >= schema->numNodes)
+			{
+				fprintf(stderr, "Layout schema field points to unknown node %llu\n", (unsigned long long)fields[f].pointee);
+				goto error;
+			}
+			MackeFuzzerField* field = &schema->fields[next++];
+			field->offset = fields[f].offset;
+			field->kind = fields[f].kind;
+			field->pointee = field->kind == MACKE_FUZZER_FIELD_DATA ? &schema->nodes[fields[f].pointee] : NULL;
+			field->stub = NULL;
+			++schema->nodes[n].numFields;
+		}
+	}
+	if(next != numFields)
+	{
+		fprintf(stderr, "Layout schema has fields of unknown nodes\n");
+		goto error;
+	}
+
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		if(nestedNodes[i] == UINT64_MAX)
+			continue;
+		if(nestedNodes[i] >= schema->numNodes)
+		{
+			fprintf(stderr, "Layout schema argument %s has unknown nested node\n", schema->args[i].name);
+			goto error;
+		}
+		schema->args[i].nested = &schema->nodes[nestedNodes[i]];
+	}
+
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		if(schema->args[i].hasPair && schema->args[i].pairedArg >= schema->numArgs)
+		{
+			fprintf(stderr, "Layout schema argument %s is paired with unknown argument\n", schema->args[i].name);
+			goto error;
+		}
+	}
+
+	free(nestedNodes);
+	free(fields);
+	free(copy);
+	return 0;
+
+error:
+	free(nestedNodes);
+	free(fields);
+	free(copy);
+	macke_fuzzer_schema_free(schema);
+	return -1;
+}
+
+
+int macke_fuzzer_schema_load(MackeFuzzerSchema* schema, const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if(!file)
+		return -1;
+
+	size_t size = 0, alloc = 4096;
+	char* text = malloc(alloc);
+	if(!text)
+		abort();
+	size_t got;
+	while((got = fread(text + size, 1, alloc - size - 1, file)) > 0)
+	{
+		size += got;
+		if(alloc - size - 1 == 0)
+		{
+			alloc *= 2;
+			text = realloc(text, alloc);
+			if(!text)
+				abort();
+		}
+	}
+	fclose(file);
+	text[size] = 0;
+
+	int ret = macke_fuzzer_schema_parse(schema, text);
+	free(text);
+	return ret;
+}
+
+
+void macke_fuzzer_schema_free(MackeFuzzerSchema* schema)
+{
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		free(schema->args[i].name);
+		free(schema->args[i].pinnedBytes);
+	}
+	free(schema->args);
+	free(schema->nodes);
+	free(schema->fields);
+	free(schema->function);
+	memset(schema, 0, sizeof(*schema));
+}
+
+
+static MackeFuzzerObject* AddObject(MackeFuzzerObjects* objects, size_t* alloc, const char* name, size_t numBytes)
+{
+	objects->objects = Grow(objects->objects, objects->count, alloc, sizeof(MackeFuzzerObject));
+	MackeFuzzerObject* obj = &objects->objects[objects->count++];
+	obj->name = strdup(name);
+	obj->numBytes = numBytes;
+	obj->bytes = calloc(numBytes ? numBytes : 1, 1);
+	if(!obj->name || !obj->bytes)
+		abort();
+	return obj;
+}
+
+
+/**
+ * Zero the pointers the decoder stored into count elements at dst and into the buffers it allocated below them.
+ * They are addresses of this process, the buffers they point to are objects of their own.
+ * Visits the buffers in the order macke_fuzzer_decode_nested allocated them, next is the index of the first one below dst.
+ */
+static void ClearPointers(uint8_t* dst, size_t count, const MackeFuzzerLayout* layout, size_t depth,
+		const MackeFuzzerAllocList* allocs, size_t* next)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		for(uint64_t f = 0; f < layout->numFields; ++f)
+		{
+			const MackeFuzzerField* field = &layout->fields[f];
+			memset(dst + i * layout->elementSize + field->offset, 0, sizeof(void*));
+			if(field->kind == MACKE_FUZZER_FIELD_FUNCTION || depth == 0 || *next >= allocs->count)
+				continue;
+
+			/* Empty buffers were decoded with one element, followed by the trailing 0 */
+			size_t k = (*next)++;
+			if(field->pointee->numFields)
+				ClearPointers(allocs->ptrs[k], (allocs->sizes[k] - 1) / field->pointee->elementSize,
+						field->pointee, depth - 1, allocs, next);
+		}
+	}
+}
+
+
+void macke_fuzzer_schema_decode(const MackeFuzzerSchema* schema, const uint8_t* data, size_t size, MackeFuzzerObjects* objects)
+{
+	size_t alloc = 0;
+	size_t* elementCounts = calloc(schema->numArgs ? schema->numArgs : 1, sizeof(size_t));
+	MackeFuzzerAllocList* nested = calloc(schema->numArgs ? schema->numArgs : 1, sizeof(MackeFuzzerAllocList));
+	if(!elementCounts || !nested)
+		abort();
+
+	objects->count = 0;
+	objects->objects = NULL;
+
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		const MackeFuzzerSchemaArg* arg = &schema->args[i];
+
+		if(arg->kind == MACKE_FUZZER_ARG_VALUE)
+		{
+			/* Missing bytes stay 0 */
+			MackeFuzzerObject* obj = AddObject(objects, &alloc, arg->name, arg->size);
+			size_t copy = size < arg->size ? size : arg->size;
+			memcpy(obj->bytes, data, copy);
+			data += copy;
+			size -= copy;
+		}
+		else if(arg->kind == MACKE_FUZZER_ARG_ARRAY)
+		{
+			size_t elemSize = arg->size ? arg->size : 1;
+			elementCounts[i] = macke_fuzzer_array_byte_size(data, size) / elemSize;
+			size_t arrayBytes = elementCounts[i] * elemSize;
+
+			/* Strings get the same terminating 0 the driver appends */
+			MackeFuzzerObject* obj = AddObject(objects, &alloc, arg->name, arrayBytes + (arg->isString ? 1 : 0));
+			const uint8_t* next = macke_fuzzer_array_extract(data, size, obj->bytes, arrayBytes);
+			size -= next - data;
+			data = next;
+
+			if(arg->nested)
+			{
+				next = macke_fuzzer_decode_nested(data, size, obj->bytes, elementCounts[i], arg->nested, schema->maxDepth, &nested[i]);
+				size -= next - data;
+				data = next;
+			}
+		}
+		else if(arg->kind == MACKE_FUZZER_ARG_PINNED)
+		{
+			/* Not part of the input, but klee still needs the value the driver passes */
+			MackeFuzzerObject* obj = AddObject(objects, &alloc, arg->name, arg->size);
+			if(arg->pinnedBytes)
+				memcpy(obj->bytes, arg->pinnedBytes, arg->size);
+		}
+		else /* Not part of the input, lengths are filled in below */
+			AddObject(objects, &alloc, arg->name, 0);
+	}
+
+	/* Length arguments hold the element count of their array, truncated to their width */
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		const MackeFuzzerSchemaArg* arg = &schema->args[i];
+		if(arg->kind != MACKE_FUZZER_ARG_LENGTH || !arg->hasPair)
+			continue;
+
+		uint64_t count = elementCounts[arg->pairedArg];
+		MackeFuzzerObject* obj = &objects->objects[i];
+		free(obj->bytes);
+		obj->numBytes = arg->size;
+		obj->bytes = calloc(arg->size ? arg->size : 1, 1);
+		if(!obj->bytes)
+			abort();
+		memcpy(obj->bytes, &count, arg->size < sizeof(count) ? arg->size : sizeof(count));
+	}
+
+	/* Pointers between the objects would be addresses of this process, they stay 0 */
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		size_t next = 0;
+		if(schema->args[i].kind == MACKE_FUZZER_ARG_ARRAY && schema->args[i].nested)
+			ClearPointers(objects->objects[i].bytes, elementCounts[i], schema->args[i].nested, schema->maxDepth, &nested[i], &next);
+	}
+
+	/* Nested buffers follow the arguments */
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		char nameBuf[600];
+		for(size_t k = 0; k < nested[i].count; ++k)
+		{
+			snprintf(nameBuf, sizeof(nameBuf), "%s.%lu", schema->args[i].name, k);
+			MackeFuzzerObject* obj = AddObject(objects, &alloc, nameBuf, nested[i].sizes[k]);
+			memcpy(obj->bytes, nested[i].ptrs[k], nested[i].sizes[k]);
+		}
+		macke_fuzzer_free_allocs(&nested[i]);
+	}
+
+	free(nested);
+	free(elementCounts);
+}
+
+
+void macke_fuzzer_objects_free(MackeFuzzerObjects* objects)
+{
+	for(size_t i = 0; i < objects->count; ++i)
+	{
+		free(objects->objects[i].name);
+		free(objects->objects[i].bytes);
+	}
+	free(objects->objects);
+	objects->count = 0;
+	objects->objects = NULL;
+}
+
+
+static size_t CountDataFields(const MackeFuzzerLayout* layout)
+{
+	size_t count = 0;
+	for(uint64_t f = 0; f < layout->numFields; ++f)
+		count += layout->fields[f].kind == MACKE_FUZZER_FIELD_DATA;
+	return count;
+}
+
+
+static void SplitBuffer(const uint8_t** data, size_t* size, MackeFuzzerBuffer* buffer, size_t elementSize)
+{
+	buffer->elementSize = elementSize;
+	buffer->numElements = macke_fuzzer_array_byte_size(*data, *size) / elementSize;
+	buffer->bytes = calloc(buffer->numElements * elementSize + 1, 1);
+	if(!buffer->bytes)
+		abort();
+
+	const uint8_t* next = macke_fuzzer_array_extract(*data, *size, buffer->bytes, buffer->numElements * elementSize);
+	*size -= next - *data;
+	*data = next;
+}
+
+
+/* Same walk as macke_fuzzer_decode_nested, count elements of buffer hold pointers described by layout */
+static void SplitNested(const uint8_t** data, size_t* size, MackeFuzzerBuffer* buffer, size_t count,
+		const MackeFuzzerLayout* layout, size_t depth)
+{
+	buffer->childrenPerElement = depth > 0 ? CountDataFields(layout) : 0;
+	buffer->numChildren = count * buffer->childrenPerElement;
+	if(!buffer->numChildren)
+		return;
+
+	buffer->children = calloc(buffer->numChildren, sizeof(MackeFuzzerBuffer));
+	if(!buffer->children)
+		abort();
+
+	MackeFuzzerBuffer* child = buffer->children;
+	for(size_t i = 0; i < count; ++i)
+	{
+		for(uint64_t f = 0; f < layout->numFields; ++f)
+		{
+			const MackeFuzzerField* field = &layout->fields[f];
+			if(field->kind != MACKE_FUZZER_FIELD_DATA)
+				continue;
+
+			SplitBuffer(data, size, child, field->pointee->elementSize);
+			if(field->pointee->numFields)
+			{
+				child->minElements = 1;
+				SplitNested(data, size, child, child->numElements ? child->numElements : 1, field->pointee, depth - 1);
+			}
+			++child;
+		}
+	}
+}
+
+
+void macke_fuzzer_input_split(const MackeFuzzerSchema* schema, const uint8_t* data, size_t size, MackeFuzzerSplitInput* input)
+{
+	input->numArgs = schema->numArgs;
+	input->args = calloc(schema->numArgs ? schema->numArgs : 1, sizeof(MackeFuzzerBuffer));
+	if(!input->args)
+		abort();
+
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		const MackeFuzzerSchemaArg* arg = &schema->args[i];
+		MackeFuzzerBuffer* buffer = &input->args[i];
+
+		if(arg->kind == MACKE_FUZZER_ARG_VALUE)
+		{
+			/* Missing bytes stay 0 */
+			size_t copy = size < arg->size ? size : arg->size;
+			buffer->elementSize = arg->size;
+			buffer->numElements = 1;
+			buffer->minElements = 1;
+			buffer->bytes = calloc(arg->size + 1, 1);
+			if(!buffer->bytes)
+				abort();
+			memcpy(buffer->bytes, data, copy);
+			data += copy;
+			size -= copy;
+		}
+		else if(arg->kind == MACKE_FUZZER_ARG_ARRAY)
+		{
+			SplitBuffer(&data, &size, buffer, arg->size ? arg->size : 1);
+			if(arg->nested)
+				SplitNested(&data, &size, buffer, buffer->numElements, arg->nested, schema->maxDepth);
+		}
+	}
+}
+
+
+typedef struct
+{
+	uint8_t* data;
+	size_t size;
+	size_t alloc;
+	size_t used; /* Everything behind used decodes the same when it is missing */
+} JoinOutput;
+
+
+static void JoinByte(JoinOutput* out, uint8_t byte)
+{
+	out->data = Grow(out->data, out->size, &out->alloc, 1);
+	out->data[out->size++] = byte;
+}
+
+
+static void JoinBuffer(JoinOutput* out, const MackeFuzzerBuffer* buffer, int isValue)
+{
+	for(size_t i = 0; i < buffer->numElements; ++i)
+	{
+		if(i >= buffer->hiddenFirst && i < buffer->hiddenFirst + buffer->hiddenCount)
+			continue;
+
+		const uint8_t* element = buffer->bytes + i * buffer->elementSize;
+		for(size_t b = 0; b < buffer->elementSize; ++b)
+		{
+			/* Missing value bytes and a missing delimiter at the end of the input decode the same */
+			if(isValue)
+			{
+				JoinByte(out, element[b]);
+				if(element[b])
+					out->used = out->size;
+				continue;
+			}
+
+			if(element[b] == (uint8_t)ESCAPE_CHAR || element[b] == (uint8_t)DELIMITER_CHAR)
+				JoinByte(out, ESCAPE_CHAR);
+			JoinByte(out, element[b]);
+			out->used = out->size;
+		}
+	}
+
+	if(!isValue)
+		JoinByte(out, DELIMITER_CHAR);
+
+	size_t child = 0;
+	for(size_t i = 0; i < buffer->numChildren / (buffer->childrenPerElement ? buffer->childrenPerElement : 1); ++i)
+	{
+		int hidden = i >= buffer->hiddenFirst && i < buffer->hiddenFirst + buffer->hiddenCount;
+		for(size_t k = 0; k < buffer->childrenPerElement; ++k, ++child)
+			if(!hidden)
+				JoinBuffer(out, &buffer->children[child], 0);
+	}
+}
+
+
+uint8_t* macke_fuzzer_input_join(const MackeFuzzerSchema* schema, const MackeFuzzerSplitInput* input, size_t* size)
+{
+	JoinOutput out = { NULL, 0, 0, 0 };
+	for(size_t i = 0; i < schema->numArgs; ++i)
+	{
+		if(schema->args[i].kind == MACKE_FUZZER_ARG_VALUE || schema->args[i].kind == MACKE_FUZZER_ARG_ARRAY)
+			JoinBuffer(&out, &input->args[i], schema->args[i].kind == MACKE_FUZZER_ARG_VALUE);
+	}
+
+	*size = out.used;
+	return out.data ? out.data : calloc(1, 1);
+}
+
+
+static void FreeBuffer(MackeFuzzerBuffer* buffer)
+{
+	for(size_t i = 0; i < buffer->numChildren; ++i)
+		FreeBuffer(&buffer->children[i]);
+	free(buffer->children);
+	free(buffer->bytes);
+}
+
+
+int macke_fuzzer_buffer_remove(MackeFuzzerBuffer* buffer, size_t first, size_t count)
+{
+	if(first + count > buffer->numElements || buffer->numElements - count < buffer->minElements)
+		return -1;
+
+	size_t elementSize = buffer->elementSize;
+	memmove(buffer->bytes + first * elementSize, buffer->bytes + (first + count) * elementSize,
+			(buffer->numElements - first - count) * elementSize);
+	buffer->numElements -= count;
+
+	size_t perElement = buffer->childrenPerElement;
+	if(perElement && buffer->numChildren)
+	{
+		for(size_t i = first * perElement; i < (first + count) * perElement; ++i)
+			FreeBuffer(&buffer->children[i]);
+		memmove(buffer->children + first * perElement, buffer->children + (first + count) * perElement,
+				(buffer->numChildren - (first + count) * perElement) * sizeof(MackeFuzzerBuffer));
+		buffer->numChildren -= count * perElement;
+	}
+
+	buffer->hiddenFirst = 0;
+	buffer->hiddenCount = 0;
+	return 0;
+}
+
+
+void macke_fuzzer_input_free(MackeFuzzerSplitInput* input)
+{
+	for(size_t i = 0; i < input->numArgs; ++i)
+		FreeBuffer(&input->args[i]);
+	free(input->args);
+	input->numArgs = 0;
+	input->args = NULL;
+}
+
+
+static int WriteU32(FILE* file, uint32_t value)
+{
+	const uint8_t bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+	return fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes) ? 0 : -1;
+}
+
+
+static int WriteBytes(FILE* file, const void* data, size_t size)
+{
+	if(WriteU32(file, size) != 0)
+		return -1;
+	return fwrite(data, 1, size, file) == size ? 0 : -1;
+}
+
+
+int macke_fuzzer_objects_write_ktest(const MackeFuzzerObjects* objects, const char* path, size_t numArgs, char** args)
+{
+	FILE* file = fopen(path, "wb");
+	if(!file)
+		return -1;
+
+	int ret = fwrite("KTEST", 1, 5, file) == 5 ? 0 : -1;
+	ret |= WriteU32(file, 3); /* Version */
+
+	ret |= WriteU32(file, numArgs);
+	for(size_t i = 0; i < numArgs; ++i)
+		ret |= WriteBytes(file, args[i], strlen(args[i]));
+
+	/* No symbolic argv */
+	ret |= WriteU32(file, 0);
+	ret |= WriteU32(file, 0);
+
+	ret |= WriteU32(file, objects->count);
+	for(size_t i = 0; i < objects->count; ++i)
+	{
+		ret |= WriteBytes(file, objects->objects[i].name, strlen(objects->objects[i].name));
+		ret |= WriteBytes(file, objects->objects[i].bytes, objects->objects[i].numBytes);
+	}
+
+	if(fclose(file) != 0)
+		ret = -1;
+	return ret;
+}
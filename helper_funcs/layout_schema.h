@@ -0,0 +1,133 @@
+
+#ifndef __LAYOUT_SCHEMA_H
+#define __LAYOUT_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nested_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Text description of how a driver reads its input, written by InsertFuzzDriver next to the drivers
+ * and embedded into the module. It is enough to decode inputs without the module:
+ *
+ *   macke-layout 1
+ *   function <name>
+ *   max-depth <levels of nested pointers>
+ *   arg <name> value|array|length|sret|callback|pinned <size> [string] [pair <argno>] [nested <node>] [value <hex bytes>]
+ *   node <id> <element size>
+ *   field <node> <offset> data <pointee node>
+ *   field <node> <offset> function
+ */
+
+#define MACKE_FUZZER_SCHEMA_MAGIC "macke-layout"
+#define MACKE_FUZZER_SCHEMA_VERSION 1
+
+typedef enum
+{
+	MACKE_FUZZER_ARG_VALUE,
+	MACKE_FUZZER_ARG_ARRAY,
+	MACKE_FUZZER_ARG_LENGTH,
+	MACKE_FUZZER_ARG_SRET,
+	MACKE_FUZZER_ARG_CALLBACK,
+	MACKE_FUZZER_ARG_PINNED
+} MackeFuzzerArgKind;
+
+typedef struct
+{
+	MackeFuzzerArgKind kind;
+	char* name;
+	uint64_t size;      /* Size of a value, or of one array element */
+	int isString;
+	int hasPair;
+	unsigned pairedArg;
+	const MackeFuzzerLayout* nested; /* NULL if the elements contain no pointers */
+	uint8_t* pinnedBytes; /* size bytes the driver passes for a pinned argument, NULL if all zero */
+} MackeFuzzerSchemaArg;
+
+typedef struct
+{
+	char* function;
+	unsigned maxDepth;
+	size_t numArgs;
+	MackeFuzzerSchemaArg* args;
+	size_t numNodes;
+	MackeFuzzerLayout* nodes;
+	MackeFuzzerField* fields;
+} MackeFuzzerSchema;
+
+/* One decoded argument or nested buffer, named like the objects of a ktest file */
+typedef struct
+{
+	char* name;
+	uint8_t* bytes;
+	size_t numBytes;
+} MackeFuzzerObject;
+
+typedef struct
+{
+	size_t count;
+	MackeFuzzerObject* objects;
+} MackeFuzzerObjects;
+
+/* Returns 0 on success, prints the offending line otherwise */
+int macke_fuzzer_schema_parse(MackeFuzzerSchema* schema, const char* text);
+int macke_fuzzer_schema_load(MackeFuzzerSchema* schema, const char* path);
+void macke_fuzzer_schema_free(MackeFuzzerSchema* schema);
+
+/**
+ * Decode an input the way the driver does: one object per argument in order,
+ * followed by the nested buffers of each argument, named <arg>.<n>.
+ * The pointers the driver would store into the elements are 0 in the objects, the pointees are the nested buffers.
+ */
+void macke_fuzzer_schema_decode(const MackeFuzzerSchema* schema, const uint8_t* data, size_t size, MackeFuzzerObjects* objects);
+void macke_fuzzer_objects_free(MackeFuzzerObjects* objects);
+
+/**
+ * An input split into the buffers the driver reads, in the order it reads them.
+ * Arrays keep only their whole elements, the nested buffers of an array hang below it,
+ * childrenPerElement of them for every element. Joining writes the canonical encoding of the same input:
+ * only delimiter and escape bytes are escaped and everything the driver would not read is left out.
+ */
+typedef struct MackeFuzzerBuffer MackeFuzzerBuffer;
+
+struct MackeFuzzerBuffer
+{
+	uint8_t* bytes;
+	size_t numElements;
+	size_t elementSize;
+	size_t minElements;        /* Nested buffers are decoded with at least one element, whose nested buffers are read too */
+	size_t childrenPerElement;
+	size_t numChildren;
+	MackeFuzzerBuffer* children;
+	size_t hiddenFirst;        /* Elements left out by join, to try a removal without changing the split input */
+	size_t hiddenCount;
+};
+
+typedef struct
+{
+	size_t numArgs;
+	MackeFuzzerBuffer* args; /* One per schema argument, empty for arguments not read from the input */
+} MackeFuzzerSplitInput;
+
+void macke_fuzzer_input_split(const MackeFuzzerSchema* schema, const uint8_t* data, size_t size, MackeFuzzerSplitInput* input);
+
+/* Returns a malloc'ed buffer with the canonical encoding of the input */
+uint8_t* macke_fuzzer_input_join(const MackeFuzzerSchema* schema, const MackeFuzzerSplitInput* input, size_t* size);
+
+/* Remove count elements and their nested buffers, returns -1 if fewer than minElements would be left */
+int macke_fuzzer_buffer_remove(MackeFuzzerBuffer* buffer, size_t first, size_t count);
+void macke_fuzzer_input_free(MackeFuzzerSplitInput* input);
+
+/* Write the objects as version 3 ktest file klee can read, with args as the klee command line. Returns 0 on success */
+int macke_fuzzer_objects_write_ktest(const MackeFuzzerObjects* objects, const char* path, size_t numArgs, char** args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LAYOUT_SCHEMA_H
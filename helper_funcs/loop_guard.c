@@ -0,0 +1,81 @@
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Runtime side of the loop-guard pass.
+ * Guarded latches decrement the counter and call macke_fuzzer_loop_guard_exceeded once it reaches 0.
+ * Before the first reset the counter is 0, so code running outside of a driver is never stopped.
+ * The exec ends by jumping back to the exit guard of the driver, see exit_guard.c.
+ */
+
+#define MACKE_FUZZER_LOOP_BUDGET_ENV "MACKE_FUZZER_LOOP_BUDGET"
+
+/* Thread local, so threads can run drivers at the same time - see driver_api.h */
+__thread uint64_t macke_fuzzer_loop_counter __attribute__((tls_model("initial-exec")));
+
+/* Defined by the pass from -loop-guard-budget */
+extern const uint64_t macke_fuzzer_loop_guard_budget;
+
+static uint64_t loopBudget;
+
+/* Slow execs stopped in all threads */
+static uint64_t exceededCount;
+
+/* Set in the forked children of the reproduce build, which report slow execs by SIGXCPU */
+static int exceededSignal;
+
+/* exit_guard.c, returns only if no guarded driver of this thread is running */
+extern void macke_fuzzer_exec_stop(void);
+
+
+void macke_fuzzer_loop_guard_reset(void)
+{
+	if(!loopBudget)
+	{
+		loopBudget = macke_fuzzer_loop_guard_budget;
+
+		const char* env = getenv(MACKE_FUZZER_LOOP_BUDGET_ENV);
+		if(env && *env)
+			loopBudget = strtoull(env, NULL, 10);
+
+		/* 0 disables the guard, the counter can not reach 0 from UINT64_MAX in practice */
+		if(!loopBudget)
+			loopBudget = UINT64_MAX;
+	}
+	macke_fuzzer_loop_counter = loopBudget;
+}
+
+
+void macke_fuzzer_loop_guard_use_signal(void)
+{
+	exceededSignal = 1;
+}
+
+
+uint64_t macke_fuzzer_loop_guard_exceeded_count(void)
+{
+	return __atomic_load_n(&exceededCount, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Ends the exec, the driver returns 0.
+ * Raises SIGXCPU instead in the reproduce build, which reports it as slow instead of as crash or timeout,
+ * and for drivers built before they were guarded.
+ */
+void macke_fuzzer_loop_guard_exceeded(void)
+{
+	if(!exceededSignal)
+	{
+		__atomic_fetch_add(&exceededCount, 1, __ATOMIC_RELAXED);
+		macke_fuzzer_exec_stop();
+	}
+
+	fprintf(stderr, "==MACKE== loop budget of %llu back-edges exceeded\n", (unsigned long long)loopBudget);
+	signal(SIGXCPU, SIG_DFL);
+	raise(SIGXCPU);
+	abort();
+}
@@ -0,0 +1,90 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nested_decode.h"
+
+/* From buffer_extract.c */
+size_t macke_fuzzer_array_byte_size(const uint8_t* src, size_t max);
+const uint8_t* macke_fuzzer_array_extract(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen);
+
+
+static void TrackAlloc(MackeFuzzerAllocList* allocs, void* ptr, size_t size)
+{
+	if(allocs->count == allocs->alloc)
+	{
+		size_t newAlloc = allocs->alloc ? allocs->alloc * 2 : 16;
+		void** newPtrs = realloc(allocs->ptrs, newAlloc * sizeof(void*));
+		size_t* newSizes = realloc(allocs->sizes, newAlloc * sizeof(size_t));
+		if(!newPtrs || !newSizes)
+			abort();
+		allocs->ptrs = newPtrs;
+		allocs->sizes = newSizes;
+		allocs->alloc = newAlloc;
+	}
+	allocs->ptrs[allocs->count] = ptr;
+	allocs->sizes[allocs->count] = size;
+	++allocs->count;
+}
+
+
+static const uint8_t* DecodeNested(const uint8_t* src, size_t* remaining, uint8_t* dst, size_t count,
+		const MackeFuzzerLayout* layout, size_t depth, MackeFuzzerAllocList* allocs)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		uint8_t* element = dst + i * layout->elementSize;
+
+		for(uint64_t f = 0; f < layout->numFields; ++f)
+		{
+			const MackeFuzzerField* field = &layout->fields[f];
+			void* value = NULL;
+
+			if(field->kind == MACKE_FUZZER_FIELD_FUNCTION)
+				value = field->stub;
+			else if(depth > 0)
+			{
+				size_t elementSize = field->pointee->elementSize;
+				size_t elements = macke_fuzzer_array_byte_size(src, *remaining) / elementSize;
+				size_t bytes = elements * elementSize;
+
+				/**
+				 * Empty sub-buffers still get one zeroed element and every buffer a trailing 0,
+				 * so embedded strings are terminated and no access to the first element is out of bounds
+				 */
+				size_t allocSize = (elements ? bytes : elementSize) + 1;
+				value = calloc(1, allocSize);
+				if(!value)
+					abort();
+				TrackAlloc(allocs, value, allocSize);
+
+				const uint8_t* next = macke_fuzzer_array_extract(src, *remaining, value, bytes);
+				*remaining -= next - src;
+				src = next;
+
+				if(field->pointee->numFields)
+					src = DecodeNested(src, remaining, value, elements ? elements : 1, field->pointee, depth - 1, allocs);
+			}
+
+			memcpy(element + field->offset, &value, sizeof(value));
+		}
+	}
+	return src;
+}
+
+
+const uint8_t* macke_fuzzer_decode_nested(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t count,
+		const MackeFuzzerLayout* layout, size_t depth, MackeFuzzerAllocList* allocs)
+{
+	return DecodeNested(src, &srcLen, dst, count, layout, depth, allocs);
+}
+
+
+void macke_fuzzer_free_allocs(MackeFuzzerAllocList* allocs)
+{
+	for(size_t i = 0; i < allocs->count; ++i)
+		free(allocs->ptrs[i]);
+	free(allocs->ptrs);
+	free(allocs->sizes);
+	memset(allocs, 0, sizeof(*allocs));
+}
@@ -0,0 +1,62 @@
+
+#ifndef __NESTED_DECODE_H
+#define __NESTED_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decoding of pointers embedded in decoded arrays, like pointer fields of structs or the elements of char**.
+ * InsertFuzzDriver emits a constant layout per argument type, describing where the pointers are.
+ * Every embedded data pointer gets its own delimited sub-buffer from the input, in depth-first order,
+ * function pointers get a stub callback.
+ */
+
+#define MACKE_FUZZER_FIELD_DATA     0
+#define MACKE_FUZZER_FIELD_FUNCTION 1
+
+typedef struct MackeFuzzerLayout MackeFuzzerLayout;
+
+typedef struct
+{
+	uint64_t offset;                  /* Offset of the pointer inside one element */
+	uint64_t kind;
+	const MackeFuzzerLayout* pointee; /* Data pointers: layout of the pointed to elements */
+	void* stub;                       /* Function pointers: callback stored into the field */
+} MackeFuzzerField;
+
+struct MackeFuzzerLayout
+{
+	uint64_t elementSize;
+	uint64_t numFields;
+	const MackeFuzzerField* fields;
+};
+
+/* Buffers allocated while decoding, freed after the target returned */
+typedef struct
+{
+	void** ptrs;
+	size_t* sizes;
+	size_t count;
+	size_t alloc;
+} MackeFuzzerAllocList;
+
+/**
+ * Fill the pointers of count elements at dst, reading their sub-buffers from src.
+ * Beyond depth levels of nesting, pointers are set to NULL.
+ * Returns the new src position, like macke_fuzzer_array_extract.
+ */
+const uint8_t* macke_fuzzer_decode_nested(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t count,
+		const MackeFuzzerLayout* layout, size_t depth, MackeFuzzerAllocList* allocs);
+
+void macke_fuzzer_free_allocs(MackeFuzzerAllocList* allocs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NESTED_DECODE_H
@@ -0,0 +1,305 @@
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Fast models for external functions, the stub-externals pass redirects calls to these.
+ * Files are kept in memory: reads are served from a copy made on the first open,
+ * writes go into memory streams that replace the in-memory content on fclose.
+ * The returned streams are real FILE*, so every other stdio function works on them.
+ * Every exec starts from the files on disk: the drivers call macke_fuzzer_stub_models_reset, which drops what
+ * the last exec wrote or removed and closes the streams it left open. Like the exec, the state is thread local.
+ * The reset only knows the streams that are still open if every fclose goes through the model, the pass models
+ * fclose whenever it models fopen.
+ */
+
+#define EXEC_STATE __thread __attribute__((tls_model("initial-exec")))
+
+typedef struct MemFile
+{
+	char* path;
+	char* data;
+	size_t size;
+	int removed; /* Hides the file on disk */
+	int changed; /* Written or removed, not only read from disk */
+	struct MemFile* next;
+} MemFile;
+
+/* Open streams, write streams replace the content of their file on fclose */
+typedef struct MemStream
+{
+	FILE* stream;
+	char* path; /* NULL for read streams */
+	char* data;
+	size_t size;
+	struct MemStream* next;
+} MemStream;
+
+static EXEC_STATE MemFile* memFiles = NULL;
+static EXEC_STATE MemStream* memStreams = NULL;
+
+
+static MemFile* FindFile(const char* path)
+{
+	for(MemFile* file = memFiles; file; file = file->next)
+		if(strcmp(file->path, path) == 0)
+			return file;
+	return NULL;
+}
+
+
+static MemFile* AddFile(const char* path)
+{
+	MemFile* file = calloc(1, sizeof(MemFile));
+	if(!file)
+		abort();
+	file->path = strdup(path);
+	file->next = memFiles;
+	memFiles = file;
+	return file;
+}
+
+
+/* Returns the in-memory file, reading it from disk the first time */
+static MemFile* LoadFile(const char* path)
+{
+	MemFile* file = FindFile(path);
+	if(file)
+		return file->removed ? NULL : file;
+
+	FILE* disk = fopen(path, "rb");
+	if(!disk)
+		return NULL;
+
+	char* data = NULL;
+	size_t size = 0, alloc = 0;
+	for(;;)
+	{
+		if(size == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 4096;
+			data = realloc(data, alloc);
+			if(!data)
+				abort();
+		}
+		size_t got = fread(data + size, 1, alloc - size, disk);
+		if(got == 0)
+			break;
+		size += got;
+	}
+	fclose(disk);
+
+	file = AddFile(path);
+	file->data = data;
+	file->size = size;
+	return file;
+}
+
+
+static void StoreFile(const char* path, const char* data, size_t size)
+{
+	MemFile* file = FindFile(path);
+	if(!file)
+		file = AddFile(path);
+
+	free(file->data);
+	file->data = malloc(size ? size : 1);
+	if(!file->data)
+		abort();
+	memcpy(file->data, data, size);
+	file->size = size;
+	file->removed = 0;
+	file->changed = 1;
+}
+
+
+static void AddStream(MemStream* ms)
+{
+	ms->next = memStreams;
+	memStreams = ms;
+}
+
+
+static FILE* OpenRead(const char* path, const char* mode)
+{
+	MemFile* file = LoadFile(path);
+	if(!file)
+	{
+		errno = ENOENT;
+		return NULL;
+	}
+
+	/* The stream works on a copy, so "r+" can not change the stored content */
+	char* copy = malloc(file->size + 1);
+	if(!copy)
+		abort();
+	memcpy(copy, file->data, file->size);
+
+	MemStream* ms = calloc(1, sizeof(MemStream));
+	if(!ms)
+		abort();
+	/* Older glibc rejects empty buffers, /dev/null reads as empty too. Tracked like the others, the reset closes it */
+	ms->stream = file->size ? fmemopen(copy, file->size, mode) : fopen("/dev/null", mode);
+	if(!ms->stream)
+	{
+		free(copy);
+		free(ms);
+		return NULL;
+	}
+	ms->data = copy;
+	ms->size = file->size;
+	AddStream(ms);
+	return ms->stream;
+}
+
+
+static FILE* OpenWrite(const char* path, const char* mode)
+{
+	MemStream* ms = calloc(1, sizeof(MemStream));
+	if(!ms)
+		abort();
+
+	ms->stream = open_memstream(&ms->data, &ms->size);
+	if(!ms->stream)
+	{
+		free(ms);
+		return NULL;
+	}
+	ms->path = strdup(path);
+
+	/* Appending starts with the current content */
+	MemFile* file = mode[0] == 'a' ? LoadFile(path) : NULL;
+	if(file)
+		fwrite(file->data, 1, file->size, ms->stream);
+
+	AddStream(ms);
+	return ms->stream;
+}
+
+
+/* Copies read from disk are kept, they are the same for every exec */
+void macke_fuzzer_stub_models_reset(void)
+{
+	while(memStreams)
+	{
+		MemStream* ms = memStreams;
+		memStreams = ms->next;
+		fclose(ms->stream);
+		free(ms->data);
+		free(ms->path);
+		free(ms);
+	}
+
+	MemFile** prev = &memFiles;
+	while(*prev)
+	{
+		MemFile* file = *prev;
+		if(!file->changed)
+		{
+			prev = &file->next;
+			continue;
+		}
+		*prev = file->next;
+		free(file->path);
+		free(file->data);
+		free(file);
+	}
+}
+
+
+FILE* macke_fuzzer_model_fopen(const char* path, const char* mode)
+{
+	if(!path || !mode)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	if(mode[0] == 'r')
+		return OpenRead(path, mode);
+	return OpenWrite(path, mode);
+}
+
+
+FILE* macke_fuzzer_model_fopen64(const char* path, const char* mode)
+{
+	return macke_fuzzer_model_fopen(path, mode);
+}
+
+
+int macke_fuzzer_model_fclose(FILE* stream)
+{
+	MemStream** prev = &memStreams;
+	for(MemStream* ms = memStreams; ms; prev = &ms->next, ms = ms->next)
+	{
+		if(ms->stream != stream)
+			continue;
+
+		/* The memory stream updates data and size on close */
+		int ret = fclose(stream);
+		if(ms->path)
+			StoreFile(ms->path, ms->data, ms->size);
+
+		*prev = ms->next;
+		free(ms->data);
+		free(ms->path);
+		free(ms);
+		return ret;
+	}
+	return fclose(stream);
+}
+
+
+int macke_fuzzer_model_remove(const char* path)
+{
+	MemFile* file = FindFile(path);
+	if(!file || file->removed)
+	{
+		if(file || access(path, F_OK) != 0)
+		{
+			errno = ENOENT;
+			return -1;
+		}
+		file = AddFile(path);
+	}
+
+	free(file->data);
+	file->data = NULL;
+	file->size = 0;
+	file->removed = 1;
+	file->changed = 1;
+	return 0;
+}
+
+
+int macke_fuzzer_model_unlink(const char* path)
+{
+	return macke_fuzzer_model_remove(path);
+}
+
+
+/* Sleeping returns at once, as if the time passed */
+unsigned int macke_fuzzer_model_sleep(unsigned int seconds)
+{
+	(void)seconds;
+	return 0;
+}
+
+
+int macke_fuzzer_model_usleep(useconds_t usec)
+{
+	(void)usec;
+	return 0;
+}
+
+
+int macke_fuzzer_model_nanosleep(const struct timespec* req, struct timespec* rem)
+{
+	(void)req;
+	if(rem)
+		memset(rem, 0, sizeof(*rem));
+	return 0;
+}
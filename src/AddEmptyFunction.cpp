@@ -5,6 +5,10 @@
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "Diagnostics.h"
+#include "FunctionStubs.h"
+#include "Passes.h"
+
 /* Module to add empty body to otherwise undefined (external) function
  * Needed to add usage() function to libcoreutils testing */
 
@@ -20,15 +24,27 @@ struct AddEmptyFunction : public llvm::ModulePass
 	static char ID;
 
 	AddEmptyFunction() : llvm::ModulePass(ID) { };
-	bool runOnModule(llvm::Module& M) override;
+	bool runOnModule(llvm::Module& M) override { return RunAddEmptyFunction(M); }
 };
 
 
-bool AddEmptyFunction::runOnModule(llvm::Module& M)
+char AddEmptyFunction::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<AddEmptyFunction> X(
+	"add-empty-function", "Transform an external function to one with no implementation (returns null)",
+	false, /* Does modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
+
+
+bool RunAddEmptyFunction(llvm::Module& M)
 {
 	if(FunctionName.empty())
 	{
-		llvm::errs() << "Error: -function-name argument missing\n";
+		Diagnostics() << "Error: -function-name argument missing\n";
 		return false;
 	}
 
@@ -36,37 +52,16 @@ bool AddEmptyFunction::runOnModule(llvm::Module& M)
 
 	if(!f)
 	{
-		llvm::errs() << "Error: " << FunctionName << " is not included in the modules symbol table.\n";
+		Diagnostics() << "Error: " << FunctionName << " is not included in the modules symbol table.\n";
 		return false;
 	}
 
 	if(!f->empty())
 	{
-		llvm::errs() << "Error: " << FunctionName << " already has a body.\n";
+		Diagnostics() << "Error: " << FunctionName << " already has a body.\n";
 		return false;
 	}
 
-	llvm::Type* retType = f->getReturnType();
-	llvm::BasicBlock* retBlock = llvm::BasicBlock::Create(M.getContext(), "return", f);
-	llvm::IRBuilder<> builder(retBlock);
-
-	/* Add return */
-	if(retType->isVoidTy())
-		builder.CreateRetVoid();
-	else
-		builder.CreateRet(llvm::Constant::getNullValue(retType));
-
+	AddNullBody(f);
 	return true;
 }
-
-
-char AddEmptyFunction::ID = 0; /* Value is ignored */
-
-/* Register the new pass */
-static llvm::RegisterPass<AddEmptyFunction> X(
-	"add-empty-function", "Transform an external function to one with no implementation (returns null)",
-	false, /* Does modify CFG */
-	false  /* Is not only analysis */
-	);
-
-} /* Namespace */
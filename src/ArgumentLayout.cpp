@@ -0,0 +1,478 @@
+
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "ArgumentLayout.h"
+#include "Compat.h"
+#include "Diagnostics.h"
+#include "TypeHelper.h"
+
+
+static llvm::cl::opt<bool> PairLengths(
+	"fuzz-pair-lengths",
+	llvm::cl::desc("Derive an integer argument following a pointer from the decoded array size, if the function uses it as bound of the array. "
+	               "Changes the input format of the drivers, existing corpora no longer decode the same"),
+	llvm::cl::init(false));
+
+static llvm::cl::opt<bool> TerminateStrings(
+	"fuzz-terminate-strings",
+	llvm::cl::desc("NUL terminate char arrays the function uses as C strings"),
+	llvm::cl::init(true));
+
+static llvm::cl::opt<std::string> LengthHints(
+	"fuzz-length-hints",
+	llvm::cl::desc("File with '<function> <pointer argno> <length argno>' lines naming additional pointer/length pairs"));
+
+static llvm::cl::list<std::string> PinnedArgs(
+	"pin-arg",
+	llvm::cl::desc("<function>:<argno>=<value> passes the constant instead of decoding the argument from the input, "
+	               "and calls a copy of the function specialized to it. Integers, floats and null pointers can be pinned"));
+
+static llvm::cl::opt<unsigned> MaxDepth(
+	"fuzz-max-depth",
+	llvm::cl::desc("Levels of pointers inside of pointed to elements that are decoded from the input, deeper pointers are NULL"),
+	llvm::cl::init(2));
+
+
+unsigned GetMaxNestingDepth()
+{
+	return MaxDepth;
+}
+
+
+typedef std::map<std::string, std::vector<std::pair<unsigned, unsigned>>> LengthHintMap;
+
+static LengthHintMap LoadLengthHints()
+{
+	LengthHintMap hints;
+	if(LengthHints.empty())
+		return hints;
+
+	std::ifstream hintFile(LengthHints);
+	if(!hintFile)
+	{
+		Diagnostics() << "Warning: length hint file '" << LengthHints << "' can not be read.\n";
+		return hints;
+	}
+
+	std::string line;
+	while(std::getline(hintFile, line))
+	{
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream lineStream(line);
+		std::string function;
+		unsigned pointerArg, lengthArg;
+		if(!(lineStream >> function >> pointerArg >> lengthArg))
+		{
+			Diagnostics() << "Warning: ignoring malformed length hint '" << line << "'.\n";
+			continue;
+		}
+		hints[function].push_back(std::make_pair(pointerArg, lengthArg));
+	}
+	return hints;
+}
+
+
+/* Parse the hint file once, the static initialization is thread safe for the parallel prep tool */
+static const LengthHintMap& GetLengthHints()
+{
+	static const LengthHintMap hints = LoadLengthHints();
+	return hints;
+}
+
+
+typedef std::map<std::string, std::vector<std::pair<unsigned, std::string>>> PinnedArgMap;
+
+static PinnedArgMap LoadPinnedArgs()
+{
+	PinnedArgMap pins;
+	for(const std::string& pin : PinnedArgs)
+	{
+		/* The function name goes up to the last colon before the value */
+		size_t equals = pin.find('=');
+		size_t colon = equals == std::string::npos ? std::string::npos : pin.rfind(':', equals);
+		unsigned argNo;
+		if(colon == std::string::npos || colon == 0 || equals + 1 == pin.size()
+				|| llvm::StringRef(pin).slice(colon + 1, equals).getAsInteger(10, argNo))
+		{
+			Diagnostics() << "Warning: ignoring malformed -pin-arg '" << pin << "'.\n";
+			continue;
+		}
+		pins[pin.substr(0, colon)].push_back(std::make_pair(argNo, pin.substr(equals + 1)));
+	}
+	return pins;
+}
+
+
+static const PinnedArgMap& GetPinnedArgs()
+{
+	static const PinnedArgMap pins = LoadPinnedArgs();
+	return pins;
+}
+
+
+/* Returns the constant of the given type value stands for, or nullptr if it does not fit */
+static llvm::Constant* ParsePinnedValue(llvm::Type* type, llvm::StringRef value)
+{
+	if(type->isIntegerTy() && type->getIntegerBitWidth() <= 64)
+	{
+		unsigned width = type->getIntegerBitWidth();
+		uint64_t unsignedValue;
+		int64_t signedValue;
+		if(!value.getAsInteger(0, unsignedValue) && llvm::isUIntN(width, unsignedValue))
+			return llvm::ConstantInt::get(type, unsignedValue);
+		if(!value.getAsInteger(0, signedValue) && llvm::isIntN(width, signedValue))
+			return llvm::ConstantInt::get(type, signedValue, true);
+		return nullptr;
+	}
+
+	if(type->isFloatingPointTy())
+	{
+		double floatValue;
+		if(value.getAsDouble(floatValue))
+			return nullptr;
+		return llvm::ConstantFP::get(type, floatValue);
+	}
+
+	if(type->isPointerTy() && (value == "0" || value == "null" || value == "NULL"))
+		return llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(type));
+
+	return nullptr;
+}
+
+
+/* Collect the values an argument flows into unchanged - through casts and, in unoptimized code, its stack slot */
+static void CollectAliases(const llvm::Value* value, llvm::SmallPtrSetImpl<const llvm::Value*>& aliases, bool followGEPs)
+{
+	if(!aliases.insert(value).second)
+		return;
+
+	for(const llvm::User* user : value->users())
+	{
+		if(llvm::isa<llvm::CastInst>(user) || (followGEPs && llvm::isa<llvm::GetElementPtrInst>(user)))
+			CollectAliases(user, aliases, followGEPs);
+		else if(auto* store = llvm::dyn_cast<llvm::StoreInst>(user))
+		{
+			auto* slot = llvm::dyn_cast<llvm::AllocaInst>(store->getPointerOperand());
+			if(!slot || store->getValueOperand() != value)
+				continue;
+			for(const llvm::User* slotUser : slot->users())
+				if(llvm::isa<llvm::LoadInst>(slotUser))
+					CollectAliases(slotUser, aliases, followGEPs);
+		}
+	}
+}
+
+
+/**
+ * The variable an index is computed from: casts and constant offsets are stripped,
+ * loads from a stack slot, as in unoptimized code, stand for the slot.
+ * i, (long)i and i + 1 all lead to the same loop counter.
+ */
+static const llvm::Value* GetIndexRoot(const llvm::Value* value)
+{
+	while(true)
+	{
+		if(auto* cast = llvm::dyn_cast<llvm::CastInst>(value))
+			value = cast->getOperand(0);
+		else if(auto* binOp = llvm::dyn_cast<llvm::BinaryOperator>(value))
+		{
+			if((binOp->getOpcode() != llvm::Instruction::Add && binOp->getOpcode() != llvm::Instruction::Sub)
+					|| !llvm::isa<llvm::Constant>(binOp->getOperand(1)))
+				return value;
+			value = binOp->getOperand(0);
+		}
+		else if(auto* load = llvm::dyn_cast<llvm::LoadInst>(value))
+		{
+			if(!llvm::isa<llvm::AllocaInst>(load->getPointerOperand()))
+				return value;
+			return load->getPointerOperand();
+		}
+		else
+			return value;
+	}
+}
+
+
+/* Returns whether length bounds the accesses to pointer inside the function */
+static bool IsUsedAsBound(const llvm::Argument* length, const llvm::Argument* pointer)
+{
+	llvm::SmallPtrSet<const llvm::Value*, 16> lengthAliases;
+	llvm::SmallPtrSet<const llvm::Value*, 16> pointerAliases;
+	CollectAliases(length, lengthAliases, false);
+	CollectAliases(pointer, pointerAliases, true);
+
+	/* Variables the buffer is indexed with */
+	llvm::SmallPtrSet<const llvm::Value*, 16> indexRoots;
+	for(const llvm::Value* alias : pointerAliases)
+		if(auto* gep = llvm::dyn_cast<llvm::GetElementPtrInst>(alias))
+			if(pointerAliases.count(gep->getPointerOperand()))
+				for(auto index = gep->idx_begin(); index != gep->idx_end(); ++index)
+					if(!llvm::isa<llvm::Constant>(index->get()))
+						indexRoots.insert(GetIndexRoot(index->get()));
+
+	for(const llvm::Value* alias : lengthAliases)
+	{
+		for(const llvm::User* user : alias->users())
+		{
+			/* Compared against a variable the buffer is indexed with, like the loop counter of for(i = 0; i < len; ++i) buf[i] */
+			if(auto* cmp = llvm::dyn_cast<llvm::ICmpInst>(user))
+			{
+				const llvm::Value* other = cmp->getOperand(cmp->getOperand(0) == alias ? 1 : 0);
+				if(indexRoots.count(GetIndexRoot(other)))
+					return true;
+			}
+			/* Indexes into the buffer */
+			else if(auto* gep = llvm::dyn_cast<llvm::GetElementPtrInst>(user))
+			{
+				if(pointerAliases.count(gep->getPointerOperand()))
+					return true;
+			}
+			/* Passed on together with the buffer, like memcpy(dst, buf, len) */
+			else if(auto* call = llvm::dyn_cast<llvm::CallInst>(user))
+			{
+				for(const llvm::Value* op : call->arg_operands())
+					if(pointerAliases.count(op))
+						return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Returns whether the library function reads argument argNo up to the terminating NUL.
+ * Only the fixed parameters count, a pointer passed among the varargs of printf may be printed with %p or %.*s.
+ */
+static bool IsStringParameter(llvm::StringRef name, unsigned argNo)
+{
+	static const std::map<std::string, std::vector<unsigned>> stringParameters = {
+		{"strlen", {0}}, {"strcmp", {0, 1}}, {"strcoll", {0, 1}}, {"strcpy", {1}}, {"strcat", {0, 1}},
+		{"strchr", {0}}, {"strrchr", {0}}, {"strstr", {0, 1}}, {"strdup", {0}}, {"strspn", {0, 1}},
+		{"strcspn", {0, 1}}, {"strpbrk", {0, 1}}, {"strtok", {0, 1}}, {"strcasecmp", {0, 1}},
+		{"strtol", {0}}, {"strtoul", {0}}, {"strtoll", {0}}, {"strtoull", {0}}, {"strtod", {0}}, {"strtof", {0}},
+		{"atoi", {0}}, {"atol", {0}}, {"atoll", {0}}, {"atof", {0}}, {"puts", {0}}, {"fputs", {0}},
+		{"printf", {0}}, {"sprintf", {1}}, {"snprintf", {2}}, {"fprintf", {1}}, {"sscanf", {0, 1}},
+		{"fopen", {0, 1}}, {"open", {0}}, {"getenv", {0}}
+	};
+	auto parameters = stringParameters.find(name.str());
+	return parameters != stringParameters.end()
+		&& std::find(parameters->second.begin(), parameters->second.end(), argNo) != parameters->second.end();
+}
+
+
+/* Returns whether the loaded char is compared against the terminating NUL */
+static bool IsComparedAgainstZero(const llvm::Value* loaded)
+{
+	for(const llvm::User* user : loaded->users())
+	{
+		if(llvm::isa<llvm::CastInst>(user) && IsComparedAgainstZero(user))
+			return true;
+
+		if(auto* cmp = llvm::dyn_cast<llvm::ICmpInst>(user))
+		{
+			for(const llvm::Value* op : cmp->operands())
+				if(auto* constant = llvm::dyn_cast<llvm::ConstantInt>(op))
+					if(constant->isZero())
+						return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Returns whether the function treats the pointer argument as C string:
+ * It is passed to a string function, or a char read from it is compared against 0.
+ * Calls to functions in the module are followed.
+ */
+static bool IsUsedAsString(const llvm::Argument* pointer, std::set<const llvm::Argument*>& visited)
+{
+	if(!visited.insert(pointer).second)
+		return false;
+
+	llvm::SmallPtrSet<const llvm::Value*, 16> pointerAliases;
+	CollectAliases(pointer, pointerAliases, true);
+
+	for(const llvm::Value* alias : pointerAliases)
+	{
+		for(const llvm::User* user : alias->users())
+		{
+			if(auto* load = llvm::dyn_cast<llvm::LoadInst>(user))
+			{
+				if(load->getType()->isIntegerTy(8) && IsComparedAgainstZero(load))
+					return true;
+			}
+			else if(auto* call = llvm::dyn_cast<llvm::CallInst>(user))
+			{
+				const llvm::Function* callee = call->getCalledFunction();
+				if(!callee)
+					continue;
+
+				for(unsigned argNo = 0; argNo < call->getNumArgOperands(); ++argNo)
+					if(pointerAliases.count(call->getArgOperand(argNo)) && IsStringParameter(callee->getName(), argNo))
+						return true;
+
+				if(callee->empty() || callee->isVarArg())
+					continue;
+
+				/* Follow into the parameters the pointer is passed as */
+				unsigned argNo = 0;
+				for(auto& param : GetFunctionArgumentList(callee))
+				{
+					if(argNo < call->getNumArgOperands() && pointerAliases.count(call->getArgOperand(argNo))
+							&& IsUsedAsString(&param, visited))
+						return true;
+					++argNo;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+
+static void PairArguments(std::vector<ArgumentLayout>& layout, unsigned pointerArg, unsigned lengthArg)
+{
+	layout[pointerArg].hasPair = true;
+	layout[pointerArg].pairedArg = lengthArg;
+	layout[lengthArg].kind = ArgumentKind::Length;
+	layout[lengthArg].hasPair = true;
+	layout[lengthArg].pairedArg = pointerArg;
+}
+
+
+static bool CanBeLength(const ArgumentLayout& arg)
+{
+	return arg.kind == ArgumentKind::Value && !arg.hasPair && arg.type->isIntegerTy() && arg.type->getIntegerBitWidth() >= 16;
+}
+
+
+std::vector<ArgumentLayout> GetArgumentLayout(const llvm::Function* function, const llvm::DataLayout* dataLayout)
+{
+	std::vector<ArgumentLayout> layout;
+	std::vector<const llvm::Argument*> args;
+
+	for(auto& arg : GetFunctionArgumentList(function))
+	{
+		ArgumentLayout argLayout;
+		argLayout.type = arg.getType();
+		argLayout.pairedArg = 0;
+		argLayout.hasPair = false;
+		argLayout.isString = false;
+		argLayout.pinned = nullptr;
+
+		if(arg.hasStructRetAttr())
+		{
+			argLayout.kind = ArgumentKind::Sret;
+			argLayout.size = 0;
+		}
+		else if(arg.getType()->isPointerTy() && arg.getType()->getPointerElementType()->isFunctionTy())
+		{
+			argLayout.kind = ArgumentKind::Callback;
+			argLayout.size = 0;
+		}
+		else if(arg.getType()->isPointerTy())
+		{
+			argLayout.kind = ArgumentKind::Array;
+			argLayout.size = GetTypeSize(dataLayout, arg.getType()->getPointerElementType());
+			if(MaxDepth > 0)
+				argLayout.nested = GetNestedLayout(dataLayout, arg.getType()->getPointerElementType());
+
+			std::set<const llvm::Argument*> visited;
+			argLayout.isString = TerminateStrings && !function->empty()
+					&& arg.getType()->getPointerElementType()->isIntegerTy(8)
+					&& IsUsedAsString(&arg, visited);
+		}
+		else
+		{
+			argLayout.kind = ArgumentKind::Value;
+			argLayout.size = GetTypeSize(dataLayout, arg.getType());
+		}
+
+		layout.push_back(argLayout);
+		args.push_back(&arg);
+	}
+
+	/* Arguments fixed by the user, they take part in no pair */
+	const PinnedArgMap& pins = GetPinnedArgs();
+	auto pin = pins.find(function->getName().str());
+	if(pin != pins.end())
+	{
+		for(auto& pinnedArg : pin->second)
+		{
+			llvm::Constant* constant = nullptr;
+			if(pinnedArg.first < layout.size() && layout[pinnedArg.first].kind != ArgumentKind::Sret)
+				constant = ParsePinnedValue(layout[pinnedArg.first].type, pinnedArg.second);
+			if(!constant)
+			{
+				Diagnostics() << "Warning: -pin-arg " << pinnedArg.first << "=" << pinnedArg.second
+				             << " does not match the arguments of " << function->getName() << ".\n";
+				continue;
+			}
+
+			ArgumentLayout& argLayout = layout[pinnedArg.first];
+			argLayout.kind = ArgumentKind::Pinned;
+			argLayout.size = GetTypeSize(dataLayout, argLayout.type);
+			argLayout.isString = false;
+			argLayout.nested.reset();
+			argLayout.pinned = constant;
+		}
+	}
+
+	/* Pairs named by the user */
+	const LengthHintMap& hints = GetLengthHints();
+	auto hint = hints.find(function->getName().str());
+	if(hint != hints.end())
+	{
+		for(auto& pair : hint->second)
+		{
+			if(pair.first >= layout.size() || pair.second >= layout.size()
+					|| layout[pair.first].kind != ArgumentKind::Array || layout[pair.first].hasPair
+					|| !CanBeLength(layout[pair.second]))
+			{
+				Diagnostics() << "Warning: length hint " << pair.first << " " << pair.second
+				             << " does not match the arguments of " << function->getName() << ".\n";
+				continue;
+			}
+			PairArguments(layout, pair.first, pair.second);
+		}
+	}
+
+	/* An integer right after a pointer, that bounds the accesses to it */
+	if(PairLengths && !function->empty())
+	{
+		for(unsigned i = 0; i + 1 < layout.size(); ++i)
+		{
+			if(layout[i].kind != ArgumentKind::Array || layout[i].hasPair || !CanBeLength(layout[i + 1]))
+				continue;
+			if(IsUsedAsBound(args[i + 1], args[i]))
+				PairArguments(layout, i, i + 1);
+		}
+	}
+
+	return layout;
+}
+
+
+bool HasPinnedArguments(const std::vector<ArgumentLayout>& layout)
+{
+	for(const ArgumentLayout& arg : layout)
+		if(arg.kind == ArgumentKind::Pinned)
+			return true;
+	return false;
+}
@@ -0,0 +1,50 @@
+
+#ifndef __ARGUMENT_LAYOUT_H
+#define __ARGUMENT_LAYOUT_H
+
+#include <llvm/IR/Constant.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+
+#include <memory>
+#include <vector>
+
+#include "NestedLayout.h"
+
+/**
+ * Describes how the arguments of a fuzzed function are read from the fuzzer input.
+ * The driver, the input generator and the ktest generation all use this, so they always agree on the format.
+ */
+
+enum class ArgumentKind
+{
+	Value,    /* Fixed size value copied from the input */
+	Array,    /* Delimited array the pointer argument points to */
+	Length,   /* Element count of another array argument, not part of the input */
+	Sret,     /* Storage for a returned struct, not part of the input */
+	Callback, /* Function pointer, replaced by a stub, not part of the input */
+	Pinned    /* Fixed to a constant with -pin-arg, not part of the input */
+};
+
+struct ArgumentLayout
+{
+	ArgumentKind kind;
+	llvm::Type* type;
+	size_t size;        /* Size of a value, or of one array element */
+	unsigned pairedArg; /* Array: index of its length argument, Length: index of its array argument */
+	bool hasPair;
+	bool isString;      /* Array of chars the function expects to be NUL terminated */
+	std::shared_ptr<NestedLayout> nested; /* Array: pointers inside the elements, decoded from the following input */
+	llvm::Constant* pinned; /* Pinned: the value passed instead */
+};
+
+std::vector<ArgumentLayout> GetArgumentLayout(const llvm::Function* function, const llvm::DataLayout* dataLayout);
+
+/* Returns whether any argument of the function is pinned */
+bool HasPinnedArguments(const std::vector<ArgumentLayout>& layout);
+
+/* How many levels of pointers inside of arrays are decoded, deeper ones are NULL */
+unsigned GetMaxNestingDepth();
+
+
+#endif // __ARGUMENT_LAYOUT_H
@@ -4,6 +4,7 @@
 #include "Compat.h"
 
 #if LLVM_VERSION_MAJOR != 3
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/DebugInfoMetadata.h>
@@ -14,3 +15,38 @@ std::string GetArgumentName(const llvm::Module* M, const llvm::Argument* argumen
 	std::string ret = "argno" + std::to_string(argument->getArgNo());
 	return ret;
 }
+
+
+#if LLVM_VERSION_MAJOR == 3
+llvm::DILocation* CreateGeneratedSubprogram(llvm::Function* function, const llvm::Function* like)
+{
+	return nullptr;
+}
+#else
+llvm::DILocation* CreateGeneratedSubprogram(llvm::Function* function, const llvm::Function* like)
+{
+	llvm::DISubprogram* likeProgram = like->getSubprogram();
+	if(!likeProgram || !likeProgram->getUnit())
+		return nullptr;
+
+	llvm::DIBuilder builder(*function->getParent(), true, likeProgram->getUnit());
+	llvm::DISubroutineType* type = builder.createSubroutineType(builder.getOrCreateTypeArray({}));
+	unsigned line = likeProgram->getLine();
+#if LLVM_VERSION_MAJOR >= 8
+	llvm::DISubprogram* program = builder.createFunction(likeProgram->getFile(), function->getName(), function->getName(),
+			likeProgram->getFile(), line, type, line, llvm::DINode::FlagArtificial,
+			llvm::DISubprogram::SPFlagDefinition);
+#else
+	llvm::DISubprogram* program = builder.createFunction(likeProgram->getFile(), function->getName(), function->getName(),
+			likeProgram->getFile(), line, type, false, true, line, llvm::DINode::FlagArtificial);
+#endif
+	function->setSubprogram(program);
+#if LLVM_VERSION_MAJOR >= 5
+	builder.finalizeSubprogram(program);
+#else
+	builder.finalize();
+#endif
+
+	return llvm::DILocation::get(function->getContext(), line, 0, program);
+}
+#endif
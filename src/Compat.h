@@ -8,6 +8,18 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#if LLVM_VERSION_MAJOR == 3
+#include <llvm/Bitcode/ReaderWriter.h>
+#else
+#include <llvm/Bitcode/BitcodeWriter.h>
+#endif
+
+#include <memory>
+
+namespace llvm { class DILocation; }
 
 #if LLVM_VERSION_MAJOR == 3
 inline auto&& GetFunctionArgumentList(llvm::Function* func)       { return func->getArgumentList(); }
@@ -17,6 +29,26 @@ inline auto&& GetModuleFunctionList(const llvm::Module* M)        { return M->ge
 
 inline void SetDoesNotAlias(llvm::Function* func)                 { func->setDoesNotAlias(0); }
 inline void SetUnnamedAddr(llvm::GlobalValue* gv)                 { gv->setUnnamedAddr(true); }
+
+inline std::unique_ptr<llvm::Module> CopyModule(const llvm::Module* M) { return std::unique_ptr<llvm::Module>(llvm::CloneModule(M)); }
+inline void WriteModuleBitcode(const llvm::Module* M, llvm::raw_ostream& os) { llvm::WriteBitcodeToFile(M, os); }
+
+#if LLVM_VERSION_MINOR >= 7
+inline const llvm::DataLayout* GetModuleDataLayout(const llvm::Module* M) { return &M->getDataLayout(); }
+#else
+inline const llvm::DataLayout* GetModuleDataLayout(const llvm::Module* M) { return M->getDataLayout(); }
+#endif
+
+#if LLVM_VERSION_MINOR >= 9
+inline llvm::Function* CloneFunctionInModule(llvm::Function* F, llvm::ValueToValueMapTy& vmap) { return llvm::CloneFunction(F, vmap); }
+#else
+inline llvm::Function* CloneFunctionInModule(llvm::Function* F, llvm::ValueToValueMapTy& vmap)
+{
+	llvm::Function* clone = llvm::CloneFunction(F, vmap, false);
+	F->getParent()->getFunctionList().push_back(clone);
+	return clone;
+}
+#endif
 #else
 inline auto GetFunctionArgumentList(llvm::Function* func)         { return func->args(); }
 inline auto GetModuleFunctionList(llvm::Module* M)                { return M->functions(); }
@@ -26,9 +58,29 @@ inline auto GetModuleFunctionList(const llvm::Module* M)          { return M->fu
 inline void SetDoesNotAlias(llvm::Function* func)                 { func->setReturnDoesNotAlias(); }
 
 inline void SetUnnamedAddr(llvm::GlobalValue* gv)                 { gv->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global); }
+
+/* The module keeps its DataLayout, no need to build one from the layout string for every query */
+inline const llvm::DataLayout* GetModuleDataLayout(const llvm::Module* M) { return &M->getDataLayout(); }
+
+/* Arguments mapped in vmap are left out of the clone, which is added to the module of F */
+inline llvm::Function* CloneFunctionInModule(llvm::Function* F, llvm::ValueToValueMapTy& vmap) { return llvm::CloneFunction(F, vmap); }
+
+#if LLVM_VERSION_MAJOR >= 7
+inline std::unique_ptr<llvm::Module> CopyModule(const llvm::Module* M) { return llvm::CloneModule(*M); }
+inline void WriteModuleBitcode(const llvm::Module* M, llvm::raw_ostream& os) { llvm::WriteBitcodeToFile(*M, os); }
+#else
+inline std::unique_ptr<llvm::Module> CopyModule(const llvm::Module* M) { return llvm::CloneModule(M); }
+inline void WriteModuleBitcode(const llvm::Module* M, llvm::raw_ostream& os) { llvm::WriteBitcodeToFile(M, os); }
+#endif
 #endif
 
 std::string GetArgumentName(const llvm::Module* M, const llvm::Argument* argument);
 
+/**
+ * Give a generated function a subprogram in the compile unit of like, so code inlined into it keeps its source locations.
+ * Returns the location of its first line, or nullptr if like has no debug info.
+ */
+llvm::DILocation* CreateGeneratedSubprogram(llvm::Function* function, const llvm::Function* like);
+
 
 #endif // __COMPAT_H
@@ -46,7 +46,7 @@ constexpr const char* DriverPtrName = DRIVER_PTR_ID_STRING;
 constexpr const char* DriverDescName = DRIVER_DESC_ID_STRING;
 constexpr const char* DriverArrayName = DRIVER_ARRAY_ID_STRING;
 constexpr const char* LibFuzzerDriverName = "LLVMFuzzerTestOneInput";
-constexpr const char* LibFuzzerInitializerName = "LLVMFuzzerTestOneInput";
+constexpr const char* LibFuzzerInitializerName = "LLVMFuzzerInitialize";
 #endif
 
 #endif // __CONFIG_H
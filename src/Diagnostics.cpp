@@ -0,0 +1,15 @@
+#include "Diagnostics.h"
+
+static thread_local llvm::raw_ostream* redirected = nullptr;
+
+
+llvm::raw_ostream& Diagnostics()
+{
+	return redirected ? *redirected : llvm::errs();
+}
+
+
+void RedirectDiagnostics(llvm::raw_ostream* stream)
+{
+	redirected = stream;
+}
@@ -0,0 +1,16 @@
+#ifndef __DIAGNOSTICS_H
+#define __DIAGNOSTICS_H
+
+#include <llvm/Support/raw_ostream.h>
+
+/**
+ * Stream the passes report errors, warnings and statistics to.
+ * This is llvm::errs(), unless the current thread redirected it: macke-fuzzer-prep runs the passes
+ * on many threads and prints what was reported for a module in one piece.
+ */
+llvm::raw_ostream& Diagnostics();
+
+/* Redirects Diagnostics() of the current thread to stream, nullptr restores llvm::errs() */
+void RedirectDiagnostics(llvm::raw_ostream* stream);
+
+#endif // __DIAGNOSTICS_H
@@ -0,0 +1,385 @@
+
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <set>
+
+#include "Config.h"
+#include "Diagnostics.h"
+#include "FunctionDeclarations.h"
+#include "FuzzDriver.h"
+#include "Passes.h"
+#include "TypeHelper.h"
+
+/**
+ * Directs the fuzzer towards target locations, like the functions or lines klee reported a problem at.
+ * Every function gets its distance to the targets in the call graph, every basic block the distance
+ * in the control flow graph to a target or to a call of a function closer to the targets.
+ * Each executed block adds its distance to the counters of distance.c, the average over an exec
+ * is the metric schedulers use to prefer seeds getting closer to the targets.
+ */
+
+namespace
+{
+
+static llvm::cl::list<std::string> TargetLocations(
+	"target-locations",
+	llvm::cl::CommaSeparated,
+	llvm::cl::desc("Functions or file:line locations the fuzzer should reach"));
+
+static llvm::cl::opt<std::string> TargetLocationsFile(
+	"target-locations-file",
+	llvm::cl::desc("File with one target location (function or file:line) per line"));
+
+static llvm::cl::opt<std::string> DistanceReport(
+	"directed-distance-report",
+	llvm::cl::desc("Write the call graph distance of every driver that can reach a target to this file"));
+
+
+typedef uint64_t Distance;
+static const Distance Unreachable = std::numeric_limits<Distance>::max();
+
+/* A call costs more than a branch, like in AFLGo */
+static const Distance CallDistance = 10;
+
+
+struct TargetLocation
+{
+	std::string function; /* Empty for file:line locations */
+	std::string file;
+	unsigned line;
+};
+
+
+static bool GetTargetLocations(std::vector<TargetLocation>& targets)
+{
+	std::vector<std::string> specs(TargetLocations.begin(), TargetLocations.end());
+
+	if(!TargetLocationsFile.empty())
+	{
+		std::ifstream locationsFile(TargetLocationsFile);
+		if(!locationsFile)
+		{
+			Diagnostics() << "Error: target locations '" << TargetLocationsFile << "' can not be read.\n";
+			return false;
+		}
+
+		std::string line;
+		while(std::getline(locationsFile, line))
+		{
+			llvm::StringRef spec = llvm::StringRef(line).trim();
+			if(!spec.empty() && !spec.startswith("#"))
+				specs.push_back(spec.str());
+		}
+	}
+
+	for(const std::string& spec : specs)
+	{
+		/* file:line if the part behind the last colon is a number, a function name otherwise */
+		llvm::StringRef ref(spec);
+		size_t colon = ref.rfind(':');
+		unsigned line;
+		if(colon != llvm::StringRef::npos && !ref.substr(colon + 1).getAsInteger(10, line))
+			targets.push_back({"", ref.substr(0, colon).str(), line});
+		else
+			targets.push_back({spec, "", 0});
+	}
+	return true;
+}
+
+
+static bool MatchesFile(llvm::StringRef filename, llvm::StringRef target)
+{
+	return filename == target || (filename.endswith(target) && filename.drop_back(target.size()).endswith("/"));
+}
+
+
+/* Returns the number of blocks found for each target, blocks are collected in targetBlocks */
+static std::vector<size_t> FindTargetBlocks(llvm::Module& M, const std::vector<TargetLocation>& targets,
+		std::set<const llvm::BasicBlock*>& targetBlocks)
+{
+	std::vector<size_t> found(targets.size(), 0);
+
+	for(size_t i = 0; i < targets.size(); ++i)
+	{
+		if(targets[i].function.empty())
+			continue;
+
+		llvm::Function* f = M.getFunction(targets[i].function);
+		if(f && !f->isDeclaration())
+		{
+			targetBlocks.insert(&f->getEntryBlock());
+			++found[i];
+		}
+	}
+
+	for(llvm::Function& f : M.functions())
+	{
+		for(llvm::BasicBlock& bb : f)
+		{
+			for(llvm::Instruction& inst : bb)
+			{
+				const llvm::DILocation* loc = inst.getDebugLoc().get();
+				if(!loc)
+					continue;
+
+				for(size_t i = 0; i < targets.size(); ++i)
+				{
+					if(targets[i].function.empty() && loc->getLine() == targets[i].line
+							&& MatchesFile(loc->getFilename(), targets[i].file) && targetBlocks.insert(&bb).second)
+						++found[i];
+				}
+			}
+		}
+	}
+	return found;
+}
+
+
+static const llvm::Function* GetDirectCallee(const llvm::Instruction& inst)
+{
+	llvm::ImmutableCallSite call(&inst);
+	if(!call)
+		return nullptr;
+
+	const llvm::Function* callee = llvm::dyn_cast<llvm::Function>(call.getCalledValue()->stripPointerCasts());
+	return callee && !callee->isDeclaration() ? callee : nullptr;
+}
+
+
+/**
+ * Shortest number of calls from every function to a function containing a target.
+ * Only direct calls are followed, indirect calls end in the external node of the call graph.
+ */
+static std::map<const llvm::Function*, Distance> GetFunctionDistances(const llvm::CallGraph& callGraph,
+		const std::set<const llvm::BasicBlock*>& targetBlocks)
+{
+	std::map<const llvm::Function*, std::set<const llvm::Function*>> callers;
+	for(auto& entry : callGraph)
+	{
+		/* The node of external callers has no function */
+		const llvm::Function* caller = entry.first;
+		if(!caller)
+			continue;
+
+		for(const llvm::CallGraphNode::CallRecord& call : *entry.second)
+		{
+			const llvm::Function* callee = call.second->getFunction();
+			if(callee && !callee->isDeclaration())
+				callers[callee].insert(caller);
+		}
+	}
+
+	std::map<const llvm::Function*, Distance> distances;
+	std::queue<const llvm::Function*> worklist;
+	for(const llvm::BasicBlock* bb : targetBlocks)
+		if(distances.insert(std::make_pair(bb->getParent(), 0)).second)
+			worklist.push(bb->getParent());
+
+	/* Breadth first over the reversed call graph */
+	while(!worklist.empty())
+	{
+		const llvm::Function* f = worklist.front();
+		worklist.pop();
+		for(const llvm::Function* caller : callers[f])
+			if(distances.insert(std::make_pair(caller, distances[f] + 1)).second)
+				worklist.push(caller);
+	}
+	return distances;
+}
+
+
+/**
+ * Distance of every block of f to the nearest target block or call of a function that reaches a target.
+ * Calls start with CallDistance per level of the call graph, so blocks close to a target in this
+ * function are preferred over blocks calling deeper into the program.
+ */
+static std::map<const llvm::BasicBlock*, Distance> GetBlockDistances(const llvm::Function& f,
+		const std::set<const llvm::BasicBlock*>& targetBlocks,
+		const std::map<const llvm::Function*, Distance>& functionDistances)
+{
+	typedef std::pair<Distance, const llvm::BasicBlock*> QueueEntry;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	for(const llvm::BasicBlock& bb : f)
+	{
+		Distance start = targetBlocks.count(&bb) ? 0 : Unreachable;
+		for(const llvm::Instruction& inst : bb)
+		{
+			const llvm::Function* callee = GetDirectCallee(inst);
+			auto calleeDistance = callee ? functionDistances.find(callee) : functionDistances.end();
+			if(calleeDistance != functionDistances.end())
+				start = std::min(start, CallDistance * (calleeDistance->second + 1));
+		}
+		if(start != Unreachable)
+			queue.push(std::make_pair(start, &bb));
+	}
+
+	/* Dijkstra over the reversed control flow graph, every edge has length 1 */
+	std::map<const llvm::BasicBlock*, Distance> distances;
+	while(!queue.empty())
+	{
+		QueueEntry entry = queue.top();
+		queue.pop();
+		if(!distances.insert(std::make_pair(entry.second, entry.first)).second)
+			continue;
+
+		for(const llvm::BasicBlock* pred : llvm::predecessors(entry.second))
+			if(!distances.count(pred))
+				queue.push(std::make_pair(entry.first + 1, pred));
+	}
+	return distances;
+}
+
+
+struct DirectedDistance : public llvm::ModulePass
+{
+	static char ID;
+
+	DirectedDistance() : llvm::ModulePass(ID) { };
+
+	void getAnalysisUsage(llvm::AnalysisUsage& AU) const override
+	{
+		AU.addRequired<llvm::CallGraphWrapperPass>();
+	}
+
+	bool runOnModule(llvm::Module& M) override
+	{
+		return RunDirectedDistance(M, getAnalysis<llvm::CallGraphWrapperPass>().getCallGraph());
+	}
+};
+
+} /* Namespace */
+
+
+bool RunDirectedDistance(llvm::Module& M, const llvm::CallGraph& callGraph)
+{
+	std::vector<TargetLocation> targets;
+	if(!GetTargetLocations(targets))
+		return false;
+
+	if(targets.empty())
+	{
+		Diagnostics() << "Error: -target-locations or -target-locations-file argument missing\n";
+		return false;
+	}
+
+	std::set<const llvm::BasicBlock*> targetBlocks;
+	std::vector<size_t> found = FindTargetBlocks(M, targets, targetBlocks);
+	for(size_t i = 0; i < targets.size(); ++i)
+	{
+		if(found[i])
+			continue;
+		if(targets[i].function.empty())
+			Diagnostics() << "Warning: no code at " << targets[i].file << ":" << targets[i].line << " (compiled without -g?)\n";
+		else
+			Diagnostics() << "Warning: target function " << targets[i].function << " is not defined in the module\n";
+	}
+
+	if(targetBlocks.empty())
+	{
+		Diagnostics() << "Error: none of the target locations is in the module\n";
+		return false;
+	}
+
+	std::map<const llvm::Function*, Distance> functionDistances = GetFunctionDistances(callGraph, targetBlocks);
+
+	/* The counters are part of the runtime */
+	llvm::Type* int64Type = GetInt64Type(&M);
+	llvm::Type* voidType = llvm::Type::getVoidTy(M.getContext());
+	llvm::Constant* distanceSum = declare_macke_fuzzer_exec_counter(&M, FUNCTION_PREFIX "distance_sum");
+	llvm::Constant* distanceCount = declare_macke_fuzzer_exec_counter(&M, FUNCTION_PREFIX "distance_count");
+	llvm::Constant* distanceMin = declare_macke_fuzzer_exec_counter(&M, FUNCTION_PREFIX "distance_min");
+	llvm::Constant* reset = M.getOrInsertFunction(FUNCTION_PREFIX "distance_reset", voidType);
+
+	size_t numBlocks = 0;
+	for(llvm::Function& f : M.functions())
+	{
+		if(f.isDeclaration())
+			continue;
+
+		/* The drivers start each exec with empty counters */
+		if(IsFuzzDriver(&f))
+		{
+			llvm::IRBuilder<> builder(&*f.getEntryBlock().getFirstInsertionPt());
+			builder.CreateCall(reset);
+		}
+
+		/* Driver code runs for every input and would only dilute the average */
+		if(IsFuzzDriver(&f) || f.getName().startswith(FUNCTION_PREFIX) || !functionDistances.count(&f))
+			continue;
+
+		for(auto& blockDistance : GetBlockDistances(f, targetBlocks, functionDistances))
+		{
+			llvm::BasicBlock* bb = const_cast<llvm::BasicBlock*>(blockDistance.first);
+			llvm::BasicBlock::iterator insertPt = bb->getFirstInsertionPt();
+			if(insertPt == bb->end())
+				continue;
+
+			llvm::IRBuilder<> builder(&*insertPt);
+			llvm::Constant* distance = llvm::ConstantInt::get(int64Type, blockDistance.second);
+
+			builder.CreateStore(builder.CreateAdd(builder.CreateLoad(distanceSum), distance), distanceSum);
+			builder.CreateStore(builder.CreateAdd(builder.CreateLoad(distanceCount), llvm::ConstantInt::get(int64Type, 1)), distanceCount);
+
+			/* Branch free minimum, 0 means a target was reached */
+			llvm::Value* min = builder.CreateLoad(distanceMin);
+			builder.CreateStore(builder.CreateSelect(builder.CreateICmpULT(distance, min), distance, min), distanceMin);
+			++numBlocks;
+		}
+	}
+
+	if(!DistanceReport.empty())
+	{
+		std::error_code ec;
+		llvm::raw_fd_ostream report(DistanceReport, ec, llvm::sys::fs::F_Text);
+		if(ec)
+		{
+			Diagnostics() << "Error: can not write '" << DistanceReport << "': " << ec.message() << "\n";
+			return true;
+		}
+
+		/* Drivers call their target, so the call graph distance of the target is reported */
+		for(llvm::Function& f : M.functions())
+		{
+			auto distance = functionDistances.find(&f);
+			if(!f.isDeclaration() && IsFuzzDriver(&f) && distance != functionDistances.end() && distance->second > 0)
+				report << f.getName() << " " << distance->second - 1 << "\n";
+		}
+	}
+
+	Diagnostics() << "Instrumented " << numBlocks << " basic blocks with their distance to "
+	             << targetBlocks.size() << " target blocks\n";
+	return true;
+}
+
+
+namespace
+{
+
+char DirectedDistance::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<DirectedDistance> X(
+	"directed-distance", "Instrument basic blocks with their distance to target locations",
+	false, /* Does modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
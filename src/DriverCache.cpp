@@ -0,0 +1,359 @@
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+
+#include "ArgumentLayout.h"
+#include "Compat.h"
+#include "Config.h"
+#include "Diagnostics.h"
+#include "DriverCache.h"
+#include "HelperBitcode.h"
+#include "LayoutSchema.h"
+#include "ModuleStripping.h"
+
+/* Bump when the generated drivers change, so old cache entries are not used anymore */
+static const char* DriverCacheVersion = "macke-driver-cache 2";
+
+
+/* Everything that changes the driver but is not part of the IR */
+static std::string DescribeDriver(const llvm::Function* target, const llvm::DataLayout* dataLayout, const DriverOptions& options)
+{
+	std::string description;
+	llvm::raw_string_ostream os(description);
+
+	os << DriverCacheVersion << "\n";
+	os << "stats " << options.collectStats << " inline " << options.inlineTarget
+	   << " helpers " << options.linkHelpers << " depth " << GetMaxNestingDepth() << "\n";
+	for(const ArgumentLayout& arg : GetArgumentLayout(target, dataLayout))
+	{
+		os << "arg " << (int)arg.kind << " " << arg.size << " " << arg.hasPair << " " << arg.pairedArg
+		   << " " << arg.isString << " " << (arg.nested ? 1 : 0);
+		if(arg.pinned)
+			os << " pinned " << *arg.pinned;
+		os << "\n";
+	}
+
+	os.flush();
+	return description;
+}
+
+
+/* Strip a copy of the module down to the target and everything it reaches */
+static std::unique_ptr<llvm::Module> ExtractTarget(const llvm::Module* module, const llvm::Function* target)
+{
+	std::unique_ptr<llvm::Module> extracted = CopyModule(module);
+	llvm::Function* extractedTarget = extracted->getFunction(target->getName());
+
+	/* Keep the target exported, so crashes are still attributed to its symbol */
+	InternalizeModule(extracted.get(), [extractedTarget](const llvm::GlobalValue* value)
+		{
+			return value == extractedTarget;
+		});
+	RemoveDeadGlobals(extracted.get());
+	return extracted;
+}
+
+
+namespace
+{
+
+/* What ExtractTarget would keep of the module, collected without copying it */
+class TargetClosure
+{
+public:
+	std::vector<const llvm::GlobalValue*> globals;
+	std::vector<const llvm::MDNode*> nodes;
+	std::vector<llvm::StructType*> structs;
+
+	TargetClosure(const llvm::Module* module, const llvm::Function* target)
+	{
+		AddGlobal(target);
+		for(const llvm::NamedMDNode& named : module->named_metadata())
+			for(const llvm::MDNode* node : named.operands())
+				AddNode(node);
+
+		/* Everything added while walking is appended, so the loops see it as well */
+		for(size_t i = 0; i < globals.size(); ++i)
+			WalkGlobal(globals[i]);
+		for(size_t i = 0; i < nodes.size(); ++i)
+			for(const llvm::MDOperand& op : nodes[i]->operands())
+				AddMetadata(op.get());
+	}
+
+private:
+	std::set<const llvm::Value*> seenValues;
+	std::set<const llvm::Metadata*> seenNodes;
+	std::set<const llvm::Type*> seenTypes;
+
+	void AddGlobal(const llvm::GlobalValue* global)
+	{
+		if(seenValues.insert(global).second)
+			globals.push_back(global);
+	}
+
+	void AddNode(const llvm::MDNode* node)
+	{
+		if(seenNodes.insert(node).second)
+			nodes.push_back(node);
+	}
+
+	void AddMetadata(const llvm::Metadata* md)
+	{
+		if(auto* node = llvm::dyn_cast_or_null<llvm::MDNode>(md))
+			AddNode(node);
+		else if(auto* constant = llvm::dyn_cast_or_null<llvm::ConstantAsMetadata>(md))
+			AddValue(constant->getValue());
+	}
+
+	void AddType(llvm::Type* type)
+	{
+		if(!seenTypes.insert(type).second)
+			return;
+		if(auto* structType = llvm::dyn_cast<llvm::StructType>(type))
+			if(!structType->isLiteral())
+				structs.push_back(structType);
+		for(llvm::Type* subtype : type->subtypes())
+			AddType(subtype);
+	}
+
+	void AddValue(const llvm::Value* value)
+	{
+		AddType(value->getType());
+		if(auto* global = llvm::dyn_cast<llvm::GlobalValue>(value))
+			AddGlobal(global);
+		else if(auto* md = llvm::dyn_cast<llvm::MetadataAsValue>(value))
+			AddMetadata(md->getMetadata());
+		else if(llvm::isa<llvm::Constant>(value) && seenValues.insert(value).second)
+			for(const llvm::Value* op : llvm::cast<llvm::User>(value)->operand_values())
+				AddValue(op);
+	}
+
+	void WalkGlobal(const llvm::GlobalValue* global)
+	{
+		AddType(global->getValueType());
+		llvm::SmallVector<std::pair<unsigned, llvm::MDNode*>, 4> attached;
+		if(auto* object = llvm::dyn_cast<llvm::GlobalObject>(global))
+			object->getAllMetadata(attached);
+
+		if(auto* var = llvm::dyn_cast<llvm::GlobalVariable>(global))
+		{
+			if(var->hasInitializer())
+				AddValue(var->getInitializer());
+		}
+		else if(auto* alias = llvm::dyn_cast<llvm::GlobalAlias>(global))
+			AddValue(alias->getAliasee());
+		else if(auto* function = llvm::dyn_cast<llvm::Function>(global))
+		{
+			if(function->hasPersonalityFn())
+				AddValue(function->getPersonalityFn());
+			for(const llvm::BasicBlock& block : *function)
+			{
+				for(const llvm::Instruction& inst : block)
+				{
+					AddType(inst.getType());
+					if(auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst))
+						AddType(alloca->getAllocatedType());
+					else if(auto* gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&inst))
+						AddType(gep->getSourceElementType());
+					for(const llvm::Value* op : inst.operand_values())
+						if(!llvm::isa<llvm::Instruction>(op) && !llvm::isa<llvm::Argument>(op) && !llvm::isa<llvm::BasicBlock>(op))
+							AddValue(op);
+					inst.getAllMetadata(attached);
+				}
+			}
+		}
+
+		for(auto& md : attached)
+			AddNode(md.second);
+	}
+};
+
+} /* Namespace */
+
+
+/**
+ * Renumber the module wide slots of printed IR, unnamed globals, metadata and attribute groups,
+ * in the order they appear. The text then only depends on what it prints, not on the rest of the module.
+ * Quoted names and strings are left alone.
+ */
+static std::string RenumberSlots(const std::string& text)
+{
+	std::map<std::string, size_t> slots[3];
+	const char* sigils = "@!#";
+
+	std::string renumbered;
+	renumbered.reserve(text.size());
+	bool quoted = false;
+	for(size_t i = 0; i < text.size(); ++i)
+	{
+		char c = text[i];
+		renumbered += c;
+		if(c == '"')
+			quoted = !quoted;
+		const char* sigil = strchr(sigils, c);
+		if(quoted || !c || !sigil || i + 1 == text.size() || !isdigit((unsigned char)text[i + 1]))
+			continue;
+
+		size_t end = i + 1;
+		while(end < text.size() && isdigit((unsigned char)text[end]))
+			++end;
+		std::map<std::string, size_t>& numbers = slots[sigil - sigils];
+		auto slot = numbers.insert(std::make_pair(text.substr(i + 1, end - i - 1), numbers.size())).first;
+		renumbered += std::to_string(slot->second);
+		i = end - 1;
+	}
+	return renumbered;
+}
+
+
+/**
+ * Hash the target, everything it reaches and the layout of its driver.
+ * The printed IR is the same as the one of the module ExtractTarget would return, but only the reached part is printed.
+ * slotTracker is shared by all targets of the module, so its slots are only numbered once.
+ */
+static std::string HashTarget(const llvm::Module* module, const llvm::Function* target,
+		llvm::ModuleSlotTracker& slotTracker, const DriverOptions& options)
+{
+	TargetClosure closure(module, target);
+
+	std::string text;
+	llvm::raw_string_ostream os(text);
+	os << module->getDataLayoutStr() << "\n" << module->getTargetTriple() << "\n" << module->getModuleInlineAsm() << "\n";
+	for(llvm::StructType* structType : closure.structs)
+	{
+		structType->print(os);
+		os << "\n";
+	}
+	for(const llvm::GlobalValue* global : closure.globals)
+	{
+		/* The target stays exported, ExtractTarget internalizes everything else */
+		os << (global == target) << " ";
+		global->print(os, slotTracker);
+		os << "\n";
+
+		/* Call sites only print the number of their attribute group */
+		if(auto* function = llvm::dyn_cast<llvm::Function>(global))
+			for(const llvm::BasicBlock& block : *function)
+				for(const llvm::Instruction& inst : block)
+					if(auto* call = llvm::dyn_cast<llvm::CallInst>(&inst))
+						os << call->getAttributes().getAsString(decltype(call->getAttributes())::FunctionIndex) << "\n";
+	}
+	for(const llvm::MDNode* node : closure.nodes)
+	{
+		node->print(os, slotTracker, module);
+		os << "\n";
+	}
+	os.flush();
+
+	text = RenumberSlots(text) + DescribeDriver(target, GetModuleDataLayout(module), options);
+
+	llvm::MD5 hash;
+	hash.update(text);
+	llvm::MD5::MD5Result result;
+	hash.final(result);
+
+	llvm::SmallString<32> hex;
+	llvm::MD5::stringifyResult(result, hex);
+	return hex.str().str();
+}
+
+
+/**
+ * Write into a file of its own next to path and rename it, so concurrent builds never see a partial file.
+ * Every writer has its own temporary file, the last rename wins.
+ */
+static bool WriteAtomically(const std::string& path, const std::function<void(llvm::raw_ostream&)>& write)
+{
+	int fd;
+	llvm::SmallString<128> tmpPath;
+	if(std::error_code ec = llvm::sys::fs::createUniqueFile(path + ".%%%%%%%%.tmp", fd, tmpPath))
+	{
+		Diagnostics() << "Error: can not write next to '" << path << "': " << ec.message() << "\n";
+		return false;
+	}
+
+	{
+		llvm::raw_fd_ostream out(fd, true);
+		write(out);
+		out.close();
+		if(out.has_error())
+		{
+			Diagnostics() << "Error: can not write '" << tmpPath << "'\n";
+			out.clear_error();
+			llvm::sys::fs::remove(tmpPath);
+			return false;
+		}
+	}
+
+	if(std::error_code ec = llvm::sys::fs::rename(tmpPath, path))
+	{
+		Diagnostics() << "Error: can not rename '" << tmpPath << "': " << ec.message() << "\n";
+		llvm::sys::fs::remove(tmpPath);
+		return false;
+	}
+	return true;
+}
+
+
+bool UpdateDriverCache(const llvm::Module* module, const std::vector<llvm::Function*>& targets,
+		const std::string& cacheDir, const DriverOptions& options, DriverCacheStats& stats)
+{
+	if(std::error_code ec = llvm::sys::fs::create_directories(cacheDir))
+	{
+		Diagnostics() << "Error: can not create the driver cache '" << cacheDir << "': " << ec.message() << "\n";
+		return false;
+	}
+
+	/* Numbers every slot of the module once, instead of once per target */
+	llvm::ModuleSlotTracker slotTracker(module, true);
+
+	std::string index;
+	for(llvm::Function* target : targets)
+	{
+		std::string hash = HashTarget(module, target, slotTracker, options);
+		std::string path = cacheDir + "/" + hash + ".bc";
+		std::string indexLine = target->getName().str() + " " + hash + "\n";
+
+		if(llvm::sys::fs::exists(path))
+		{
+			++stats.hits;
+			index += indexLine;
+			continue;
+		}
+		++stats.misses;
+
+		/* Only the misses copy the module */
+		std::unique_ptr<llvm::Module> extracted = ExtractTarget(module, target);
+		llvm::Function* extractedTarget = extracted->getFunction(target->getName());
+		extractedTarget->addFnAttr(llvm::Attribute::NoInline);
+		if(!CreateFuzzDriverFor(extracted.get(), extractedTarget, LibFuzzerDriverName, options))
+		{
+			Diagnostics() << "Warning: no driver could be generated for " << target->getName() << ".\n";
+			continue;
+		}
+		EmitLayoutSchema(extracted.get(), extractedTarget);
+		EmitLayoutHash(extracted.get(), {extractedTarget});
+		if(options.linkHelpers && !LinkHelperBitcode(extracted.get()))
+			return false;
+
+		const llvm::Module* driverModule = extracted.get();
+		if(!WriteAtomically(path, [driverModule](llvm::raw_ostream& out) { WriteModuleBitcode(driverModule, out); }))
+			return false;
+		index += indexLine;
+	}
+
+	/* The index maps the targets of this run to their entries, older entries stay for other revisions */
+	return WriteAtomically(cacheDir + "/index", [&index](llvm::raw_ostream& out) { out << index; });
+}
@@ -0,0 +1,34 @@
+
+#ifndef __DRIVER_CACHE_H
+#define __DRIVER_CACHE_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+#include <string>
+#include <vector>
+
+#include "FuzzDriver.h"
+
+/**
+ * On-disk cache of single target driver modules.
+ * Every target is keyed by a hash over itself, everything it reaches and its argument layout,
+ * so only targets whose code changed get a new <hash>.bc, that has to be rebuilt.
+ */
+
+struct DriverCacheStats
+{
+	size_t hits = 0;
+	size_t misses = 0;
+};
+
+/**
+ * Make sure <cacheDir>/<hash>.bc exists for every target and write <cacheDir>/index with '<function> <hash>' lines.
+ * Each module contains the target, everything reachable from it and its driver as LLVMFuzzerTestOneInput.
+ * Returns false if the cache directory can not be written.
+ */
+bool UpdateDriverCache(const llvm::Module* module, const std::vector<llvm::Function*>& targets,
+		const std::string& cacheDir, const DriverOptions& options, DriverCacheStats& stats);
+
+
+#endif // __DRIVER_CACHE_H
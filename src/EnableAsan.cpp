@@ -3,6 +3,7 @@
 #include <llvm/IR/Function.h>
 
 #include "Config.h"
+#include "Passes.h"
 
 /**
  * Pass to set the SanitizeAddr flag,
@@ -18,11 +19,7 @@ struct EnableAsan : public llvm::FunctionPass
 
 	EnableAsan() : llvm::FunctionPass(ID) { }
 
-	bool runOnFunction(llvm::Function& F) override
-	{
-		F.addFnAttr(llvm::Attribute::SanitizeAddress);
-		return true;
-	}
+	bool runOnFunction(llvm::Function& F) override { return RunEnableAsan(F); }
 };
 
 
@@ -36,3 +33,10 @@ static llvm::RegisterPass<EnableAsan> X(
 	);
 
 } /* Namespace */
+
+
+bool RunEnableAsan(llvm::Function& F)
+{
+	F.addFnAttr(llvm::Attribute::SanitizeAddress);
+	return true;
+}
@@ -70,3 +70,80 @@ llvm::Function* declare_macke_fuzzer_array_extract(llvm::Module* module)
 {
 	return declare_function(module, "macke_fuzzer_array_extract", GetInt8PtrType(module), {GetInt8PtrType(module), GetSizeType(module), GetInt8PtrType(module), GetSizeType(module)});
 }
+/* declare const uint8_t* macke_fuzzer_decode_nested(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t count, const MackeFuzzerLayout* layout, size_t depth, MackeFuzzerAllocList* allocs) */
+llvm::Function* declare_macke_fuzzer_decode_nested(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_decode_nested", GetInt8PtrType(module),
+			{GetInt8PtrType(module), GetSizeType(module), GetInt8PtrType(module), GetSizeType(module),
+			 GetNestedLayoutType(module)->getPointerTo(), GetSizeType(module), GetAllocListType(module)->getPointerTo()});
+}
+/* declare void macke_fuzzer_free_allocs(MackeFuzzerAllocList* allocs) */
+llvm::Function* declare_macke_fuzzer_free_allocs(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_free_allocs", llvm::Type::getVoidTy(module->getContext()), {GetAllocListType(module)->getPointerTo()});
+}
+
+
+
+/* declare i64 macke_fuzzer_stats_begin(const char* name, void** handle) */
+llvm::Function* declare_macke_fuzzer_stats_begin(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_stats_begin", GetInt64Type(module), {GetInt8PtrType(module), GetInt8PtrType(module)->getPointerTo()});
+}
+/* declare i64 macke_fuzzer_stats_decoded(void* handle, i64 start, const uint8_t* data, size_t consumed, size_t pointerArgs) */
+llvm::Function* declare_macke_fuzzer_stats_decoded(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_stats_decoded", GetInt64Type(module), {GetInt8PtrType(module), GetInt64Type(module), GetInt8PtrType(module), GetSizeType(module), GetSizeType(module)});
+}
+/* declare void macke_fuzzer_stats_end(void* handle, i64 decodedAt) */
+llvm::Function* declare_macke_fuzzer_stats_end(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_stats_end", llvm::Type::getVoidTy(module->getContext()), {GetInt8PtrType(module), GetInt64Type(module)});
+}
+
+
+/* declare int macke_fuzzer_exit_guard(int (*body)(const uint8_t*, size_t), const uint8_t* data, size_t size) */
+llvm::Function* declare_macke_fuzzer_exit_guard(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_exit_guard", GetInt32Type(module),
+			{GetFuzzDriverType(module)->getPointerTo(), GetInt8PtrType(module), GetSizeType(module)});
+}
+/* declare noreturn void macke_fuzzer_exit(int status), or macke_fuzzer__exit for _exit */
+llvm::Function* declare_macke_fuzzer_exit(llvm::Module* module, bool immediate)
+{
+	llvm::Function* func = declare_function(module, immediate ? "macke_fuzzer__exit" : "macke_fuzzer_exit",
+			llvm::Type::getVoidTy(module->getContext()), {GetInt32Type(module)});
+	func->setDoesNotReturn();
+	return func;
+}
+/* declare void macke_fuzzer_exit_guard_cleanup(void (*cleanup)(void*), void* arg) */
+llvm::Function* declare_macke_fuzzer_exit_guard_cleanup(llvm::Module* module)
+{
+	llvm::Type* voidType = llvm::Type::getVoidTy(module->getContext());
+	std::vector<llvm::Type*> cleanupParams = {GetInt8PtrType(module)};
+	llvm::Type* cleanupType = llvm::FunctionType::get(voidType, cleanupParams, false)->getPointerTo();
+	return declare_function(module, "macke_fuzzer_exit_guard_cleanup", voidType, {cleanupType, GetInt8PtrType(module)});
+}
+/* declare void* macke_fuzzer_exit_guard_storage(size_t size) */
+llvm::Function* declare_macke_fuzzer_exit_guard_storage(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_exit_guard_storage", GetInt8PtrType(module), {GetSizeType(module)});
+}
+
+
+/* declare void macke_fuzzer_stub_models_reset(void) */
+llvm::Function* declare_macke_fuzzer_stub_models_reset(llvm::Module* module)
+{
+	return declare_function(module, "macke_fuzzer_stub_models_reset", llvm::Type::getVoidTy(module->getContext()), {});
+}
+
+
+/* extern __thread uint64_t <name>, initial-exec like the definition in the runtime */
+llvm::GlobalVariable* declare_macke_fuzzer_exec_counter(llvm::Module* module, const std::string& name)
+{
+	llvm::GlobalVariable* counter = module->getGlobalVariable(name);
+	if(!counter)
+		counter = new llvm::GlobalVariable(*module, GetInt64Type(module), false, llvm::GlobalValue::ExternalLinkage, nullptr, name);
+	counter->setThreadLocalMode(llvm::GlobalValue::InitialExecTLSModel);
+	return counter;
+}
@@ -3,6 +3,7 @@
 #define __FUNCTION_DECLARATIONS_H
 
 #include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Module.h>
 
 llvm::Function* declare_malloc(llvm::Module* module);
@@ -13,5 +14,23 @@ llvm::Function* declare_memset(llvm::Module* module);
 
 llvm::Function* declare_macke_fuzzer_array_byte_size(llvm::Module* module);
 llvm::Function* declare_macke_fuzzer_array_extract(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_decode_nested(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_free_allocs(llvm::Module* module);
+
+llvm::Function* declare_macke_fuzzer_stats_begin(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_stats_decoded(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_stats_end(llvm::Module* module);
+
+/* Exit interception of the intercept-exit pass */
+llvm::Function* declare_macke_fuzzer_exit_guard(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_exit(llvm::Module* module, bool immediate);
+llvm::Function* declare_macke_fuzzer_exit_guard_cleanup(llvm::Module* module);
+llvm::Function* declare_macke_fuzzer_exit_guard_storage(llvm::Module* module);
+
+/* Drops the files the models of stub-externals kept for the last exec */
+llvm::Function* declare_macke_fuzzer_stub_models_reset(llvm::Module* module);
+
+/* Per exec state of the runtime, thread local so the drivers stay reentrant */
+llvm::GlobalVariable* declare_macke_fuzzer_exec_counter(llvm::Module* module, const std::string& name);
 
 #endif // __FUNCTION_DECLARATIONS_H
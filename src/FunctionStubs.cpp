@@ -0,0 +1,19 @@
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include "FunctionStubs.h"
+
+
+/* Give a function without implementation a body, that does nothing and returns null */
+void AddNullBody(llvm::Function* function)
+{
+	llvm::Type* retType = function->getReturnType();
+	llvm::BasicBlock* retBlock = llvm::BasicBlock::Create(function->getContext(), "return", function);
+	llvm::IRBuilder<> builder(retBlock);
+
+	/* Add return */
+	if(retType->isVoidTy())
+		builder.CreateRetVoid();
+	else
+		builder.CreateRet(llvm::Constant::getNullValue(retType));
+}
@@ -0,0 +1,11 @@
+
+#ifndef __FUNCTION_STUBS_H
+#define __FUNCTION_STUBS_H
+
+#include <llvm/IR/Function.h>
+
+/* Give a function without implementation a body, that does nothing and returns null */
+void AddNullBody(llvm::Function* function);
+
+
+#endif // __FUNCTION_STUBS_H
@@ -2,12 +2,23 @@
 
 
 #include <assert.h>
+#include <algorithm>
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
 
 
+#include "ArgumentLayout.h"
 #include "Compat.h"
+#include "Config.h"
+#include "Diagnostics.h"
 #include "FuzzDriver.h"
 #include "FunctionDeclarations.h"
+#include "NestedLayout.h"
 #include "TypeHelper.h"
 
 
@@ -30,13 +41,15 @@ bool CanBeFuzzed(const llvm::Function* function)
 	bool nonSret = false;
 	for(auto& arg : GetFunctionArgumentList(function))
 	{
-		if(!arg.hasStructRetAttr())
+		/* Callbacks are stubbed, they are no input */
+		bool isCallback = arg.getType()->isPointerTy() && arg.getType()->getPointerElementType()->isFunctionTy();
+		if(!arg.hasStructRetAttr() && !isCallback)
 		{
 			nonSret = true;
 			/* If we can not deduce the argument names, dont fuzz */
 			if(GetArgumentName(function->getParent(), &arg).empty())
 			{
-				llvm::errs() << "Warning: Function '" << function->getName() << "' can not be fuzzed because argument names can not be deduced.\n";
+				Diagnostics() << "Warning: Function '" << function->getName() << "' can not be fuzzed because argument names can not be deduced.\n";
 				return false;
 			}
 		}
@@ -49,13 +62,6 @@ bool CanBeFuzzed(const llvm::Function* function)
 			if(elemType->getStructName().startswith("pthread"))
 				return false;
 		}
-		if(arg.getType()->isPointerTy())
-		{
-			if(arg.getType()->getPointerElementType()->isPointerTy())
-				return false;
-			if(arg.getType()->getPointerElementType()->isFunctionTy())
-				return false;
-		}
 	}
 
 	return nonSret;
@@ -65,14 +71,20 @@ bool CanBeFuzzed(const llvm::Function* function)
 
 /**
  * Takes as argument the value for the Data and Size, and writes back the new pointers to the remaining Data and Size
+ * For arrays, elementCount receives the number of decoded elements
+ * and nulTerminate appends a terminating 0 behind them, which is not counted.
+ * If nestedLayout is given, the pointers inside the elements are decoded from the following data,
+ * and their buffers are recorded in allocList
  */
 llvm::Value* PrepareArgumentInstruction(
 		llvm::Module* module, llvm::BasicBlock** currentBlock, llvm::Function* function,
-		llvm::DataLayout* dataLayout, llvm::Type* type,
+		const llvm::DataLayout* dataLayout, llvm::Type* type,
 		llvm::Value* bufRef, llvm::Value* remainingSizeRef,
 		llvm::Function* _memcpy, llvm::Function* _memset,
 		llvm::Function* _malloc,
-		std::vector<llvm::Value*>& saved_mallocs)
+		std::vector<llvm::Value*>& saved_mallocs,
+		llvm::Value** elementCount, bool nulTerminate,
+		llvm::Constant* nestedLayout, llvm::Value* allocList)
 {
 	/* Builder for beginning */
 	llvm::IRBuilder<> beginBuilder(*currentBlock);
@@ -95,19 +107,37 @@ llvm::Value* PrepareArgumentInstruction(
 		/* Calculate bufferSize */
 		llvm::Function* bytesizeFunc = declare_macke_fuzzer_array_byte_size(module);
 		llvm::Value* arrayReservedSpace = beginBuilder.CreateCall(bytesizeFunc, llvm::ArrayRef<llvm::Value*>{std::vector<llvm::Value*>{buf, remainingSize}});
-		llvm::Value* bufferSize = beginBuilder.CreateMul(beginBuilder.CreateUDiv(arrayReservedSpace, typeSize), typeSize);
+		llvm::Value* elements = beginBuilder.CreateUDiv(arrayReservedSpace, typeSize);
+		llvm::Value* bufferSize = beginBuilder.CreateMul(elements, typeSize);
+		*elementCount = elements;
 
 		/* Allocate buffer and save it in saved_mallocs */
-		llvm::Value* malloced_buffer = beginBuilder.CreateCall(_malloc, bufferSize);
+		llvm::Value* allocSize = bufferSize;
+		if(nulTerminate)
+			allocSize = beginBuilder.CreateAdd(bufferSize, GetSize(1, module, &beginBuilder));
+		llvm::Value* malloced_buffer = beginBuilder.CreateCall(_malloc, allocSize);
 		saved_mallocs.push_back(malloced_buffer);
 
 		/* Fill the buffer and calculate new buf and remainingSize for next argument */
 		llvm::Function* extractFunc = declare_macke_fuzzer_array_extract(module);
 		llvm::Value* newBuf = beginBuilder.CreateCall(extractFunc, llvm::ArrayRef<llvm::Value*>{
 				std::vector<llvm::Value*>{buf, remainingSize, malloced_buffer, bufferSize}});
+		if(nulTerminate)
+			beginBuilder.CreateStore(beginBuilder.getInt8(0), beginBuilder.CreateGEP(malloced_buffer, bufferSize));
 		llvm::Value* diff = beginBuilder.CreatePtrDiff(newBuf, buf);
 		llvm::Value* newSize = beginBuilder.CreateSub(remainingSize, diff);
 
+		/* Decode the buffers the elements point to */
+		if(nestedLayout)
+		{
+			llvm::Function* nestedFunc = declare_macke_fuzzer_decode_nested(module);
+			llvm::Value* nestedBuf = beginBuilder.CreateCall(nestedFunc, llvm::ArrayRef<llvm::Value*>{
+					std::vector<llvm::Value*>{newBuf, newSize, malloced_buffer, elements, nestedLayout,
+							GetSize(GetMaxNestingDepth(), module, &beginBuilder), allocList}});
+			newSize = beginBuilder.CreateSub(newSize, beginBuilder.CreatePtrDiff(nestedBuf, newBuf));
+			newBuf = nestedBuf;
+		}
+
 		/* Store newBuf and newSize */
 		beginBuilder.CreateStore(newBuf, bufRef);
 		beginBuilder.CreateStore(newSize, remainingSizeRef);
@@ -191,6 +221,298 @@ llvm::Value* PrepareArgumentInstruction(
 }
 
 
+/* Fold everything the pinned constants decide in the specialized clone */
+static void FoldPinnedConstants(llvm::Function* function)
+{
+	/* Unoptimized code keeps the arguments in stack slots, which hides the constants from folding */
+	std::vector<llvm::AllocaInst*> allocas;
+	for(llvm::Instruction& inst : function->getEntryBlock())
+		if(auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(&inst))
+			if(llvm::isAllocaPromotable(alloca))
+				allocas.push_back(alloca);
+	if(!allocas.empty())
+	{
+		llvm::DominatorTree dominators(*function);
+		llvm::PromoteMemToReg(allocas, dominators);
+	}
+
+	const llvm::DataLayout* dataLayout = GetModuleDataLayout(function->getParent());
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(llvm::BasicBlock& block : *function)
+		{
+			for(auto it = block.begin(); it != block.end(); )
+			{
+				llvm::Instruction* inst = &*it++;
+				llvm::Constant* folded = llvm::ConstantFoldInstruction(inst, *dataLayout);
+				if(!folded)
+					continue;
+				inst->replaceAllUsesWith(folded);
+				inst->eraseFromParent();
+				changed = true;
+			}
+			changed |= llvm::ConstantFoldTerminator(&block, true);
+		}
+		changed |= llvm::removeUnreachableBlocks(*function);
+	}
+}
+
+
+/**
+ * Returns <function>.pinned, a copy of function that only takes the arguments which are not pinned.
+ * The pinned constants are propagated into it and the branches they decide are removed.
+ */
+static llvm::Function* GetPinnedSpecialization(llvm::Module* module, llvm::Function* function, const std::vector<ArgumentLayout>& layout)
+{
+	std::string name = function->getName().str() + ".pinned";
+	if(llvm::Function* existing = module->getFunction(name))
+		return existing;
+
+	llvm::ValueToValueMapTy vmap;
+	size_t argNo = 0;
+	for(auto& arg : GetFunctionArgumentList(function))
+	{
+		if(layout[argNo].kind == ArgumentKind::Pinned)
+			vmap[&arg] = layout[argNo].pinned;
+		++argNo;
+	}
+
+	llvm::Function* clone = CloneFunctionInModule(function, vmap);
+	clone->setName(name);
+	clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+	clone->setComdat(nullptr);
+	FoldPinnedConstants(clone);
+	return clone;
+}
+
+
+/**
+ * Inline the call to the target, so the decoding and the target body are optimized together.
+ * The driver gets a subprogram next to the target, so the inlined code is still attributed to the target.
+ */
+static void InlineIntoDriver(llvm::Function* driver, llvm::CallInst* call, const llvm::Function* target)
+{
+	if(llvm::DILocation* location = CreateGeneratedSubprogram(driver, target))
+		call->setDebugLoc(llvm::DebugLoc(location));
+
+	llvm::Function* callee = call->getCalledFunction();
+	llvm::InlineFunctionInfo inlineInfo;
+	if(!llvm::InlineFunction(call, inlineInfo))
+	{
+		Diagnostics() << "Warning: " << target->getName() << " can not be inlined into its driver.\n";
+		return;
+	}
+
+	/* The specialized copy of pinned arguments is only called by the driver */
+	if(callee != target && callee->use_empty())
+		callee->eraseFromParent();
+}
+
+
+bool IsFuzzDriver(const llvm::Function* function)
+{
+	return function->getName() == LibFuzzerDriverName || function->getName().startswith(FUNCTION_PREFIX "driver_");
+}
+
+
+bool HoldsTargetCode(const llvm::Function* function)
+{
+	llvm::StringRef name = function->getName();
+	return !name.startswith(FUNCTION_PREFIX) || IsFuzzDriver(function) || name.startswith(FUNCTION_PREFIX "guarded_body_");
+}
+
+
+std::set<const llvm::Function*> GetDriverReachableFunctions(llvm::Module& M)
+{
+	std::set<const llvm::Function*> reachable;
+	std::vector<const llvm::Function*> worklist;
+	for(llvm::Function& f : M.functions())
+		if(!f.isDeclaration() && IsFuzzDriver(&f) && reachable.insert(&f).second)
+			worklist.push_back(&f);
+
+	if(worklist.empty())
+	{
+		for(llvm::Function& f : M.functions())
+			if(!f.isDeclaration())
+				reachable.insert(&f);
+		return reachable;
+	}
+
+	bool hasIndirectCalls = false;
+	while(!worklist.empty())
+	{
+		const llvm::Function* f = worklist.back();
+		worklist.pop_back();
+
+		for(const llvm::BasicBlock& bb : *f)
+		{
+			for(const llvm::Instruction& inst : bb)
+			{
+				llvm::ImmutableCallSite call(&inst);
+				if(!call)
+					continue;
+
+				const llvm::Function* callee = llvm::dyn_cast<llvm::Function>(call.getCalledValue()->stripPointerCasts());
+				if(!callee)
+					hasIndirectCalls = true;
+				else if(!callee->isDeclaration() && reachable.insert(callee).second)
+					worklist.push_back(callee);
+
+				/* Functions passed to a call, like the body of a driver to the exit guard, may be called by it */
+				for(const llvm::Value* arg : call.args())
+				{
+					const llvm::Function* passed = llvm::dyn_cast<llvm::Function>(arg->stripPointerCasts());
+					if(passed && !passed->isDeclaration() && reachable.insert(passed).second)
+						worklist.push_back(passed);
+				}
+			}
+		}
+
+		/* Indirect calls may reach every function whose address is taken */
+		if(worklist.empty() && hasIndirectCalls)
+		{
+			hasIndirectCalls = false;
+			for(llvm::Function& candidate : M.functions())
+				if(!candidate.isDeclaration() && candidate.hasAddressTaken() && reachable.insert(&candidate).second)
+					worklist.push_back(&candidate);
+		}
+	}
+	return reachable;
+}
+
+
+bool UsesStubModels(const llvm::Module* module)
+{
+	for(const llvm::Function& f : module->functions())
+		if(f.getName().startswith(FUNCTION_PREFIX "model_"))
+			return true;
+	return false;
+}
+
+
+bool UsesLoopGuard(const llvm::Module* module)
+{
+	return module->getGlobalVariable(FUNCTION_PREFIX "loop_counter") != nullptr;
+}
+
+
+/* Marks the calls freeing what the driver allocated, the exit guard has to free the same if the target does not return */
+static const char DriverCleanupMetadata[] = "macke.driver.cleanup";
+
+
+static void MarkDriverCleanup(llvm::CallInst* call)
+{
+	call->setMetadata(DriverCleanupMetadata, llvm::MDNode::get(call->getContext(), llvm::None));
+}
+
+
+/**
+ * Registers the buffers the driver body frees with the exit guard, right after they are allocated.
+ * The list of nested allocations moves from the stack of the body into the frame of the guard,
+ * the guard still reads it after an exit jumped out of the body.
+ */
+static void RegisterDriverCleanups(llvm::Module& M, llvm::Function* body)
+{
+	std::vector<llvm::CallInst*> cleanups;
+	for(llvm::BasicBlock& block : *body)
+		for(llvm::Instruction& inst : block)
+			if(llvm::CallInst* call = llvm::dyn_cast<llvm::CallInst>(&inst))
+				if(call->getMetadata(DriverCleanupMetadata) && call->getCalledFunction())
+					cleanups.push_back(call);
+
+	llvm::Function* registerFunc = declare_macke_fuzzer_exit_guard_cleanup(&M);
+	llvm::Type* cleanupType = registerFunc->getFunctionType()->getParamType(0);
+	for(llvm::CallInst* call : cleanups)
+	{
+		/* The malloc of a buffer, or the alloca of the list of nested allocations */
+		llvm::Instruction* resource = llvm::dyn_cast<llvm::Instruction>(call->getArgOperand(0));
+		if(!resource)
+			continue;
+
+		if(llvm::AllocaInst* alloca = llvm::dyn_cast<llvm::AllocaInst>(resource))
+		{
+			llvm::IRBuilder<> builder(alloca);
+			llvm::Value* size = GetSize(GetTypeSize(GetModuleDataLayout(&M), alloca->getAllocatedType()), &M, &builder);
+			llvm::Instruction* storage = builder.CreateCall(declare_macke_fuzzer_exit_guard_storage(&M), size);
+			alloca->replaceAllUsesWith(builder.CreateBitCast(storage, alloca->getType()));
+			alloca->eraseFromParent();
+			resource = storage;
+		}
+
+		llvm::BasicBlock::iterator insertPoint(resource);
+		llvm::IRBuilder<> builder(resource->getParent(), ++insertPoint);
+		builder.CreateCall(registerFunc, llvm::ArrayRef<llvm::Value*>{std::vector<llvm::Value*>{
+				llvm::ConstantExpr::getBitCast(call->getCalledFunction(), cleanupType),
+				builder.CreateBitCast(resource, GetInt8PtrType(&M))}});
+	}
+}
+
+
+/* Returns false if the driver is guarded already */
+static bool GuardFuzzDriver(llvm::Module& M, llvm::Function* driver)
+{
+	llvm::StringRef name = driver->getName();
+	if(name.startswith(FUNCTION_PREFIX "driver_"))
+		name = name.drop_front(sizeof(FUNCTION_PREFIX "driver_") - 1);
+	std::string bodyName = FUNCTION_PREFIX "guarded_body_" + name.str();
+	if(M.getFunction(bodyName))
+		return false;
+
+	llvm::Function* body = llvm::Function::Create(driver->getFunctionType(), llvm::GlobalValue::InternalLinkage, bodyName, &M);
+	body->copyAttributesFrom(driver);
+	body->setLinkage(llvm::GlobalValue::InternalLinkage);
+	body->getBasicBlockList().splice(body->begin(), driver->getBasicBlockList());
+
+	auto bodyArg = body->arg_begin();
+	for(llvm::Argument& arg : GetFunctionArgumentList(driver))
+	{
+		arg.replaceAllUsesWith(&*bodyArg);
+		bodyArg->takeName(&arg);
+		++bodyArg;
+	}
+	RegisterDriverCleanups(M, body);
+
+#if LLVM_VERSION_MAJOR >= 4
+	/* The debug info describes the code, which is in the body now */
+	body->setSubprogram(driver->getSubprogram());
+	driver->setSubprogram(nullptr);
+#endif
+
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(M.getContext(), "", driver));
+	std::vector<llvm::Value*> args = { body };
+	for(llvm::Argument& arg : GetFunctionArgumentList(driver))
+		args.push_back(&arg);
+	builder.CreateRet(builder.CreateCall(declare_macke_fuzzer_exit_guard(&M), args));
+	return true;
+}
+
+
+size_t GuardFuzzDrivers(llvm::Module& M)
+{
+	std::vector<llvm::Function*> drivers;
+	bool hasFunctionDrivers = false;
+	for(llvm::Function& f : M.functions())
+	{
+		if(f.isDeclaration() || !IsFuzzDriver(&f))
+			continue;
+		drivers.push_back(&f);
+		hasFunctionDrivers |= f.getName() != LibFuzzerDriverName;
+	}
+
+	size_t numGuarded = 0;
+	for(llvm::Function* driver : drivers)
+	{
+		if(hasFunctionDrivers && driver->getName() == LibFuzzerDriverName)
+			continue;
+		if(GuardFuzzDriver(M, driver))
+			++numGuarded;
+	}
+	return numGuarded;
+}
+
+
 llvm::Function* DeclareFuzzDriver(llvm::Module* module, const std::string &driverName)
 {
 	/* Check if function with driverName exists already */
@@ -209,7 +531,8 @@ llvm::Function* DeclareFuzzDriver(llvm::Module* module, const std::string &drive
 
 
 /* Returns nullptr when function with driverName already exists */
-llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFunction, const std::string &driverName)
+llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFunction, const std::string &driverName,
+		const DriverOptions& options)
 {
 	assert(fuzzFunction);
 
@@ -247,8 +570,7 @@ llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFu
 
 
 
-	/* Create DataLayout for size calculations */
-	llvm::DataLayout dataLayout(module);
+	const llvm::DataLayout* dataLayout = GetModuleDataLayout(module);
 
 	/* Create builder for beginning */
 	llvm::IRBuilder<> beginBuilder(latestBlock);
@@ -260,37 +582,124 @@ llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFu
 	beginBuilder.CreateStore(data, dataRef);
 	beginBuilder.CreateStore(size, sizeRef);
 
+	/* Files written by the last exec are gone */
+	if(UsesStubModels(module))
+		beginBuilder.CreateCall(declare_macke_fuzzer_stub_models_reset(module));
+
+	/* The loop guard counts down from the budget, before its first reset the counter is 0 and never reaches it */
+	if(UsesLoopGuard(module))
+		beginBuilder.CreateCall(module->getOrInsertFunction(FUNCTION_PREFIX "loop_guard_reset",
+				llvm::Type::getVoidTy(module->getContext())));
+
+	/* Register the exec with the stats runtime, the handle caches the drivers stats entry */
+	llvm::GlobalVariable* statsHandle = nullptr;
+	llvm::Value* statsStart = nullptr;
+	if(options.collectStats)
+	{
+		statsHandle = new llvm::GlobalVariable(*module, GetInt8PtrType(module), false,
+				llvm::GlobalValue::PrivateLinkage, llvm::Constant::getNullValue(GetInt8PtrType(module)),
+				FUNCTION_PREFIX "stats_handle");
+		statsStart = beginBuilder.CreateCall(declare_macke_fuzzer_stats_begin(module), llvm::ArrayRef<llvm::Value*>{
+				std::vector<llvm::Value*>{beginBuilder.CreateGlobalStringPtr(fuzzFunction->getName()), statsHandle}});
+	}
+
 	/* Create instructions for arguments */
-	for(auto& argument : GetFunctionArgumentList(fuzzFunction))
+	std::vector<ArgumentLayout> layout = GetArgumentLayout(fuzzFunction, dataLayout);
+	std::vector<llvm::Value*> elementCounts(layout.size(), nullptr);
+
+	/* Buffers of nested pointers are collected in a list on the stack */
+	llvm::Value* allocList = nullptr;
+	for(auto& arg : layout)
 	{
-		/* Do not fill sret arguments */
-		if(argument.hasStructRetAttr())
-		{
-			llvm::IRBuilder<> sretBuilder(latestBlock);
-			fuzzArgs.push_back(sretBuilder.CreateAlloca(argument.getType()->getPointerElementType()));
+		if(arg.kind != ArgumentKind::Array || !arg.nested || allocList)
 			continue;
+		allocList = beginBuilder.CreateAlloca(GetAllocListType(module));
+		beginBuilder.CreateStore(llvm::Constant::getNullValue(GetAllocListType(module)), allocList);
+	}
+
+	for(size_t i = 0; i < layout.size(); ++i)
+	{
+		switch(layout[i].kind)
+		{
+			/* Do not fill sret arguments */
+			case ArgumentKind::Sret:
+			{
+				llvm::IRBuilder<> sretBuilder(latestBlock);
+				fuzzArgs.push_back(sretBuilder.CreateAlloca(layout[i].type->getPointerElementType()));
+				break;
+			}
+			/* Lengths are filled in once their array is decoded */
+			case ArgumentKind::Length:
+				fuzzArgs.push_back(nullptr);
+				break;
+			/* Callbacks do nothing */
+			case ArgumentKind::Callback:
+				fuzzArgs.push_back(GetFunctionStub(module, llvm::cast<llvm::FunctionType>(layout[i].type->getPointerElementType())));
+				break;
+			/* Pinned arguments are left out of the call to the specialized copy */
+			case ArgumentKind::Pinned:
+				fuzzArgs.push_back(nullptr);
+				break;
+			default:
+				fuzzArgs.push_back(PrepareArgumentInstruction(
+							module, &latestBlock, driver,
+							dataLayout, layout[i].type,
+							dataRef, sizeRef,
+							_memcpy, _memset,
+							_malloc, saved_mallocs,
+							&elementCounts[i], layout[i].isString,
+							layout[i].nested ? EmitNestedLayout(module, *layout[i].nested) : nullptr, allocList));
 		}
-		fuzzArgs.push_back(PrepareArgumentInstruction(
-					module, &latestBlock, driver,
-					&dataLayout, argument.getType(),
-					dataRef, sizeRef,
-					_memcpy, _memset,
-					_malloc, saved_mallocs));
 	}
 
 	/* Create builder for last call and ret */
 	llvm::IRBuilder<> endBuilder(latestBlock);
 
-	/* Call target function */
-	endBuilder.CreateCall(fuzzFunction, llvm::ArrayRef<llvm::Value*>(fuzzArgs));
+	/* Length arguments get the element count of their array */
+	for(size_t i = 0; i < layout.size(); ++i)
+		if(layout[i].kind == ArgumentKind::Length)
+			fuzzArgs[i] = endBuilder.CreateZExtOrTrunc(elementCounts[layout[i].pairedArg], layout[i].type);
+
+	/* Report the decoding to the stats runtime */
+	llvm::Value* statsDecodedAt = nullptr;
+	if(options.collectStats)
+	{
+		llvm::Value* consumed = endBuilder.CreateSub(size, endBuilder.CreateLoad(sizeRef));
+		statsDecodedAt = endBuilder.CreateCall(declare_macke_fuzzer_stats_decoded(module), llvm::ArrayRef<llvm::Value*>{
+				std::vector<llvm::Value*>{
+						endBuilder.CreateLoad(statsHandle), statsStart, data, consumed,
+						GetSize(saved_mallocs.size(), module, &endBuilder)}});
+	}
+
+	/* Call target function, or its copy specialized to the pinned arguments */
+	llvm::Function* callee = fuzzFunction;
+	if(HasPinnedArguments(layout))
+	{
+		callee = GetPinnedSpecialization(module, fuzzFunction, layout);
+		fuzzArgs.erase(std::remove(fuzzArgs.begin(), fuzzArgs.end(), nullptr), fuzzArgs.end());
+	}
+	llvm::CallInst* call = endBuilder.CreateCall(callee, llvm::ArrayRef<llvm::Value*>(fuzzArgs));
+
+	if(options.collectStats)
+		endBuilder.CreateCall(declare_macke_fuzzer_stats_end(module), llvm::ArrayRef<llvm::Value*>{
+				std::vector<llvm::Value*>{endBuilder.CreateLoad(statsHandle), statsDecodedAt}});
 
 	/* Free everything alloced */
 	for(auto& malloc : saved_mallocs)
-		endBuilder.CreateCall(_free, malloc);
+		MarkDriverCleanup(endBuilder.CreateCall(_free, malloc));
+	if(allocList)
+		MarkDriverCleanup(endBuilder.CreateCall(declare_macke_fuzzer_free_allocs(module), allocList));
 
 	/* Driver always returns 0 */
 	endBuilder.CreateRet(endBuilder.getInt32(0));
 
+	if(options.inlineTarget)
+		InlineIntoDriver(driver, call, fuzzFunction);
+
+	/* Drivers added after intercept-exit or loop-guard need the exit guard their runtime jumps back to */
+	if(module->getFunction("macke_fuzzer_exit_guard"))
+		GuardFuzzDrivers(*module);
+
 	return driver;
 }
 
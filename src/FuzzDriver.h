@@ -5,12 +5,53 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
 
+#include <set>
+
 /* Returns whether a function is suitable for fuzzing */
 bool CanBeFuzzed(const llvm::Function* function);
 
+/* Optional features of generated drivers */
+struct DriverOptions
+{
+	/* Report execs, decoded bytes and timings to the shared stats block of the runtime */
+	bool collectStats = false;
+	/* Inline a copy of the target into the driver, the exported target stays as it is */
+	bool inlineTarget = false;
+	/* Link private copies of the decode helpers into the module, to be inlined into the drivers */
+	bool linkHelpers = false;
+};
+
+/* Returns whether function is LLVMFuzzerTestOneInput or one of the per-function drivers */
+bool IsFuzzDriver(const llvm::Function* function);
+
+/**
+ * Returns whether the function may contain code of the target: every function we did not generate,
+ * and the drivers and their guarded bodies, which hold an inlined copy of the target with -fuzz-inline-target.
+ * Instrumentation of the target code has to cover all of them.
+ */
+bool HoldsTargetCode(const llvm::Function* function);
+
+/* Functions reachable from the drivers, or all functions, if the module has no drivers yet */
+std::set<const llvm::Function*> GetDriverReachableFunctions(llvm::Module& M);
+
+/**
+ * Move the body of every driver into an internal function that the driver calls through macke_fuzzer_exit_guard,
+ * so intercepted exits and the loop guard can end an exec by jumping back to the driver.
+ * LLVMFuzzerTestOneInput is left alone if there are per-function drivers, it only dispatches to them.
+ * Returns how many drivers were not guarded before.
+ */
+size_t GuardFuzzDrivers(llvm::Module& M);
+
+/* Returns whether stub-externals redirected functions to the models of the runtime, the drivers reset them for every exec */
+bool UsesStubModels(const llvm::Module* module);
+
+/* Returns whether loop-guard ran on the module, the drivers reset its counter for every exec */
+bool UsesLoopGuard(const llvm::Module* module);
+
 /* Returns nullptr when function with driverName already exists */
 llvm::Function* DeclareFuzzDriver(llvm::Module* module, const std::string &driverName);
-llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFunction, const std::string& driverName);
+llvm::Function* CreateFuzzDriverFor(llvm::Module* module, llvm::Function* fuzzFunction, const std::string& driverName,
+		const DriverOptions& options = DriverOptions());
 
 
 #endif // __FUZZ_DRIVER_H
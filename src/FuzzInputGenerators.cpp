@@ -6,6 +6,7 @@
 #include <llvm/Pass.h>
 #include <llvm/Support/CommandLine.h>
 
+#include "ArgumentLayout.h"
 #include "Config.h"
 #include "Compat.h"
 #include "TypeHelper.h"
@@ -60,24 +61,26 @@ llvm::Function* CreateFuzzInputGenerator(llvm::Module* module, llvm::Function* f
 	llvm::BasicBlock* basicBlock = llvm::BasicBlock::Create(module->getContext(), "", generator);
 	llvm::IRBuilder<> builder(basicBlock);
 
-	/* Create DataLayout for size calculations */
-	llvm::DataLayout dataLayout(module);
+	const llvm::DataLayout* dataLayout = GetModuleDataLayout(module);
 
 	llvm::Value* calcRetLen = GetSize(0, module, &builder);
 
+	std::vector<ArgumentLayout> layout = GetArgumentLayout(fuzzFunction, dataLayout);
+
 	/* Calculate retLen */
 	{
 		bool first = true; /* On all arguments but the first we have to add the seperator to retLen */
-		for(auto& argument : GetFunctionArgumentList(fuzzFunction))
+		for(auto& argument : layout)
 		{
-			/* Ignore sret arguments */
-			if(argument.hasStructRetAttr())
+			/* Ignore arguments that are not part of the input */
+			if(argument.kind == ArgumentKind::Sret || argument.kind == ArgumentKind::Length
+					|| argument.kind == ArgumentKind::Callback || argument.kind == ArgumentKind::Pinned)
 				continue;
 
-			if(argument.getType()->isPointerTy()) /* Array, add arrLen */
+			if(argument.kind == ArgumentKind::Array) /* Array, add arrLen */
 				calcRetLen = builder.CreateAdd(calcRetLen, arrLen);
 			else /* Value, just add size */
-				calcRetLen = builder.CreateAdd(calcRetLen, GetSize(GetTypeSize(&dataLayout, argument.getType()), module, &builder));
+				calcRetLen = builder.CreateAdd(calcRetLen, GetSize(argument.size, module, &builder));
 			if(first)
 				first = false;
 			else
@@ -100,12 +103,13 @@ llvm::Function* CreateFuzzInputGenerator(llvm::Module* module, llvm::Function* f
 	{
 		llvm::Value* currentPtr = retArray;
 
-		for(auto& argument : GetFunctionArgumentList(fuzzFunction))
+		for(auto& argument : layout)
 		{
-			if(argument.hasStructRetAttr())
+			if(argument.kind == ArgumentKind::Sret || argument.kind == ArgumentKind::Length
+					|| argument.kind == ArgumentKind::Callback || argument.kind == ArgumentKind::Pinned)
 				continue;
 
-			if(argument.getType()->isPointerTy())
+			if(argument.kind == ArgumentKind::Array)
 			{
 				/* use memset and add arrLen */
 				builder.CreateCall(_memset, llvm::ArrayRef<llvm::Value*>{
@@ -121,7 +125,7 @@ llvm::Function* CreateFuzzInputGenerator(llvm::Module* module, llvm::Function* f
 			}
 			else
 			{
-				llvm::Value* typeSize = GetSize(GetTypeSize(&dataLayout, argument.getType()), module, &builder);
+				llvm::Value* typeSize = GetSize(argument.size, module, &builder);
 				/* use memset and add typesize */
 				builder.CreateCall(_memset, llvm::ArrayRef<llvm::Value*>{
 						std::vector<llvm::Value*>{
@@ -148,21 +152,20 @@ llvm::Function* CreateFuzzInputGenerator(llvm::Module* module, llvm::Function* f
 std::string GetInputGeneratorNameForFunction(llvm::Module* module, llvm::Function* function)
 {
 	std::string ret = FUNCTION_PREFIX "generator";
-	/* Create DataLayout for size calculations */
-	llvm::DataLayout dataLayout(module);
+	const llvm::DataLayout* dataLayout = GetModuleDataLayout(module);
 
-	for(auto& arg : GetFunctionArgumentList(function))
+	for(auto& arg : GetArgumentLayout(function, dataLayout))
 	{
-		if(arg.hasStructRetAttr())
+		if(arg.kind == ArgumentKind::Sret || arg.kind == ArgumentKind::Length || arg.kind == ArgumentKind::Callback
+				|| arg.kind == ArgumentKind::Pinned)
 			continue;
 
-		llvm::Type* elemType = arg.getType();
-		if(elemType->isPointerTy())
+		if(arg.kind == ArgumentKind::Array)
 			ret += "_ptr";
 		else
 		{
 			ret += "_t";
-			ret += GetTypeSize(&dataLayout, elemType);
+			ret += std::to_string(arg.size);
 		}
 	}
 	return ret;
@@ -0,0 +1,38 @@
+
+#include "Compat.h"
+#include "FuzzDriver.h"
+#include "FuzzabilityAnalysis.h"
+
+
+FuzzabilityInfo::FuzzabilityInfo(llvm::Module& module)
+{
+	for(llvm::Function& f : GetModuleFunctionList(&module))
+	{
+		if(CanBeFuzzed(&f))
+		{
+			fuzzable.push_back(&f);
+			fuzzableSet.insert(&f);
+		}
+	}
+}
+
+
+bool FuzzabilityWrapperPass::runOnModule(llvm::Module& M)
+{
+	info.reset(new FuzzabilityInfo(M));
+	return false;
+}
+
+
+char FuzzabilityWrapperPass::ID = 0; /* Value is ignored */
+
+#if LLVM_VERSION_MAJOR >= 7
+llvm::AnalysisKey FuzzabilityAnalysis::Key;
+#endif
+
+/* Register the analysis */
+static llvm::RegisterPass<FuzzabilityWrapperPass> X(
+	"fuzzability", "Functions fuzzing drivers can be generated for",
+	true, /* Does not modify CFG */
+	true  /* Is only analysis */
+	);
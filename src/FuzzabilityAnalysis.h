@@ -0,0 +1,72 @@
+
+#ifndef __FUZZABILITY_ANALYSIS_H
+#define __FUZZABILITY_ANALYSIS_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+#if LLVM_VERSION_MAJOR >= 7
+#include <llvm/IR/PassManager.h>
+#endif
+
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * The functions drivers can be generated for, computed once per module.
+ * CanBeFuzzed deduces argument names from debug info, which is slow on large modules,
+ * so the passes share this result instead of checking every function again.
+ */
+class FuzzabilityInfo
+{
+public:
+	explicit FuzzabilityInfo(llvm::Module& module);
+
+	/* In module order */
+	const std::vector<llvm::Function*>& GetFuzzableFunctions() const { return fuzzable; }
+	bool IsFuzzable(const llvm::Function* function) const { return fuzzableSet.count(function) != 0; }
+
+private:
+	std::vector<llvm::Function*> fuzzable;
+	std::set<const llvm::Function*> fuzzableSet;
+};
+
+
+/* Legacy pass manager: getAnalysis<FuzzabilityWrapperPass>().GetInfo() */
+class FuzzabilityWrapperPass : public llvm::ModulePass
+{
+public:
+	static char ID;
+
+	FuzzabilityWrapperPass() : llvm::ModulePass(ID) { }
+
+	bool runOnModule(llvm::Module& M) override;
+	void getAnalysisUsage(llvm::AnalysisUsage& AU) const override { AU.setPreservesAll(); }
+	void releaseMemory() override { info.reset(); }
+
+	const FuzzabilityInfo& GetInfo() const { return *info; }
+
+private:
+	std::unique_ptr<FuzzabilityInfo> info;
+};
+
+
+#if LLVM_VERSION_MAJOR >= 7
+/* New pass manager: MAM.getResult<FuzzabilityAnalysis>(M) */
+class FuzzabilityAnalysis : public llvm::AnalysisInfoMixin<FuzzabilityAnalysis>
+{
+public:
+	typedef FuzzabilityInfo Result;
+
+	Result run(llvm::Module& M, llvm::ModuleAnalysisManager&) { return FuzzabilityInfo(M); }
+
+private:
+	friend llvm::AnalysisInfoMixin<FuzzabilityAnalysis>;
+	static llvm::AnalysisKey Key;
+};
+#endif
+
+
+#endif // __FUZZABILITY_ANALYSIS_H
@@ -0,0 +1,98 @@
+
+#include <llvm/IR/Attributes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#if LLVM_VERSION_MAJOR >= 4
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Linker/Linker.h>
+#endif
+
+#include "Config.h"
+#include "Diagnostics.h"
+#include "HelperBitcode.h"
+
+/* The Makefile compiles the helpers with the clang of the llvm the plugin is built against */
+#ifdef HELPER_BITCODE_PATH
+asm(".pushsection .rodata\n"
+    ".balign 4\n"
+    ".globl macke_fuzzer_helper_bitcode\n"
+    ".hidden macke_fuzzer_helper_bitcode\n"
+    "macke_fuzzer_helper_bitcode:\n"
+    ".incbin \"" HELPER_BITCODE_PATH "\"\n"
+    ".globl macke_fuzzer_helper_bitcode_end\n"
+    ".hidden macke_fuzzer_helper_bitcode_end\n"
+    "macke_fuzzer_helper_bitcode_end:\n"
+    ".popsection\n");
+
+extern "C" __attribute__((visibility("hidden"))) const char macke_fuzzer_helper_bitcode[];
+extern "C" __attribute__((visibility("hidden"))) const char macke_fuzzer_helper_bitcode_end[];
+#endif
+
+/* Helpers the drivers call, everything else in the bitcode is only linked if they need it */
+static const char* HelperNames[] = {
+	FUNCTION_PREFIX "array_byte_size",
+	FUNCTION_PREFIX "array_extract"
+};
+
+
+bool LinkHelperBitcode(llvm::Module* module)
+{
+#if !defined(HELPER_BITCODE_PATH) || LLVM_VERSION_MAJOR < 4
+	(void)module;
+	Diagnostics() << "Error: the plugin was built without the helper bitcode, it needs llvm 4 or newer.\n";
+	return false;
+#else
+	llvm::StringRef bitcode(macke_fuzzer_helper_bitcode, macke_fuzzer_helper_bitcode_end - macke_fuzzer_helper_bitcode);
+	std::unique_ptr<llvm::MemoryBuffer> buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "helper_funcs", false);
+
+	llvm::Expected<std::unique_ptr<llvm::Module>> helpers = llvm::parseBitcodeFile(buffer->getMemBufferRef(), module->getContext());
+	if(!helpers)
+	{
+		Diagnostics() << "Error: can not read the helper bitcode: " << llvm::toString(helpers.takeError()) << "\n";
+		return false;
+	}
+
+	/* The helpers work on size_t, which has to be the same as in the module */
+	const llvm::DataLayout& dataLayout = module->getDataLayout();
+	if((*helpers)->getDataLayout().getPointerSizeInBits() != dataLayout.getPointerSizeInBits())
+	{
+		Diagnostics() << "Error: the helper bitcode was built for " << (*helpers)->getTargetTriple()
+		             << ", not for the target of the module " << module->getTargetTriple() << ".\n";
+		return false;
+	}
+	(*helpers)->setDataLayout(dataLayout);
+	(*helpers)->setTargetTriple(module->getTargetTriple());
+
+	for(const char* name : HelperNames)
+	{
+		llvm::Function* helper = (*helpers)->getFunction(name);
+		if(!helper)
+			continue;
+
+		/* The generated drivers have no target attributes, a callee with more features would not be inlined */
+		helper->removeFnAttr("target-cpu");
+		helper->removeFnAttr("target-features");
+		helper->removeFnAttr(llvm::Attribute::NoInline);
+		helper->removeFnAttr(llvm::Attribute::OptimizeNone);
+		helper->addFnAttr(llvm::Attribute::AlwaysInline);
+	}
+
+	if(llvm::Linker::linkModules(*module, std::move(*helpers), llvm::Linker::Flags::LinkOnlyNeeded))
+	{
+		Diagnostics() << "Error: can not link the helper bitcode into the module.\n";
+		return false;
+	}
+
+	/* Private copies, the runtime keeps its own for the code that is not generated */
+	for(const char* name : HelperNames)
+	{
+		llvm::Function* helper = module->getFunction(name);
+		if(helper && !helper->isDeclaration())
+			helper->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+	return true;
+#endif
+}
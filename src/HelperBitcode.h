@@ -0,0 +1,15 @@
+#ifndef __HELPER_BITCODE_H
+#define __HELPER_BITCODE_H
+
+#include <llvm/IR/Module.h>
+
+/**
+ * The decode helpers of helper_funcs/buffer_extract.c are embedded into the plugin as bitcode.
+ * Linking them into a module gives the drivers private, always inlined copies,
+ * so the decoding is optimized together with each driver - for its element sizes and argument counts -
+ * instead of calling the native helpers of the runtime.
+ */
+bool LinkHelperBitcode(llvm::Module* module);
+
+
+#endif // __HELPER_BITCODE_H
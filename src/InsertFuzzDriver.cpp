@@ -5,12 +5,23 @@
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <set>
+
 
 #include "Compat.h"
 #include "Config.h"
+#include "Diagnostics.h"
+#include "DriverCache.h"
 #include "TypeHelper.h"
 #include "FuzzDriver.h"
 #include "FuzzInputGenerators.h"
+#include "FuzzabilityAnalysis.h"
+#include "HelperBitcode.h"
+#include "LayoutSchema.h"
+#include "ModuleStripping.h"
+#include "Passes.h"
+#include "TargetDedup.h"
+#include "TargetRanking.h"
 
 namespace {
 
@@ -20,6 +31,66 @@ static llvm::cl::opt<std::string> FuzzFunc(
 	"fuzz-func",
 	llvm::cl::desc("Function the driver should be generated for"));
 
+static llvm::cl::opt<bool> StripUnreachable(
+	"fuzz-strip-unreachable",
+	llvm::cl::desc("Internalize everything but the driver entry points and runtime hooks, then remove code not reachable from them"),
+	llvm::cl::init(false));
+
+static llvm::cl::opt<bool> CollectStats(
+	"fuzz-stats",
+	llvm::cl::desc("Let the drivers report execs, decoded bytes and timings to the shared stats block of the runtime"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<bool> InlineTarget(
+	"fuzz-inline-target",
+	llvm::cl::desc("Inline a copy of each target into its driver, so it is optimized together with the decoding. "
+	               "The target itself is still exported, and the inlined code keeps its debug locations"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<bool> LinkHelpers(
+	"fuzz-link-helpers",
+	llvm::cl::desc("Link the decode helpers into the module as private copies marked always inline, "
+	               "so they are specialized for each driver instead of called in the runtime"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<bool> TargetWeights(
+	"fuzz-target-weights",
+	llvm::cl::desc("Rank the targets like rank-targets and store their weights next to the driver table, "
+	               "so schedulers can read them with --rank-fuzz-drivers"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<bool> DedupTargets(
+	"fuzz-dedup-targets",
+	llvm::cl::desc("Generate only one driver for targets with equivalent code and input layout. "
+	               "The others are listed as its aliases in the binary, --list-fuzz-aliases prints them"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<std::string> DriverCacheDir(
+	"fuzz-driver-cache",
+	llvm::cl::desc("Instead of changing the module, write a single target driver module per target into this directory, "
+	               "named after a hash of the target and everything it reaches. Unchanged targets are skipped"));
+
+
+static llvm::cl::opt<std::string> LayoutDir(
+	"fuzz-layout-dir",
+	llvm::cl::desc("Write the input layout schema of every driver to <dir>/<function>.layout"));
+
+
+/* Driver features requested on the command line */
+static DriverOptions GetDriverOptions()
+{
+	DriverOptions options;
+	options.collectStats = CollectStats;
+	options.inlineTarget = InlineTarget;
+	options.linkHelpers = LinkHelpers;
+	return options;
+}
+
 
 struct InsertFuzzDriver : public llvm::ModulePass
 {
@@ -27,11 +98,98 @@ struct InsertFuzzDriver : public llvm::ModulePass
 
 	InsertFuzzDriver() : llvm::ModulePass(ID) { };
 
-	bool runOnModule(llvm::Module& M) override;
+	void getAnalysisUsage(llvm::AnalysisUsage& AU) const override
+	{
+		AU.addRequired<FuzzabilityWrapperPass>();
+	}
+
+	bool runOnModule(llvm::Module& M) override
+	{
+		return RunInsertFuzzDriver(M, getAnalysis<FuzzabilityWrapperPass>().GetInfo());
+	}
 };
 
-bool InsertFuzzDriver::runOnModule(llvm::Module& M)
+/* Fill the driver cache for the targets, the module itself stays unchanged */
+static bool UpdateCache(llvm::Module& M, const FuzzabilityInfo& fuzzability)
 {
+	std::vector<llvm::Function*> targets;
+	if(FuzzFunc.empty())
+		targets = fuzzability.GetFuzzableFunctions();
+	else
+	{
+		llvm::Function* targetFunction = M.getFunction(FuzzFunc);
+		if(!targetFunction)
+		{
+			Diagnostics() << "Error: " << FuzzFunc
+			             << " is no function inside the module.\n"
+			             << "Fuzzing driver generation is not possible!\n";
+			return false;
+		}
+		targets.push_back(targetFunction);
+	}
+
+	DriverCacheStats stats;
+	if(!UpdateDriverCache(&M, targets, DriverCacheDir, GetDriverOptions(), stats))
+		return false;
+
+	Diagnostics() << "Driver cache: " << stats.hits << " hits, " << stats.misses << " misses\n";
+	return false;
+}
+
+/* macke_fuzzer_driver_weights, the weight of every entry of the driver table, 0 for the terminating one */
+static void EmitTargetWeights(llvm::Module* module, const std::vector<llvm::Function*>& targets)
+{
+	llvm::Type* doubleType = llvm::Type::getDoubleTy(module->getContext());
+	std::vector<llvm::Constant*> weights;
+	for(const TargetRank& rank : RankTargets(targets))
+		weights.push_back(llvm::ConstantFP::get(doubleType, rank.weight));
+	weights.push_back(llvm::ConstantFP::get(doubleType, 0.0));
+
+	llvm::ArrayType* arrayType = llvm::ArrayType::get(doubleType, weights.size());
+	new llvm::GlobalVariable(*module, arrayType, true, llvm::GlobalValue::ExternalLinkage,
+			llvm::ConstantArray::get(arrayType, weights), FUNCTION_PREFIX "driver_weights");
+}
+
+/* Private NUL terminated copy of str, as i8* */
+static llvm::Constant* GetStringConstant(llvm::Module* module, llvm::StringRef str)
+{
+	llvm::Constant* strConstant = llvm::ConstantDataArray::getString(module->getContext(), str);
+	llvm::GlobalVariable* strGlobal = new llvm::GlobalVariable(*module, strConstant->getType(),
+			true, llvm::GlobalValue::PrivateLinkage, strConstant);
+	SetUnnamedAddr(strGlobal);
+	return llvm::ConstantExpr::getBitCast(strGlobal, GetInt8PtrType(module));
+}
+
+
+/* macke_fuzzer_driver_aliases, pairs of the names of an alias and the target fuzzed for it, terminated by a NULL pair */
+static void EmitTargetAliases(llvm::Module* module, const std::vector<TargetAlias>& aliases)
+{
+	llvm::StructType* aliasStruct = llvm::StructType::get(module->getContext(),
+			{ GetInt8PtrType(module), GetInt8PtrType(module) });
+	std::vector<llvm::Constant*> entries;
+	for(const TargetAlias& alias : aliases)
+	{
+		std::vector<llvm::Constant*> names = {
+			GetStringConstant(module, alias.alias->getName()),
+			GetStringConstant(module, alias.target->getName())
+		};
+		entries.push_back(llvm::ConstantStruct::get(aliasStruct, names));
+	}
+	entries.push_back(llvm::Constant::getNullValue(aliasStruct));
+
+	llvm::ArrayType* arrayType = llvm::ArrayType::get(aliasStruct, entries.size());
+	new llvm::GlobalVariable(*module, arrayType, true, llvm::GlobalValue::ExternalLinkage,
+			llvm::ConstantArray::get(arrayType, entries), FUNCTION_PREFIX "driver_aliases");
+}
+
+} /* Namespace */
+
+
+bool RunInsertFuzzDriver(llvm::Module& M, const FuzzabilityInfo& fuzzability)
+{
+	if(!DriverCacheDir.empty())
+		return UpdateCache(M, fuzzability);
+
 	/* If no function is specified, generate one for all functions */
 	if(FuzzFunc.empty())
 	{
@@ -43,7 +201,7 @@ bool InsertFuzzDriver::runOnModule(llvm::Module& M)
 
 		if(!fuzzDriver)
 		{
-			llvm::errs() << "Error: " << LibFuzzerDriverName
+			Diagnostics() << "Error: " << LibFuzzerDriverName
 				          << " already exists in the module.\n";
 			return false;
 		}
@@ -56,45 +214,45 @@ bool InsertFuzzDriver::runOnModule(llvm::Module& M)
 								{
 									GetInt8PtrType(&M),
 									driverType->getPointerTo(),
-									generatorType->getPointerTo()
+									generatorType->getPointerTo(),
+									GetInt8PtrType(&M)
 								})),
 				DriverDescName);
 		std::vector<llvm::Constant*> descEntries;
 
 		/* Collect all functions that can be fuzzed */
-		std::vector<llvm::Function*> fuzzingTargets;
-		for(llvm::Function& f : GetModuleFunctionList(&M))
-		{
-			if(CanBeFuzzed(&f))
-				fuzzingTargets.push_back(&f);
-		}
+		std::vector<llvm::Function*> fuzzingTargets = fuzzability.GetFuzzableFunctions();
+
+		/* Equivalent targets share the driver of the first of them */
+		std::vector<TargetAlias> aliases;
+		std::vector<llvm::Function*> driverTargets = DedupTargets ? DeduplicateTargets(fuzzingTargets, aliases) : fuzzingTargets;
+		if(DedupTargets)
+			Diagnostics() << "Skipped " << aliases.size() << " targets equivalent to others, "
+			             << driverTargets.size() << " drivers left\n";
 
 		/* Create driver for each function and add an entry to the description array */
 		std::vector<llvm::Function*> fuzzingDrivers;
-		for(llvm::Function* f : fuzzingTargets)
+		for(llvm::Function* f : driverTargets)
 		{
 			f->addFnAttr(llvm::Attribute::NoInline);
 			std::string driverName = FUNCTION_PREFIX "driver_";
 			driverName += f->getName();
-			llvm::Function* functionDriver = CreateFuzzDriverFor(&M, f, driverName);
+			llvm::Function* functionDriver = CreateFuzzDriverFor(&M, f, driverName, GetDriverOptions());
 			fuzzingDrivers.push_back(functionDriver);
 
-			llvm::Constant* strConstant = llvm::ConstantDataArray::getString(M.getContext(), f->getName());
-			llvm::GlobalVariable *strGlobal = new llvm::GlobalVariable(M, strConstant->getType(),
-					true, llvm::GlobalValue::PrivateLinkage,
-					strConstant);
-
 			llvm::Function* inputGenerator = GetInputGeneratorForFunction(&M, f);
-
-			SetUnnamedAddr(strGlobal);
+			llvm::Constant* layoutSchema = EmitLayoutSchema(&M, f);
+			if(!LayoutDir.empty() && !WriteLayoutSchema(LayoutDir, f))
+				return false;
 
 			descEntries.push_back(llvm::ConstantStruct::get(descStruct,
 					llvm::ArrayRef<llvm::Constant*>(
 							std::vector<llvm::Constant*>(
 								{
-									llvm::ConstantExpr::getBitCast(strGlobal, GetInt8PtrType(&M)),
+									GetStringConstant(&M, f->getName()),
 									functionDriver,
-									inputGenerator
+									inputGenerator,
+									layoutSchema
 								}))));
 		}
 
@@ -123,7 +281,30 @@ bool InsertFuzzDriver::runOnModule(llvm::Module& M)
 		llvm::GlobalVariable* driverDescriptions = new llvm::GlobalVariable(M, descArrayType, true,
 				llvm::GlobalValue::ExternalLinkage, descArrayInitializer, DriverArrayName);
 		(void)driverDescriptions;
+		EmitLayoutHash(&M, driverTargets);
+		if(TargetWeights)
+			EmitTargetWeights(&M, driverTargets);
+
+		/* Aliases decode their inputs like their target, tools still find a schema under their name */
+		if(DedupTargets)
+			EmitTargetAliases(&M, aliases);
+		for(const TargetAlias& alias : aliases)
+			if(!LayoutDir.empty() && !WriteLayoutSchema(LayoutDir, alias.alias))
+				return false;
+
+		if(LinkHelpers && !LinkHelperBitcode(&M))
+			return false;
 
+		if(StripUnreachable)
+		{
+			/* Aliases stay exported as well, their code is still what the drivers run */
+			std::set<const llvm::GlobalValue*> targets(fuzzingTargets.begin(), fuzzingTargets.end());
+			InternalizeModule(&M, [&targets](const llvm::GlobalValue* value)
+				{
+					return targets.count(value) || IsFuzzRuntimeSymbol(value);
+				});
+			RemoveDeadGlobals(&M);
+		}
 
 		return true;
 	}
@@ -132,22 +313,41 @@ bool InsertFuzzDriver::runOnModule(llvm::Module& M)
 
 	if(!targetFunction)
 	{
-		llvm::errs() << "Error: " << FuzzFunc
+		Diagnostics() << "Error: " << FuzzFunc
 		             << " is no function inside the module.\n"
 		             << "Fuzzing driver generation is not possible!\n";
 		return false;
 	}
 	targetFunction->addFnAttr(llvm::Attribute::NoInline);
 
-	if(!CreateFuzzDriverFor(&M, targetFunction, LibFuzzerDriverName))
+	if(!CreateFuzzDriverFor(&M, targetFunction, LibFuzzerDriverName, GetDriverOptions()))
 	{
-		llvm::errs() << "Error: fuzzing driver could not be generated!\n";
+		Diagnostics() << "Error: fuzzing driver could not be generated!\n";
 		return false;
 	}
+	EmitLayoutSchema(&M, targetFunction);
+	EmitLayoutHash(&M, {targetFunction});
+	if(!LayoutDir.empty() && !WriteLayoutSchema(LayoutDir, targetFunction))
+		return false;
+	if(LinkHelpers && !LinkHelperBitcode(&M))
+		return false;
+
+	if(StripUnreachable)
+	{
+		/* Keep the target exported, so crashes are still attributed to its symbol */
+		InternalizeModule(&M, [targetFunction](const llvm::GlobalValue* value)
+			{
+				return value == targetFunction || IsFuzzRuntimeSymbol(value);
+			});
+		RemoveDeadGlobals(&M);
+	}
 
 	return true;
 }
 
+
+namespace {
+
 char InsertFuzzDriver::ID = 0; /* Value is ignored */
 
 /* Register the new pass */
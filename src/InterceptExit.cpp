@@ -0,0 +1,97 @@
+
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "Diagnostics.h"
+#include "FunctionDeclarations.h"
+#include "FuzzDriver.h"
+#include "Passes.h"
+
+/**
+ * Keeps targets that exit on bad input from ending persistent fuzzing loops.
+ * Calls of exit, _exit and _Exit in code reachable from the drivers go to macke_fuzzer_exit instead,
+ * and every driver runs its body through macke_fuzzer_exit_guard, which the intercepted exit jumps back to.
+ * The exec ends there, the process keeps running. See helper_funcs/exit_guard.c.
+ * Run it after insert-fuzzdriver. abort is left alone, it is a crash the fuzzer should report.
+ */
+
+namespace
+{
+
+struct InterceptExit : public llvm::ModulePass
+{
+	static char ID;
+
+	InterceptExit() : llvm::ModulePass(ID) { };
+
+	bool runOnModule(llvm::Module& M) override { return RunInterceptExit(M); }
+};
+
+
+/* Returns the exit function a call site calls, or nullptr */
+static const char* GetExitFunction(llvm::CallSite call)
+{
+	static const char* exitFunctions[] = { "exit", "_exit", "_Exit" };
+
+	const llvm::Function* callee = call.getCalledFunction();
+	if(!callee || !callee->isDeclaration() || call.arg_size() != 1 || !call.getArgument(0)->getType()->isIntegerTy(32))
+		return nullptr;
+
+	for(const char* name : exitFunctions)
+		if(callee->getName() == name)
+			return name;
+	return nullptr;
+}
+
+} /* Namespace */
+
+
+bool RunInterceptExit(llvm::Module& M)
+{
+	/* Redirect the exits first, the reachable functions are computed from the unguarded drivers */
+	size_t numExits = 0;
+	for(const llvm::Function* reachable : GetDriverReachableFunctions(M))
+	{
+		llvm::Function* f = const_cast<llvm::Function*>(reachable);
+		if(!HoldsTargetCode(f))
+			continue;
+
+		for(llvm::BasicBlock& bb : *f)
+		{
+			for(llvm::Instruction& inst : bb)
+			{
+				llvm::CallSite call(&inst);
+				const char* exitFunction = call ? GetExitFunction(call) : nullptr;
+				if(!exitFunction)
+					continue;
+
+				call.setCalledFunction(declare_macke_fuzzer_exit(&M, exitFunction[0] == '_'));
+				++numExits;
+			}
+		}
+	}
+
+	size_t numDrivers = GuardFuzzDrivers(M);
+
+	Diagnostics() << "Intercepted " << numExits << " exit calls, guarded " << numDrivers << " drivers\n";
+	return numDrivers > 0 || numExits > 0;
+}
+
+
+namespace
+{
+
+char InterceptExit::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<InterceptExit> X(
+	"intercept-exit", "End only the exec instead of the process when a target calls exit",
+	false, /* Does modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
@@ -1,31 +1,24 @@
 
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
-#include <llvm/IR/DataLayout.h>
 #include <llvm/Pass.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 
-#include <fstream>
-#include <sstream>
-
 #include <klee/Internal/ADT/KTest.h>
 
 #include "Compat.h"
-#include "TypeHelper.h"
-
-#define MIN(a,b)   (((a) < (b)) ? (a) : (b))
+#include "Diagnostics.h"
+#include "LayoutSchema.h"
+#include "Passes.h"
+#include "../helper_funcs/corpus_pack.h"
+#include "../helper_funcs/layout_schema.h"
 
 /**
  * Helper pass to extract a ktest file from an inputfile and the functionname
  */
 
-/* Extern helper function declarations */
-extern "C" {
-	extern size_t macke_fuzzer_array_byte_size(const uint8_t* src, size_t max);
-	extern const uint8_t* macke_fuzzer_array_extract(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen);
-}
-
 namespace
 {
 
@@ -37,6 +30,15 @@ namespace
 		"ktestinputfile",
 		llvm::cl::desc("Path to the fuzzer-input file containing the data"));
 
+	static llvm::cl::opt<std::string> KTestInputPack(
+		"ktestinputpack",
+		llvm::cl::desc("Path to a packed corpus containing the data, converts all entries into the -ktestout directory"));
+
+	static llvm::cl::opt<int> KTestInputIndex(
+		"ktestinputindex",
+		llvm::cl::desc("Only convert this entry of the -ktestinputpack corpus, written to -ktestout"),
+		llvm::cl::init(-1));
+
 	static llvm::cl::opt<std::string> KTestOut(
 		"ktestout",
 		llvm::cl::desc("Where to save the ktest file"));
@@ -51,46 +53,14 @@ namespace
 
 		KTestGenerator() : llvm::ModulePass(ID) { };
 
-		bool runOnModule(llvm::Module &M) override;
+		bool runOnModule(llvm::Module &M) override { return RunKTestGenerator(M); }
 	};
 
 
-	bool KTestGenerator::runOnModule(llvm::Module &M)
+	/* Create the ktest for one fuzzer input and write it to outPath */
+	static bool WriteKTest(llvm::Module &M, llvm::Function* backgroundFunc,
+			const uint8_t* current, size_t remaining, const std::string& outPath)
 	{
-		assert(kTest_getCurrentVersion() == 3);
-
-		/* Check all the command line arguments */
-		if(KTestFunction.empty())
-		{
-			llvm::errs() << "Error: -ktestfunction parameter is needed!\n";
-			return false;
-		}
-
-		if(KTestInputFile.empty())
-		{
-			llvm::errs() << "Error: -ktestinputfile parameter is needed!\n";
-			return false;
-		}
-
-		if(KTestOut.empty())
-		{
-			llvm::errs() << "Error: -ktestout parameter is needed!\n";
-			return false;
-		}
-
-
-		/* Look for the function */
-		llvm::Function* backgroundFunc = M.getFunction(KTestFunction);
-
-		// Check if the function given by the user really exists
-		if(backgroundFunc == nullptr)
-		{
-			llvm::errs() << "Error: " << KTestFunction
-			             << " is no function inside the module. " << '\n'
-			             << "ktest generation is not possible!" << '\n';
-			return false;
-		}
-
 		/* Create and initialize the ktest object */
 		KTest* newKTest = (KTest*)malloc(sizeof(KTest));
 		newKTest->symArgvs = 0;
@@ -115,82 +85,42 @@ namespace
 			newKTest->args[i][arg.size()] = 0;
 		}
 
-		/* Read the input file into buffer */
-		std::string inputBuffer;
+		/* Decode the arguments through the layout schema, like the standalone converter */
+		MackeFuzzerSchema schema;
+		if(macke_fuzzer_schema_parse(&schema, GetLayoutSchema(backgroundFunc, GetModuleDataLayout(&M)).c_str()) != 0)
 		{
-			std::ifstream instream_input(KTestInputFile);
-			std::stringstream input_stream;
-			input_stream << instream_input.rdbuf();
-			inputBuffer = input_stream.str();
+			Diagnostics() << "Error: no layout schema for " << backgroundFunc->getName() << "\n";
+			kTest_free(newKTest);
+			return false;
 		}
 
-		size_t remaining = inputBuffer.size();
-		const uint8_t* current = (const uint8_t*)inputBuffer.c_str();
-
-		/* Create DataLayout for size calculations */
-		llvm::DataLayout dataLayout(&M);
+		MackeFuzzerObjects objects;
+		macke_fuzzer_schema_decode(&schema, current, remaining, &objects);
+		macke_fuzzer_schema_free(&schema);
 
-		/* Allocate array for KTestObjects */
-		newKTest->numObjects = backgroundFunc->arg_size();
-		newKTest->objects = (KTestObject*)malloc(sizeof(KTestObject) * backgroundFunc->arg_size());
-		KTestObject* obj = newKTest->objects;
-
-
-		/* Fill KTestObjects for arguments */
-		for(auto& arg : GetFunctionArgumentList(backgroundFunc))
+		/* The ktest takes over names and bytes of the objects */
+		newKTest->numObjects = objects.count;
+		newKTest->objects = (KTestObject*)malloc(sizeof(KTestObject) * (objects.count ? objects.count : 1));
+		for(size_t i = 0; i < objects.count; ++i)
 		{
-			std::string argName = GetArgumentName(&M, &arg);
-
-			/* Copy the argument-name into the obj */
-			obj->name = (char*)malloc(argName.size() + 1);
-			memcpy(obj->name, argName.c_str(), argName.size());
-			obj->name[argName.size()] = 0;
-
-			if(argName.size() == 0)
-				abort();
-
-
-			/** Unpack the argument and save it into the object **/
-			/* Pointers and non-pointers are treated differently */
-			if(arg.getType()->isPointerTy())
-			{
-				size_t typeSize = GetTypeSize(&dataLayout, arg.getType()->getPointerElementType());
-				size_t byteSize = macke_fuzzer_array_byte_size(current, remaining);
-
-				/* Round down */
-				obj->numBytes = (byteSize / typeSize) * typeSize;
-				obj->bytes = (unsigned char*)malloc(obj->numBytes);
-				const uint8_t* newCurrent = macke_fuzzer_array_extract(current, remaining, obj->bytes, obj->numBytes);
-				remaining -= newCurrent - current;
-				current = newCurrent;
-			}
-			else
-			{
-				size_t typeSize = GetTypeSize(&dataLayout, arg.getType());
-				obj->numBytes = typeSize;
-				/* 0 initialized */
-				obj->bytes = (unsigned char*)calloc(1, obj->numBytes);
-
-				size_t copyBytes = MIN(remaining, typeSize);
-				memcpy(obj->bytes, current, copyBytes);
-				current += copyBytes;
-				remaining -= copyBytes;
-			}
-
-			/* Point to the next object */
-			obj++;
+			newKTest->objects[i].name = objects.objects[i].name;
+			newKTest->objects[i].numBytes = objects.objects[i].numBytes;
+			newKTest->objects[i].bytes = objects.objects[i].bytes;
 		}
+		free(objects.objects);
 
 
 		/* Output the KTest to file */
-		if(!kTest_toFile(newKTest, KTestOut.c_str()))
-			llvm::errs() << "Unspecified error in kTest_toFile!\n";
+		bool ret = kTest_toFile(newKTest, outPath.c_str());
+		if(!ret)
+			Diagnostics() << "Unspecified error in kTest_toFile!\n";
 
 		kTest_free(newKTest);
 
-		return false;
+		return ret;
 	}
 
+
 char KTestGenerator::ID = 0; /* Value is ignored */
 
 /* Register the new pass */
@@ -201,3 +131,89 @@ static llvm::RegisterPass<KTestGenerator> X(
 	);
 
 }
+
+
+bool RunKTestGenerator(llvm::Module& M)
+{
+	assert(kTest_getCurrentVersion() == 3);
+
+	/* Check all the command line arguments */
+	if(KTestFunction.empty())
+	{
+		Diagnostics() << "Error: -ktestfunction parameter is needed!\n";
+		return false;
+	}
+
+	if(KTestInputFile.empty() && KTestInputPack.empty())
+	{
+		Diagnostics() << "Error: -ktestinputfile or -ktestinputpack parameter is needed!\n";
+		return false;
+	}
+
+	if(KTestOut.empty())
+	{
+		Diagnostics() << "Error: -ktestout parameter is needed!\n";
+		return false;
+	}
+
+
+	/* Look for the function */
+	llvm::Function* backgroundFunc = M.getFunction(KTestFunction);
+
+	// Check if the function given by the user really exists
+	if(backgroundFunc == nullptr)
+	{
+		Diagnostics() << "Error: " << KTestFunction
+		             << " is no function inside the module. " << '\n'
+		             << "ktest generation is not possible!" << '\n';
+		return false;
+	}
+
+	/* Convert entries of a packed corpus straight from its mapping */
+	if(!KTestInputPack.empty())
+	{
+		MackeFuzzerPack pack;
+		if(macke_fuzzer_pack_open(&pack, KTestInputPack.c_str()) != 0)
+		{
+			Diagnostics() << "Error: " << KTestInputPack << " is no packed corpus!\n";
+			return false;
+		}
+
+		/* A single entry goes to -ktestout, all entries go into the -ktestout directory */
+		for(size_t i = 0; i < pack.count; ++i)
+		{
+			if(KTestInputIndex >= 0 && i != (size_t)KTestInputIndex)
+				continue;
+
+			size_t len;
+			const uint8_t* data = macke_fuzzer_pack_get(&pack, i, &len);
+			if(!data)
+			{
+				Diagnostics() << "Error: entry " << i << " of " << KTestInputPack << " is truncated!\n";
+				continue;
+			}
+
+			std::string outPath = KTestOut;
+			if(KTestInputIndex < 0)
+				outPath += "/input_" + std::to_string(i) + ".ktest";
+			WriteKTest(M, backgroundFunc, data, len, outPath);
+		}
+
+		macke_fuzzer_pack_close(&pack);
+		return false;
+	}
+
+	/* Map the input file */
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> inputBuffer = llvm::MemoryBuffer::getFile(KTestInputFile);
+	if(!inputBuffer)
+	{
+		Diagnostics() << "Error: " << KTestInputFile << " can not be read: "
+		             << inputBuffer.getError().message() << '\n';
+		return false;
+	}
+
+	WriteKTest(M, backgroundFunc, (const uint8_t*)(*inputBuffer)->getBufferStart(),
+			(*inputBuffer)->getBufferSize(), KTestOut);
+
+	return false;
+}
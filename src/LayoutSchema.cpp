@@ -0,0 +1,168 @@
+
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <map>
+
+#include "ArgumentLayout.h"
+#include "Compat.h"
+#include "Config.h"
+#include "Diagnostics.h"
+#include "LayoutSchema.h"
+#include "TypeHelper.h"
+#include "../helper_funcs/layout_schema.h"
+
+
+static const char* GetKindName(ArgumentKind kind)
+{
+	switch(kind)
+	{
+		case ArgumentKind::Value:    return "value";
+		case ArgumentKind::Array:    return "array";
+		case ArgumentKind::Length:   return "length";
+		case ArgumentKind::Sret:     return "sret";
+		case ArgumentKind::Callback: return "callback";
+		case ArgumentKind::Pinned:   return "pinned";
+	}
+	return "value";
+}
+
+
+/* The bytes of a pinned constant in target memory order, as hex. Null pointers are all zero */
+static std::string GetPinnedBytes(const llvm::Constant* constant, size_t size, const llvm::DataLayout* dataLayout)
+{
+	llvm::APInt bits(size * 8, 0);
+	if(auto* intConstant = llvm::dyn_cast<llvm::ConstantInt>(constant))
+		bits = intConstant->getValue().zextOrTrunc(size * 8);
+	else if(auto* floatConstant = llvm::dyn_cast<llvm::ConstantFP>(constant))
+		bits = floatConstant->getValueAPF().bitcastToAPInt().zextOrTrunc(size * 8);
+
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string hex;
+	for(size_t i = 0; i < size; ++i)
+	{
+		size_t byte = dataLayout->isLittleEndian() ? i : size - 1 - i;
+		uint64_t value = bits.lshr(byte * 8).getLoBits(8).getZExtValue();
+		hex += hexDigits[value >> 4];
+		hex += hexDigits[value & 0xF];
+	}
+	return hex;
+}
+
+
+std::string GetLayoutSchema(const llvm::Function* function, const llvm::DataLayout* dataLayout)
+{
+	std::string schema;
+	llvm::raw_string_ostream os(schema);
+
+	os << MACKE_FUZZER_SCHEMA_MAGIC << " " << MACKE_FUZZER_SCHEMA_VERSION << "\n";
+	os << "function " << function->getName() << "\n";
+	os << "max-depth " << GetMaxNestingDepth() << "\n";
+
+	std::vector<ArgumentLayout> layout = GetArgumentLayout(function, dataLayout);
+
+	/* Nodes of all nested layouts are numbered in one sequence */
+	std::map<const NestedLayoutNode*, size_t> nodeIds;
+	std::vector<const NestedLayoutNode*> nodes;
+	for(const ArgumentLayout& arg : layout)
+	{
+		if(!arg.nested)
+			continue;
+		for(auto& node : arg.nested->nodes)
+		{
+			nodeIds[node.get()] = nodes.size();
+			nodes.push_back(node.get());
+		}
+	}
+
+	size_t argNo = 0;
+	for(auto& arg : GetFunctionArgumentList(function))
+	{
+		const ArgumentLayout& argLayout = layout[argNo++];
+		os << "arg " << GetArgumentName(function->getParent(), &arg) << " " << GetKindName(argLayout.kind) << " " << argLayout.size;
+		if(argLayout.isString)
+			os << " string";
+		if(argLayout.hasPair)
+			os << " pair " << argLayout.pairedArg;
+		if(argLayout.nested)
+			os << " nested " << nodeIds[argLayout.nested->root];
+		if(argLayout.pinned && argLayout.size)
+			os << " value " << GetPinnedBytes(argLayout.pinned, argLayout.size, dataLayout);
+		os << "\n";
+	}
+
+	for(size_t i = 0; i < nodes.size(); ++i)
+	{
+		os << "node " << i << " " << nodes[i]->elementSize << "\n";
+		for(const NestedField& field : nodes[i]->fields)
+		{
+			if(field.isFunction)
+				os << "field " << i << " " << field.offset << " function\n";
+			else
+				os << "field " << i << " " << field.offset << " data " << nodeIds[field.pointee] << "\n";
+		}
+	}
+
+	os.flush();
+	return schema;
+}
+
+
+llvm::Constant* EmitLayoutSchema(llvm::Module* module, const llvm::Function* function)
+{
+	llvm::Constant* strConstant = llvm::ConstantDataArray::getString(module->getContext(),
+			GetLayoutSchema(function, GetModuleDataLayout(module)));
+
+	/* Exported, so tools can read it from the symbol table of the fuzzing binary */
+	llvm::GlobalVariable* strGlobal = new llvm::GlobalVariable(*module, strConstant->getType(), true,
+			llvm::GlobalValue::ExternalLinkage, strConstant, FUNCTION_PREFIX "layout_schema_" + function->getName().str());
+
+	return llvm::ConstantExpr::getBitCast(strGlobal, GetInt8PtrType(module));
+}
+
+
+bool WriteLayoutSchema(const std::string& dir, const llvm::Function* function)
+{
+	if(std::error_code ec = llvm::sys::fs::create_directories(dir))
+	{
+		Diagnostics() << "Error: can not create '" << dir << "': " << ec.message() << "\n";
+		return false;
+	}
+
+	std::string path = dir + "/" + function->getName().str() + ".layout";
+	std::error_code ec;
+	llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::F_None);
+	if(ec)
+	{
+		Diagnostics() << "Error: can not write '" << path << "': " << ec.message() << "\n";
+		return false;
+	}
+
+	out << GetLayoutSchema(function, GetModuleDataLayout(function->getParent()));
+	return true;
+}
+
+
+void EmitLayoutHash(llvm::Module* module, const std::vector<llvm::Function*>& functions)
+{
+	llvm::MD5 hash;
+	for(const llvm::Function* function : functions)
+	{
+		hash.update(function->getName());
+		hash.update(GetLayoutSchema(function, GetModuleDataLayout(module)));
+	}
+	llvm::MD5::MD5Result result;
+	hash.final(result);
+
+	uint64_t value = 0;
+	for(size_t i = 0; i < sizeof(value); ++i)
+		value = (value << 8) | result[i];
+
+	llvm::Type* int64Type = GetInt64Type(module);
+	new llvm::GlobalVariable(*module, int64Type, true, llvm::GlobalValue::ExternalLinkage,
+			llvm::ConstantInt::get(int64Type, value), FUNCTION_PREFIX "layout_hash");
+}
@@ -0,0 +1,32 @@
+
+#ifndef __LAYOUT_SCHEMA_TEXT_H
+#define __LAYOUT_SCHEMA_TEXT_H
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Text form of the argument layout of a function, in the format parsed by helper_funcs/layout_schema.c.
+ * Tools decode inputs with it, without loading the module.
+ */
+std::string GetLayoutSchema(const llvm::Function* function, const llvm::DataLayout* dataLayout);
+
+/* Add the schema of function as constant string, returns a pointer to it */
+llvm::Constant* EmitLayoutSchema(llvm::Module* module, const llvm::Function* function);
+
+/* Write the schema of function to <dir>/<function>.layout */
+bool WriteLayoutSchema(const std::string& dir, const llvm::Function* function);
+
+/**
+ * Add macke_fuzzer_layout_hash, a hash over the names and schemas of all drivers in order.
+ * Builds of the same module with different instrumentation have the same hash,
+ * so the runtime can check that inputs of one build mean the same for the other.
+ */
+void EmitLayoutHash(llvm::Module* module, const std::vector<llvm::Function*>& functions);
+
+
+#endif // __LAYOUT_SCHEMA_TEXT_H
@@ -0,0 +1,152 @@
+
+#include <llvm/ADT/SetVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+#include <set>
+
+#include "Config.h"
+#include "Diagnostics.h"
+#include "FunctionDeclarations.h"
+#include "FuzzDriver.h"
+#include "Passes.h"
+#include "TypeHelper.h"
+
+/**
+ * Counts the back-edges taken during one exec and stops execs that exceed a budget,
+ * long before the timeout of the fuzzer would kill them.
+ * All latches of loops reachable from the drivers decrement one global counter,
+ * the drivers reset it on entry and loop_guard.c ends the exec when it runs out.
+ * The drivers run their body through macke_fuzzer_exit_guard like for intercept-exit, the exec ends by jumping back to it
+ * and the driver returns 0, so libFuzzer and afl go on with the next input. Only the forked children
+ * of the reproduce build raise SIGXCPU instead, the batch reproducer reports that as slow.
+ */
+
+namespace
+{
+
+static llvm::cl::opt<unsigned long long> LoopBudget(
+	"loop-guard-budget",
+	llvm::cl::desc("Back-edges an exec may take before it is stopped (can be overridden with MACKE_FUZZER_LOOP_BUDGET at runtime)"),
+	llvm::cl::init(1ULL << 24));
+
+
+static void CollectLatches(const llvm::Loop* loop, llvm::SmallSetVector<llvm::BasicBlock*, 16>& latches)
+{
+	llvm::SmallVector<llvm::BasicBlock*, 4> loopLatches;
+	loop->getLoopLatches(loopLatches);
+	latches.insert(loopLatches.begin(), loopLatches.end());
+
+	for(const llvm::Loop* subLoop : loop->getSubLoops())
+		CollectLatches(subLoop, latches);
+}
+
+
+struct LoopGuard : public llvm::ModulePass
+{
+	static char ID;
+
+	LoopGuard() : llvm::ModulePass(ID) { };
+
+	void getAnalysisUsage(llvm::AnalysisUsage& AU) const override
+	{
+		AU.addRequired<llvm::LoopInfoWrapperPass>();
+	}
+
+	bool runOnModule(llvm::Module& M) override
+	{
+		return RunLoopGuard(M, [this](llvm::Function& f) -> llvm::LoopInfo&
+			{
+				return getAnalysis<llvm::LoopInfoWrapperPass>(f).getLoopInfo();
+			});
+	}
+};
+
+} /* Namespace */
+
+
+bool RunLoopGuard(llvm::Module& M, const std::function<llvm::LoopInfo&(llvm::Function&)>& getLoopInfo)
+{
+	llvm::LLVMContext& ctx = M.getContext();
+	llvm::Type* int64Type = GetInt64Type(&M);
+	llvm::Type* voidType = llvm::Type::getVoidTy(ctx);
+
+	/* The counter and the handlers are part of the runtime, the budget is defined here */
+	llvm::Constant* counter = declare_macke_fuzzer_exec_counter(&M, FUNCTION_PREFIX "loop_counter");
+	llvm::Constant* exceeded = M.getOrInsertFunction(FUNCTION_PREFIX "loop_guard_exceeded", voidType);
+	llvm::Constant* reset = M.getOrInsertFunction(FUNCTION_PREFIX "loop_guard_reset", voidType);
+
+	if(!M.getGlobalVariable(FUNCTION_PREFIX "loop_guard_budget"))
+		new llvm::GlobalVariable(M, int64Type, true, llvm::GlobalValue::WeakAnyLinkage,
+				llvm::ConstantInt::get(int64Type, LoopBudget), FUNCTION_PREFIX "loop_guard_budget");
+
+	std::set<const llvm::Function*> guarded = GetDriverReachableFunctions(M);
+	llvm::MDNode* unlikely = llvm::MDBuilder(ctx).createBranchWeights(1, 1 << 20);
+
+	size_t numLatches = 0;
+	for(llvm::Function& f : M.functions())
+	{
+		if(f.isDeclaration())
+			continue;
+
+		/* The drivers start each exec with a full budget */
+		if(IsFuzzDriver(&f))
+		{
+			llvm::IRBuilder<> builder(&*f.getEntryBlock().getFirstInsertionPt());
+			builder.CreateCall(reset);
+		}
+
+		/* The runtime is left alone, the drivers may hold an inlined target */
+		if(!guarded.count(&f) || !HoldsTargetCode(&f))
+			continue;
+
+		llvm::LoopInfo& loopInfo = getLoopInfo(f);
+		llvm::SmallSetVector<llvm::BasicBlock*, 16> latches;
+		for(const llvm::Loop* loop : loopInfo)
+			CollectLatches(loop, latches);
+
+		/* Decrement the counter on every back-edge, the handler is only called when it reaches 0 */
+		for(llvm::BasicBlock* latch : latches)
+		{
+			llvm::Instruction* terminator = latch->getTerminator();
+			llvm::IRBuilder<> builder(terminator);
+			llvm::Value* remaining = builder.CreateSub(builder.CreateLoad(counter), llvm::ConstantInt::get(int64Type, 1));
+			builder.CreateStore(remaining, counter);
+			llvm::Value* isExceeded = builder.CreateICmpEQ(remaining, llvm::ConstantInt::get(int64Type, 0));
+
+			llvm::TerminatorInst* exceededTerm = llvm::SplitBlockAndInsertIfThen(isExceeded, terminator, true, unlikely);
+			llvm::IRBuilder<>(exceededTerm).CreateCall(exceeded);
+			++numLatches;
+		}
+	}
+
+	/* After the reset was added, it moves into the guarded body with the rest of the driver */
+	GuardFuzzDrivers(M);
+
+	Diagnostics() << "Guarded " << numLatches << " loop latches\n";
+	return true;
+}
+
+
+namespace
+{
+
+char LoopGuard::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<LoopGuard> X(
+	"loop-guard", "Stop execs that take more loop back-edges than a budget",
+	false, /* Does modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
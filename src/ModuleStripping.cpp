@@ -0,0 +1,218 @@
+
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalAlias.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include "Config.h"
+#include "ModuleStripping.h"
+
+
+/* Returns whether a global should stay visible outside of the module after driver insertion */
+bool IsFuzzRuntimeSymbol(const llvm::GlobalValue* value)
+{
+	llvm::StringRef name = value->getName();
+
+	/* Entry points called by libFuzzer, afl and the reproduce main */
+	if(name == LibFuzzerDriverName || name == LibFuzzerInitializerName || name == "main")
+		return true;
+
+	/* libFuzzer hooks the target may define itself */
+	if(name.startswith("LLVMFuzzer"))
+		return true;
+
+	/* Our own drivers, descriptions and generators */
+	if(name.startswith(FUNCTION_PREFIX))
+		return true;
+
+	/* Runtime hooks of the sanitizers and afl */
+	if(name.startswith("__sanitizer") || name.startswith("__asan") || name.startswith("__afl"))
+		return true;
+
+	return false;
+}
+
+
+/* Give internal linkage to every definition for which keep returns false */
+bool InternalizeModule(llvm::Module* module, const std::function<bool(const llvm::GlobalValue*)>& keep)
+{
+	bool changed = false;
+
+	auto internalize = [&](llvm::GlobalValue& value)
+	{
+		if(value.isDeclaration() || value.hasLocalLinkage())
+			return;
+		/* Intrinsic globals like llvm.used or llvm.global_ctors must keep their linkage */
+		if(value.getName().startswith("llvm."))
+			return;
+		if(keep(&value))
+			return;
+
+		value.setVisibility(llvm::GlobalValue::DefaultVisibility);
+		value.setLinkage(llvm::GlobalValue::InternalLinkage);
+		changed = true;
+	};
+
+	for(llvm::Function& f : module->functions())
+	{
+		internalize(f);
+		if(f.hasLocalLinkage() && f.hasComdat())
+			f.setComdat(nullptr);
+	}
+	for(llvm::GlobalVariable& gv : module->globals())
+	{
+		internalize(gv);
+		if(gv.hasLocalLinkage() && gv.hasComdat())
+			gv.setComdat(nullptr);
+	}
+	for(llvm::GlobalAlias& ga : module->aliases())
+		internalize(ga);
+
+	return changed;
+}
+
+
+/* Mark every global value that is referenced by the given constant */
+static void MarkConstant(const llvm::Constant* constant,
+		llvm::SmallPtrSetImpl<const llvm::GlobalValue*>& alive,
+		llvm::SmallVectorImpl<const llvm::GlobalValue*>& worklist,
+		llvm::SmallPtrSetImpl<const llvm::Constant*>& visitedConstants)
+{
+	if(!visitedConstants.insert(constant).second)
+		return;
+
+	if(auto* value = llvm::dyn_cast<llvm::GlobalValue>(constant))
+	{
+		if(alive.insert(value).second)
+			worklist.push_back(value);
+		return;
+	}
+
+	for(const llvm::Use& op : constant->operands())
+		if(auto* opConstant = llvm::dyn_cast<llvm::Constant>(op.get()))
+			MarkConstant(opConstant, alive, worklist, visitedConstants);
+}
+
+
+/* Whether every use of value, through constants, is in the body, initializer or aliasee of one of values */
+static bool OnlyUsedBy(const llvm::Value* value, const llvm::SmallPtrSetImpl<const llvm::GlobalValue*>& values)
+{
+	for(const llvm::User* user : value->users())
+	{
+		if(auto* inst = llvm::dyn_cast<llvm::Instruction>(user))
+		{
+			if(!values.count(inst->getFunction()))
+				return false;
+		}
+		else if(auto* global = llvm::dyn_cast<llvm::GlobalValue>(user))
+		{
+			if(!values.count(global))
+				return false;
+		}
+		else if(!llvm::isa<llvm::Constant>(user) || !OnlyUsedBy(user, values))
+			return false;
+	}
+	return true;
+}
+
+
+/* Remove all internal functions, variables and aliases that can not be reached from an externally visible one */
+bool RemoveDeadGlobals(llvm::Module* module)
+{
+	llvm::SmallPtrSet<const llvm::GlobalValue*, 32> alive;
+	llvm::SmallPtrSet<const llvm::Constant*, 32> visitedConstants;
+	llvm::SmallVector<const llvm::GlobalValue*, 64> worklist;
+
+	/* Every externally visible definition is a root */
+	auto addRoot = [&](const llvm::GlobalValue& value)
+	{
+		if(value.isDeclaration() || value.hasLocalLinkage())
+			return;
+		if(alive.insert(&value).second)
+			worklist.push_back(&value);
+	};
+	for(const llvm::Function& f : module->functions())
+		addRoot(f);
+	for(const llvm::GlobalVariable& gv : module->globals())
+		addRoot(gv);
+	for(const llvm::GlobalAlias& ga : module->aliases())
+		addRoot(ga);
+
+	/* Propagate liveness through function bodies, initializers and aliasees */
+	while(!worklist.empty())
+	{
+		const llvm::GlobalValue* value = worklist.pop_back_val();
+
+		if(auto* f = llvm::dyn_cast<llvm::Function>(value))
+		{
+			if(f->hasPersonalityFn())
+				MarkConstant(f->getPersonalityFn(), alive, worklist, visitedConstants);
+			for(const llvm::BasicBlock& bb : *f)
+				for(const llvm::Instruction& inst : bb)
+					for(const llvm::Use& op : inst.operands())
+						if(auto* constant = llvm::dyn_cast<llvm::Constant>(op.get()))
+							MarkConstant(constant, alive, worklist, visitedConstants);
+		}
+		else if(auto* gv = llvm::dyn_cast<llvm::GlobalVariable>(value))
+		{
+			if(gv->hasInitializer())
+				MarkConstant(gv->getInitializer(), alive, worklist, visitedConstants);
+		}
+		else if(auto* ga = llvm::dyn_cast<llvm::GlobalAlias>(value))
+		{
+			MarkConstant(ga->getAliasee(), alive, worklist, visitedConstants);
+		}
+	}
+
+	/* Collect everything that is dead - declarations are only dead if nothing alive uses them */
+	std::vector<llvm::GlobalValue*> dead;
+	for(llvm::GlobalAlias& ga : module->aliases()) /* Aliases first, so their aliasees lose the use */
+		if(!alive.count(&ga))
+			dead.push_back(&ga);
+	for(llvm::Function& f : module->functions())
+		if(!alive.count(&f) && (!f.isDeclaration() || !f.getName().startswith("llvm.")))
+			dead.push_back(&f);
+	for(llvm::GlobalVariable& gv : module->globals())
+		if(!alive.count(&gv))
+			dead.push_back(&gv);
+
+	/*
+	 * Something the walk does not follow can still use a dead value. It stays untouched then, with everything it uses,
+	 * a value that lost its body or initializer but not its local linkage would be invalid.
+	 */
+	llvm::SmallPtrSet<const llvm::GlobalValue*, 32> erasable(dead.begin(), dead.end());
+	for(bool shrunk = true; shrunk; )
+	{
+		shrunk = false;
+		for(llvm::GlobalValue* value : dead)
+			if(erasable.count(value) && !OnlyUsedBy(value, erasable))
+				shrunk |= erasable.erase(value);
+	}
+
+	/* Drop references first, dead values can reference each other */
+	for(llvm::GlobalValue* value : dead)
+	{
+		if(!erasable.count(value))
+			continue;
+		if(auto* f = llvm::dyn_cast<llvm::Function>(value))
+			f->dropAllReferences();
+		else if(auto* gv = llvm::dyn_cast<llvm::GlobalVariable>(value))
+			gv->dropAllReferences();
+	}
+
+	bool changed = false;
+	for(llvm::GlobalValue* value : dead)
+	{
+		if(!erasable.count(value))
+			continue;
+		value->removeDeadConstantUsers();
+		value->eraseFromParent();
+		changed = true;
+	}
+
+	return changed;
+}
@@ -0,0 +1,19 @@
+
+#ifndef __MODULE_STRIPPING_H
+#define __MODULE_STRIPPING_H
+
+#include <llvm/IR/Module.h>
+
+#include <functional>
+
+/* Returns whether a global should stay visible outside of the module after driver insertion */
+bool IsFuzzRuntimeSymbol(const llvm::GlobalValue* value);
+
+/* Give internal linkage to every definition for which keep returns false */
+bool InternalizeModule(llvm::Module* module, const std::function<bool(const llvm::GlobalValue*)>& keep);
+
+/* Remove all internal functions, variables and aliases that can not be reached from an externally visible one */
+bool RemoveDeadGlobals(llvm::Module* module);
+
+
+#endif // __MODULE_STRIPPING_H
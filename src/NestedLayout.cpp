@@ -0,0 +1,178 @@
+
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+
+#include "Config.h"
+#include "FunctionStubs.h"
+#include "NestedLayout.h"
+#include "TypeHelper.h"
+
+/* Arrays inside of elements get their pointers decoded up to this many entries */
+static const uint64_t MaxExpandedArrayElements = 256;
+
+
+static bool ContainsPointer(llvm::Type* type)
+{
+	if(type->isPointerTy())
+		return true;
+	if(auto* structType = llvm::dyn_cast<llvm::StructType>(type))
+	{
+		for(llvm::Type* elemType : structType->elements())
+			if(ContainsPointer(elemType))
+				return true;
+		return false;
+	}
+	if(auto* arrayType = llvm::dyn_cast<llvm::ArrayType>(type))
+		return ContainsPointer(arrayType->getElementType());
+	return false;
+}
+
+
+namespace
+{
+
+struct NestedLayoutBuilder
+{
+	const llvm::DataLayout* dataLayout;
+	NestedLayout* layout;
+	std::map<llvm::Type*, NestedLayoutNode*> nodes;
+
+	NestedLayoutNode* GetNode(llvm::Type* type)
+	{
+		auto it = nodes.find(type);
+		if(it != nodes.end())
+			return it->second;
+
+		/* Register the node before collecting its fields, so self referencing types terminate */
+		layout->nodes.emplace_back(new NestedLayoutNode());
+		NestedLayoutNode* node = layout->nodes.back().get();
+		nodes[type] = node;
+
+		node->elementSize = GetTypeSize(dataLayout, type);
+		if(type->isSized())
+			CollectPointers(type, 0, node);
+		return node;
+	}
+
+	void CollectPointers(llvm::Type* type, uint64_t offset, NestedLayoutNode* node)
+	{
+		if(type->isPointerTy())
+		{
+			NestedField field;
+			field.offset = offset;
+			field.isFunction = type->getPointerElementType()->isFunctionTy();
+			field.functionType = field.isFunction ? llvm::cast<llvm::FunctionType>(type->getPointerElementType()) : nullptr;
+			field.pointee = field.isFunction ? nullptr : GetNode(type->getPointerElementType());
+			node->fields.push_back(field);
+		}
+		else if(auto* structType = llvm::dyn_cast<llvm::StructType>(type))
+		{
+			const llvm::StructLayout* structLayout = dataLayout->getStructLayout(structType);
+			for(unsigned i = 0; i < structType->getNumElements(); ++i)
+				if(ContainsPointer(structType->getElementType(i)))
+					CollectPointers(structType->getElementType(i), offset + structLayout->getElementOffset(i), node);
+		}
+		else if(auto* arrayType = llvm::dyn_cast<llvm::ArrayType>(type))
+		{
+			llvm::Type* elemType = arrayType->getElementType();
+			if(!ContainsPointer(elemType))
+				return;
+
+			uint64_t elemSize = dataLayout->getTypeAllocSize(elemType);
+			for(uint64_t i = 0; i < arrayType->getNumElements() && i < MaxExpandedArrayElements; ++i)
+				CollectPointers(elemType, offset + i * elemSize, node);
+		}
+	}
+};
+
+} /* Namespace */
+
+
+/* Returns nullptr if elements of elemType contain no pointers */
+std::shared_ptr<NestedLayout> GetNestedLayout(const llvm::DataLayout* dataLayout, llvm::Type* elemType)
+{
+	if(!ContainsPointer(elemType))
+		return nullptr;
+
+	std::shared_ptr<NestedLayout> layout = std::make_shared<NestedLayout>();
+	NestedLayoutBuilder builder;
+	builder.dataLayout = dataLayout;
+	builder.layout = layout.get();
+	layout->root = builder.GetNode(elemType);
+
+	if(layout->root->fields.empty())
+		return nullptr;
+	return layout;
+}
+
+
+/* Returns an internal function with the given type, that does nothing and returns null */
+llvm::Function* GetFunctionStub(llvm::Module* module, llvm::FunctionType* type)
+{
+	/* Reuse a stub of the same type */
+	for(llvm::Function& f : module->functions())
+		if(f.hasLocalLinkage() && f.getFunctionType() == type && f.getName().startswith(FUNCTION_PREFIX "stub"))
+			return &f;
+
+	llvm::Function* stub = llvm::Function::Create(type, llvm::GlobalValue::InternalLinkage, FUNCTION_PREFIX "stub", module);
+	AddNullBody(stub);
+	return stub;
+}
+
+
+/* Emit the layout as constant MackeFuzzerLayout, returns a pointer to its root */
+llvm::Constant* EmitNestedLayout(llvm::Module* module, const NestedLayout& layout)
+{
+	llvm::StructType* layoutType = GetNestedLayoutType(module);
+	llvm::StructType* fieldType = GetNestedFieldType(module);
+	llvm::Type* int64Type = GetInt64Type(module);
+
+	/* Create all globals first, fields may reference them in cycles */
+	std::map<const NestedLayoutNode*, llvm::GlobalVariable*> globals;
+	for(auto& node : layout.nodes)
+		globals[node.get()] = new llvm::GlobalVariable(*module, layoutType, true,
+				llvm::GlobalValue::PrivateLinkage, nullptr, FUNCTION_PREFIX "layout");
+
+	for(auto& node : layout.nodes)
+	{
+		std::vector<llvm::Constant*> fields;
+		for(const NestedField& field : node->fields)
+		{
+			llvm::Constant* pointee = field.isFunction ? llvm::Constant::getNullValue(layoutType->getPointerTo())
+			                                           : globals[field.pointee];
+			llvm::Constant* stub = field.isFunction ? llvm::ConstantExpr::getBitCast(GetFunctionStub(module, field.functionType), GetInt8PtrType(module))
+			                                        : llvm::Constant::getNullValue(GetInt8PtrType(module));
+			fields.push_back(llvm::ConstantStruct::get(fieldType,
+					llvm::ArrayRef<llvm::Constant*>(
+							std::vector<llvm::Constant*>(
+								{
+									llvm::ConstantInt::get(int64Type, field.offset),
+									llvm::ConstantInt::get(int64Type, field.isFunction ? MACKE_FUZZER_FIELD_FUNCTION : MACKE_FUZZER_FIELD_DATA),
+									pointee,
+									stub
+								}))));
+		}
+
+		llvm::Constant* fieldsPtr = llvm::Constant::getNullValue(fieldType->getPointerTo());
+		if(!fields.empty())
+		{
+			llvm::ArrayType* fieldsType = llvm::ArrayType::get(fieldType, fields.size());
+			llvm::GlobalVariable* fieldsGlobal = new llvm::GlobalVariable(*module, fieldsType, true,
+					llvm::GlobalValue::PrivateLinkage, llvm::ConstantArray::get(fieldsType, fields), FUNCTION_PREFIX "fields");
+			fieldsPtr = llvm::ConstantExpr::getBitCast(fieldsGlobal, fieldType->getPointerTo());
+		}
+
+		globals[node.get()]->setInitializer(llvm::ConstantStruct::get(layoutType,
+				llvm::ArrayRef<llvm::Constant*>(
+						std::vector<llvm::Constant*>(
+							{
+								llvm::ConstantInt::get(int64Type, node->elementSize),
+								llvm::ConstantInt::get(int64Type, node->fields.size()),
+								fieldsPtr
+							}))));
+	}
+
+	return globals[layout.root];
+}
@@ -0,0 +1,51 @@
+
+#ifndef __NESTED_LAYOUT_H
+#define __NESTED_LAYOUT_H
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Module.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "../helper_funcs/nested_decode.h"
+
+/**
+ * Where pointers are embedded in the elements of a decoded array.
+ * Mirrors MackeFuzzerLayout of the runtime, and is emitted as constant for it.
+ */
+
+struct NestedLayoutNode;
+
+struct NestedField
+{
+	uint64_t offset;
+	bool isFunction;
+	llvm::FunctionType* functionType; /* Function pointers */
+	const NestedLayoutNode* pointee;  /* Data pointers */
+};
+
+struct NestedLayoutNode
+{
+	uint64_t elementSize;
+	std::vector<NestedField> fields;
+};
+
+/* All nodes reachable from the layout of one argument, the graph may contain cycles */
+struct NestedLayout
+{
+	std::vector<std::unique_ptr<NestedLayoutNode>> nodes;
+	const NestedLayoutNode* root;
+};
+
+/* Returns nullptr if elements of elemType contain no pointers */
+std::shared_ptr<NestedLayout> GetNestedLayout(const llvm::DataLayout* dataLayout, llvm::Type* elemType);
+
+/* Returns an internal function with the given type, that does nothing and returns null */
+llvm::Function* GetFunctionStub(llvm::Module* module, llvm::FunctionType* type);
+
+/* Emit the layout as constant MackeFuzzerLayout, returns a pointer to its root */
+llvm::Constant* EmitNestedLayout(llvm::Module* module, const NestedLayout& layout);
+
+#endif // __NESTED_LAYOUT_H
@@ -0,0 +1,199 @@
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+/**
+ * Registers the passes with the new pass manager, so they can run in one pipeline and share cached analyses:
+ *     opt -load libMackeFuzzerOpt.so -load-pass-plugin libMackeFuzzerOpt.so \
+ *         -passes='renamemain,stub-externals,insert-fuzzdriver,loop-guard' in.bc -o out.bc
+ * -load is still needed, opt parses the options of the passes before it loads pass plugins.
+ * The fuzzable functions, the call graph and the loop info are computed once and reused until a pass changes the module.
+ */
+
+#if LLVM_VERSION_MAJOR >= 7
+
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+
+#include "FuzzabilityAnalysis.h"
+#include "Passes.h"
+
+namespace
+{
+
+static llvm::PreservedAnalyses GetPreserved(bool changed)
+{
+	return changed ? llvm::PreservedAnalyses::none() : llvm::PreservedAnalyses::all();
+}
+
+
+struct RenameMainPass : public llvm::PassInfoMixin<RenameMainPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&)
+	{
+		return GetPreserved(RunRenameMain(M));
+	}
+};
+
+
+struct AddEmptyFunctionPass : public llvm::PassInfoMixin<AddEmptyFunctionPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&)
+	{
+		return GetPreserved(RunAddEmptyFunction(M));
+	}
+};
+
+
+struct EnableAsanPass : public llvm::PassInfoMixin<EnableAsanPass>
+{
+	llvm::PreservedAnalyses run(llvm::Function& F, llvm::FunctionAnalysisManager&)
+	{
+		/* Only an attribute changes, the CFG and everything computed from it stays valid */
+		if(!RunEnableAsan(F))
+			return llvm::PreservedAnalyses::all();
+		llvm::PreservedAnalyses preserved;
+		preserved.preserveSet<llvm::CFGAnalyses>();
+		return preserved;
+	}
+};
+
+
+struct InsertFuzzDriverPass : public llvm::PassInfoMixin<InsertFuzzDriverPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager& MAM)
+	{
+		return GetPreserved(RunInsertFuzzDriver(M, MAM.getResult<FuzzabilityAnalysis>(M)));
+	}
+};
+
+
+struct KTestGeneratorPass : public llvm::PassInfoMixin<KTestGeneratorPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&)
+	{
+		RunKTestGenerator(M);
+		return llvm::PreservedAnalyses::all();
+	}
+};
+
+
+struct StubExternalsPass : public llvm::PassInfoMixin<StubExternalsPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&)
+	{
+		return GetPreserved(RunStubExternals(M));
+	}
+};
+
+
+struct LoopGuardPass : public llvm::PassInfoMixin<LoopGuardPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager& MAM)
+	{
+		llvm::FunctionAnalysisManager& FAM = MAM.getResult<llvm::FunctionAnalysisManagerModuleProxy>(M).getManager();
+		return GetPreserved(RunLoopGuard(M, [&FAM](llvm::Function& f) -> llvm::LoopInfo&
+			{
+				return FAM.getResult<llvm::LoopAnalysis>(f);
+			}));
+	}
+};
+
+
+struct DirectedDistancePass : public llvm::PassInfoMixin<DirectedDistancePass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager& MAM)
+	{
+		/* Instructions are only added inside existing blocks, the drivers gain calls to the runtime */
+		if(!RunDirectedDistance(M, MAM.getResult<llvm::CallGraphAnalysis>(M)))
+			return llvm::PreservedAnalyses::all();
+		/**
+		 * The call graph and the fuzzable functions are invalidated. The function analyses are only kept
+		 * through the proxy, which then invalidates everything per function except the CFG analyses.
+		 */
+		llvm::PreservedAnalyses preserved;
+		preserved.preserve<llvm::FunctionAnalysisManagerModuleProxy>();
+		preserved.preserveSet<llvm::CFGAnalyses>();
+		return preserved;
+	}
+};
+
+
+struct InterceptExitPass : public llvm::PassInfoMixin<InterceptExitPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&)
+	{
+		return GetPreserved(RunInterceptExit(M));
+	}
+};
+
+
+struct RankTargetsPass : public llvm::PassInfoMixin<RankTargetsPass>
+{
+	llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager& MAM)
+	{
+		RunRankTargets(M, MAM.getResult<FuzzabilityAnalysis>(M));
+		return llvm::PreservedAnalyses::all();
+	}
+};
+
+
+static bool ParseModulePass(llvm::StringRef name, llvm::ModulePassManager& MPM,
+		llvm::ArrayRef<llvm::PassBuilder::PipelineElement>)
+{
+	if(name == "renamemain")
+		MPM.addPass(RenameMainPass());
+	else if(name == "add-empty-function")
+		MPM.addPass(AddEmptyFunctionPass());
+	else if(name == "insert-fuzzdriver")
+		MPM.addPass(InsertFuzzDriverPass());
+	else if(name == "generate-ktest")
+		MPM.addPass(KTestGeneratorPass());
+	else if(name == "stub-externals")
+		MPM.addPass(StubExternalsPass());
+	else if(name == "loop-guard")
+		MPM.addPass(LoopGuardPass());
+	else if(name == "directed-distance")
+		MPM.addPass(DirectedDistancePass());
+	else if(name == "intercept-exit")
+		MPM.addPass(InterceptExitPass());
+	else if(name == "rank-targets")
+		MPM.addPass(RankTargetsPass());
+	else
+		return false;
+	return true;
+}
+
+
+static bool ParseFunctionPass(llvm::StringRef name, llvm::FunctionPassManager& FPM,
+		llvm::ArrayRef<llvm::PassBuilder::PipelineElement>)
+{
+	if(name != "enable-asan")
+		return false;
+	FPM.addPass(EnableAsanPass());
+	return true;
+}
+
+
+static void RegisterPasses(llvm::PassBuilder& PB)
+{
+	PB.registerAnalysisRegistrationCallback([](llvm::ModuleAnalysisManager& MAM)
+		{
+			MAM.registerPass([] { return FuzzabilityAnalysis(); });
+		});
+	PB.registerPipelineParsingCallback(ParseModulePass);
+	PB.registerPipelineParsingCallback(ParseFunctionPass);
+}
+
+} /* Namespace */
+
+
+extern "C" LLVM_ATTRIBUTE_WEAK llvm::PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+	return { LLVM_PLUGIN_API_VERSION, "MackeFuzzer", "1", RegisterPasses };
+}
+
+#endif
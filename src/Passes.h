@@ -0,0 +1,31 @@
+
+#ifndef __PASSES_H
+#define __PASSES_H
+
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+#include <functional>
+
+class FuzzabilityInfo;
+
+/**
+ * Bodies of the passes, shared by the legacy passes and the new pass manager plugin (PassPlugin.cpp).
+ * They read their options from the command line and return whether the module was changed.
+ */
+
+bool RunRenameMain(llvm::Module& M);
+bool RunAddEmptyFunction(llvm::Module& M);
+bool RunEnableAsan(llvm::Function& F);
+bool RunInsertFuzzDriver(llvm::Module& M, const FuzzabilityInfo& fuzzability);
+bool RunKTestGenerator(llvm::Module& M);
+bool RunStubExternals(llvm::Module& M);
+bool RunLoopGuard(llvm::Module& M, const std::function<llvm::LoopInfo&(llvm::Function&)>& getLoopInfo);
+bool RunDirectedDistance(llvm::Module& M, const llvm::CallGraph& callGraph);
+bool RunInterceptExit(llvm::Module& M);
+bool RunRankTargets(llvm::Module& M, const FuzzabilityInfo& fuzzability);
+
+
+#endif // __PASSES_H
@@ -5,6 +5,8 @@
 #include <llvm/Pass.h>
 #include <llvm/Support/CommandLine.h>
 
+#include "Passes.h"
+
 
 namespace {
 
@@ -19,10 +21,22 @@ struct RenameMain : public llvm::ModulePass
 
 	RenameMain() : llvm::ModulePass(ID) { };
 
-	bool runOnModule(llvm::Module& M) override;
+	bool runOnModule(llvm::Module& M) override { return RunRenameMain(M); }
 };
 
-bool RenameMain::runOnModule(llvm::Module& M)
+char RenameMain::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<RenameMain> X(
+	"renamemain", "Change the name of the main function",
+	false, /* Does not modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
+
+
+bool RunRenameMain(llvm::Module& M)
 {
 	std::string newName;
 	if(NewMainName.empty())
@@ -38,15 +52,3 @@ bool RenameMain::runOnModule(llvm::Module& M)
 	main->setName(newName);
 	return true; /* Tell llvm the module was modified */
 }
-
-char RenameMain::ID = 0; /* Value is ignored */
-
-/* Register the new pass */
-static llvm::RegisterPass<RenameMain> X(
-	"renamemain", "Change the name of the main function",
-	false, /* Does not modify CFG */
-	false  /* Is not only analysis */
-	);
-
-} /* Namespace */
-
@@ -0,0 +1,229 @@
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <fnmatch.h>
+
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "Config.h"
+#include "Diagnostics.h"
+#include "FunctionDeclarations.h"
+#include "FunctionStubs.h"
+#include "FuzzDriver.h"
+#include "ModuleStripping.h"
+#include "Passes.h"
+
+/**
+ * Bulk version of add-empty-function for slow or side effecting externals, like sleep, network or disk I/O.
+ * Matching functions either get a body that returns null,
+ * or are redirected to a fast model of the runtime (stub_models.c), like in-memory files for fopen.
+ */
+
+namespace
+{
+
+static llvm::cl::list<std::string> NullPatterns(
+	"stub-null",
+	llvm::cl::CommaSeparated,
+	llvm::cl::desc("Glob patterns of external functions that get a body returning null"));
+
+static llvm::cl::list<std::string> ModelPatterns(
+	"stub-model",
+	llvm::cl::CommaSeparated,
+	llvm::cl::desc("Glob patterns of external functions that are replaced by the models of the runtime, if one exists"));
+
+static llvm::cl::opt<std::string> StubConfig(
+	"stub-config",
+	llvm::cl::desc("File with 'null <glob>' and 'model <glob>' lines, the first matching line decides"));
+
+
+/* Functions stub_models.c has a model for */
+static bool HasModel(llvm::StringRef name)
+{
+	static const std::set<std::string> modelled = {
+		"fopen", "fopen64", "fclose", "remove", "unlink", "sleep", "usleep", "nanosleep"
+	};
+	return modelled.count(name.str()) != 0;
+}
+
+
+enum class StubKind
+{
+	None,
+	Null,
+	Model
+};
+
+struct StubRule
+{
+	StubKind kind;
+	std::string pattern;
+};
+
+
+/* Rules from the command line come first */
+static bool GetStubRules(std::vector<StubRule>& rules)
+{
+	for(const std::string& pattern : NullPatterns)
+		rules.push_back({StubKind::Null, pattern});
+	for(const std::string& pattern : ModelPatterns)
+		rules.push_back({StubKind::Model, pattern});
+
+	if(StubConfig.empty())
+		return true;
+
+	std::ifstream configFile(StubConfig);
+	if(!configFile)
+	{
+		Diagnostics() << "Error: stub config '" << StubConfig << "' can not be read.\n";
+		return false;
+	}
+
+	std::string line;
+	while(std::getline(configFile, line))
+	{
+		std::istringstream lineStream(line);
+		std::string kind, pattern;
+		if(!(lineStream >> kind) || kind[0] == '#')
+			continue;
+
+		if(!(lineStream >> pattern) || (kind != "null" && kind != "model"))
+		{
+			Diagnostics() << "Warning: ignoring malformed stub rule '" << line << "'.\n";
+			continue;
+		}
+		rules.push_back({kind == "null" ? StubKind::Null : StubKind::Model, pattern});
+	}
+	return true;
+}
+
+
+static StubKind GetStubKind(const std::vector<StubRule>& rules, llvm::StringRef name)
+{
+	for(const StubRule& rule : rules)
+		if(fnmatch(rule.pattern.c_str(), name.str().c_str(), 0) == 0)
+			return rule.kind;
+	return StubKind::None;
+}
+
+
+struct StubExternals : public llvm::ModulePass
+{
+	static char ID;
+
+	StubExternals() : llvm::ModulePass(ID) { };
+	bool runOnModule(llvm::Module& M) override { return RunStubExternals(M); }
+};
+
+} /* Namespace */
+
+
+bool RunStubExternals(llvm::Module& M)
+{
+	std::vector<StubRule> rules;
+	if(!GetStubRules(rules))
+		return false;
+
+	if(rules.empty())
+	{
+		Diagnostics() << "Error: -stub-null, -stub-model or -stub-config argument missing\n";
+		return false;
+	}
+
+	/* Collect first, redirected declarations are erased */
+	std::vector<std::pair<llvm::Function*, StubKind>> stubs;
+	for(llvm::Function& f : M.functions())
+	{
+		if(!f.isDeclaration() || f.isIntrinsic() || IsFuzzRuntimeSymbol(&f))
+			continue;
+
+		StubKind kind = GetStubKind(rules, f.getName());
+		/* Globs may match functions without a model, they stay untouched */
+		if(kind == StubKind::Model && !HasModel(f.getName()))
+			continue;
+		if(kind != StubKind::None)
+			stubs.push_back(std::make_pair(&f, kind));
+	}
+
+	/* The reset closes the streams the model tracks, a real fclose would leave it a closed one */
+	bool modelsFopen = false;
+	for(auto& stub : stubs)
+		if(stub.second == StubKind::Model)
+			modelsFopen |= stub.first->getName() == "fopen" || stub.first->getName() == "fopen64";
+	if(modelsFopen)
+	{
+		llvm::Function* fclose = M.getFunction("fclose");
+		bool known = false;
+		for(auto& stub : stubs)
+		{
+			if(stub.first != fclose)
+				continue;
+			stub.second = StubKind::Model;
+			known = true;
+		}
+		if(!known && fclose && fclose->isDeclaration())
+			stubs.push_back(std::make_pair(fclose, StubKind::Model));
+	}
+
+	size_t nullStubs = 0, models = 0;
+	for(auto& stub : stubs)
+	{
+		llvm::Function* f = stub.first;
+		if(stub.second == StubKind::Null)
+		{
+			AddNullBody(f);
+			++nullStubs;
+			continue;
+		}
+
+		std::string modelName = FUNCTION_PREFIX "model_" + f->getName().str();
+		llvm::Constant* model = M.getOrInsertFunction(modelName, f->getFunctionType());
+		f->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(model, f->getType()));
+		f->eraseFromParent();
+		++models;
+	}
+
+	/* Drivers generated before start their execs with a reset of the models, later ones do it themselves */
+	if(models)
+	{
+		llvm::Function* reset = declare_macke_fuzzer_stub_models_reset(&M);
+		for(llvm::Function& f : M.functions())
+		{
+			if(f.isDeclaration() || !IsFuzzDriver(&f))
+				continue;
+
+			bool hasReset = false;
+			for(const llvm::Instruction& inst : f.getEntryBlock())
+				if(auto* call = llvm::dyn_cast<llvm::CallInst>(&inst))
+					hasReset |= call->getCalledFunction() == reset;
+			if(!hasReset)
+				llvm::CallInst::Create(reset, "", &*f.getEntryBlock().getFirstInsertionPt());
+		}
+	}
+
+	Diagnostics() << "Stubbed " << nullStubs << " functions with null bodies and " << models << " with models\n";
+	return !stubs.empty();
+}
+
+
+namespace
+{
+
+char StubExternals::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<StubExternals> X(
+	"stub-externals", "Replace matching external functions by null returning bodies or fast runtime models",
+	false, /* Does modify CFG */
+	false  /* Is not only analysis */
+	);
+
+} /* Namespace */
@@ -0,0 +1,65 @@
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#if LLVM_VERSION_MAJOR >= 4
+#include <llvm/Transforms/Utils/FunctionComparator.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+#include "Diagnostics.h"
+#include "LayoutSchema.h"
+#include "TargetDedup.h"
+
+/**
+ * The structural hash and comparison of MergeFunctions find the equivalent code.
+ * Pins and length hints are given per function name, so the layout schema - without the function name - has to match as well.
+ */
+
+#if LLVM_VERSION_MAJOR >= 4
+/* Equal for functions that read their inputs the same way */
+static std::string GetInputFormat(const llvm::Function* function)
+{
+	std::string schema = GetLayoutSchema(function, &function->getParent()->getDataLayout());
+	size_t line = schema.find("\nfunction ");
+	if(line != std::string::npos)
+		schema.erase(line + 1, schema.find('\n', line + 1) - line);
+	return schema;
+}
+#endif
+
+
+std::vector<llvm::Function*> DeduplicateTargets(const std::vector<llvm::Function*>& targets, std::vector<TargetAlias>& aliases)
+{
+#if LLVM_VERSION_MAJOR < 4
+	(void)aliases;
+	Diagnostics() << "Warning: deduplicating targets needs llvm 4 or newer, every target gets its own driver.\n";
+	return targets;
+#else
+	/* Numbers the globals the functions use, so references to the same global compare equal */
+	llvm::GlobalNumberState globalNumbers;
+	std::map<std::pair<llvm::FunctionComparator::FunctionHash, std::string>, std::vector<llvm::Function*>> classes;
+	std::vector<llvm::Function*> unique;
+
+	for(llvm::Function* f : targets)
+	{
+		std::vector<llvm::Function*>& candidates = classes[std::make_pair(llvm::FunctionComparator::functionHash(*f), GetInputFormat(f))];
+		auto equivalent = std::find_if(candidates.begin(), candidates.end(), [f, &globalNumbers](llvm::Function* candidate)
+			{
+				return llvm::FunctionComparator(candidate, f, &globalNumbers).compare() == 0;
+			});
+
+		if(equivalent != candidates.end())
+		{
+			aliases.push_back({ f, *equivalent });
+			continue;
+		}
+		candidates.push_back(f);
+		unique.push_back(f);
+	}
+	return unique;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef __TARGET_DEDUP_H
+#define __TARGET_DEDUP_H
+
+#include <llvm/IR/Function.h>
+
+#include <vector>
+
+/**
+ * Libraries are full of targets that are the same code under another name: wrappers, template instances,
+ * accessors generated by macros. Fuzzing each of them separately only repeats the same work.
+ */
+struct TargetAlias
+{
+	llvm::Function* alias;
+	llvm::Function* target; /* Fuzzed in place of alias */
+};
+
+/**
+ * Returns one target of every class of equivalent targets, in the order of targets, and adds the others to aliases.
+ * Targets are equivalent if they compare equal like in MergeFunctions and their inputs have the same layout.
+ */
+std::vector<llvm::Function*> DeduplicateTargets(const std::vector<llvm::Function*>& targets, std::vector<TargetAlias>& aliases);
+
+
+#endif // __TARGET_DEDUP_H
@@ -0,0 +1,307 @@
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include "Compat.h"
+#include "Diagnostics.h"
+#include "FuzzabilityAnalysis.h"
+#include "Passes.h"
+#include "TargetRanking.h"
+
+/**
+ * Ranks the fuzzable functions by how much fuzzing they are likely worth:
+ * the code they reach, its branches and loops, the compares on input derived values and the memory accesses.
+ * The score adds up the logarithms of the metrics, so one huge function does not push all others to 0,
+ * compares on the input weigh most, they are what the fuzzer has to solve.
+ */
+
+namespace
+{
+
+static llvm::cl::opt<std::string> RankingOut(
+	"rank-targets-out",
+	llvm::cl::desc("Write the ranking of the fuzzable functions as CSV to this file instead of stderr"));
+
+
+/* What a function contributes on its own, computed once */
+struct FunctionMetrics
+{
+	uint64_t instructions = 0;
+	uint64_t cyclomatic = 0;
+	uint64_t memoryAccesses = 0;
+	unsigned loopDepth = 0;
+	/* Defined callees, with the loop depth of the call */
+	std::vector<std::pair<llvm::Function*, unsigned>> calls;
+};
+
+
+class TargetRanker
+{
+public:
+	TargetRank Rank(llvm::Function* target);
+
+private:
+	const FunctionMetrics& GetMetrics(llvm::Function* f);
+	unsigned GetLoopDepth(llvm::Function* f);
+	uint64_t CountInputCompares(llvm::Function* target);
+
+	std::map<const llvm::Function*, FunctionMetrics> metrics;
+	std::map<const llvm::Function*, unsigned> loopDepths;
+	std::set<const llvm::Function*> inProgress;
+};
+
+
+const FunctionMetrics& TargetRanker::GetMetrics(llvm::Function* f)
+{
+	auto known = metrics.find(f);
+	if(known != metrics.end())
+		return known->second;
+
+	FunctionMetrics& m = metrics[f];
+	llvm::DominatorTree domTree(*f);
+	llvm::LoopInfo loopInfo(domTree);
+
+	int64_t edges = 0;
+	for(llvm::BasicBlock& bb : *f)
+	{
+		edges += bb.getTerminator()->getNumSuccessors();
+		unsigned depth = loopInfo.getLoopDepth(&bb);
+		m.loopDepth = std::max(m.loopDepth, depth);
+
+		for(llvm::Instruction& inst : bb)
+		{
+			++m.instructions;
+			if(llvm::isa<llvm::LoadInst>(inst) || llvm::isa<llvm::StoreInst>(inst))
+				++m.memoryAccesses;
+
+			llvm::CallSite call(&inst);
+			if(!call)
+				continue;
+			llvm::Function* callee = llvm::dyn_cast<llvm::Function>(call.getCalledValue()->stripPointerCasts());
+			if(callee && !callee->isDeclaration())
+				m.calls.emplace_back(callee, depth);
+		}
+	}
+
+	/* Unreachable blocks can push it below 1 */
+	m.cyclomatic = std::max<int64_t>(1, edges - (int64_t)f->size() + 2);
+	return m;
+}
+
+
+/* Loops of callees nest into the loop the call is in */
+unsigned TargetRanker::GetLoopDepth(llvm::Function* f)
+{
+	auto known = loopDepths.find(f);
+	if(known != loopDepths.end())
+		return known->second;
+
+	/* Recursion adds no nesting we could count */
+	if(!inProgress.insert(f).second)
+		return 0;
+
+	const FunctionMetrics& m = GetMetrics(f);
+	unsigned depth = m.loopDepth;
+	for(const auto& call : m.calls)
+		depth = std::max(depth, call.second + GetLoopDepth(call.first));
+
+	inProgress.erase(f);
+	loopDepths[f] = depth;
+	return depth;
+}
+
+
+/**
+ * Follow the arguments of the target through its code and the code of its callees,
+ * count the compares and switches on anything derived from them.
+ * Stored values taint the memory they are stored to, found through the underlying object of the pointer.
+ */
+uint64_t TargetRanker::CountInputCompares(llvm::Function* target)
+{
+	const llvm::DataLayout& dataLayout = target->getParent()->getDataLayout();
+	std::set<const llvm::Value*> tainted;
+	std::vector<const llvm::Value*> worklist;
+	std::set<const llvm::Instruction*> compares;
+
+	auto taint = [&tainted, &worklist](const llvm::Value* value)
+		{
+			if(tainted.insert(value).second)
+				worklist.push_back(value);
+		};
+
+	for(llvm::Argument& arg : GetFunctionArgumentList(target))
+		taint(&arg);
+
+	while(!worklist.empty())
+	{
+		const llvm::Value* value = worklist.back();
+		worklist.pop_back();
+
+		for(const llvm::User* user : value->users())
+		{
+			const llvm::Instruction* inst = llvm::dyn_cast<llvm::Instruction>(user);
+			if(!inst)
+				continue;
+
+			if(llvm::isa<llvm::CmpInst>(inst) || llvm::isa<llvm::SwitchInst>(inst))
+				compares.insert(inst);
+			else if(const llvm::StoreInst* store = llvm::dyn_cast<llvm::StoreInst>(inst))
+			{
+				if(store->getValueOperand() == value)
+					taint(llvm::GetUnderlyingObject(store->getPointerOperand(), dataLayout));
+			}
+			else if(llvm::isa<llvm::CallInst>(inst) || llvm::isa<llvm::InvokeInst>(inst))
+			{
+				llvm::ImmutableCallSite call(inst);
+				const llvm::Function* callee = llvm::dyn_cast<llvm::Function>(call.getCalledValue()->stripPointerCasts());
+				if(callee && !callee->isDeclaration())
+				{
+					for(unsigned i = 0; i < call.arg_size() && i < callee->arg_size(); ++i)
+						if(call.getArgument(i) == value)
+							taint(&*std::next(callee->arg_begin(), i));
+				}
+
+				/* Results of calls on the input, like strlen, are input as well */
+				taint(inst);
+			}
+			else if(!inst->isTerminator())
+				taint(inst);
+		}
+	}
+	return compares.size();
+}
+
+
+TargetRank TargetRanker::Rank(llvm::Function* target)
+{
+	TargetRank rank = { target, 0, 0, 0, 0, 0, 0, 0 };
+
+	std::set<llvm::Function*> reachable = { target };
+	std::vector<llvm::Function*> worklist = { target };
+	while(!worklist.empty())
+	{
+		llvm::Function* f = worklist.back();
+		worklist.pop_back();
+
+		const FunctionMetrics& m = GetMetrics(f);
+		rank.instructions += m.instructions;
+		rank.cyclomatic += m.cyclomatic;
+		rank.memoryAccesses += m.memoryAccesses;
+		for(const auto& call : m.calls)
+			if(reachable.insert(call.first).second)
+				worklist.push_back(call.first);
+	}
+
+	rank.loopDepth = GetLoopDepth(target);
+	rank.inputCompares = CountInputCompares(target);
+	rank.score = std::log2(1.0 + rank.instructions)
+	           + 2 * std::log2(1.0 + rank.cyclomatic)
+	           + 2 * rank.loopDepth
+	           + 3 * std::log2(1.0 + rank.inputCompares)
+	           + std::log2(1.0 + rank.memoryAccesses);
+	return rank;
+}
+
+
+struct RankTargetsPass : public llvm::ModulePass
+{
+	static char ID;
+
+	RankTargetsPass() : llvm::ModulePass(ID) { };
+
+	void getAnalysisUsage(llvm::AnalysisUsage& AU) const override
+	{
+		AU.addRequired<FuzzabilityWrapperPass>();
+		AU.setPreservesAll();
+	}
+
+	bool runOnModule(llvm::Module& M) override
+	{
+		return RunRankTargets(M, getAnalysis<FuzzabilityWrapperPass>().GetInfo());
+	}
+};
+
+} /* Namespace */
+
+
+std::vector<TargetRank> RankTargets(const std::vector<llvm::Function*>& targets)
+{
+	TargetRanker ranker;
+	std::vector<TargetRank> ranking;
+	double total = 0;
+	for(llvm::Function* target : targets)
+	{
+		ranking.push_back(ranker.Rank(target));
+		total += ranking.back().score;
+	}
+
+	for(TargetRank& rank : ranking)
+		rank.weight = total > 0 ? rank.score / total : 1.0 / ranking.size();
+	return ranking;
+}
+
+
+void WriteTargetRanking(llvm::raw_ostream& os, std::vector<TargetRank> ranking)
+{
+	std::stable_sort(ranking.begin(), ranking.end(), [](const TargetRank& a, const TargetRank& b)
+		{
+			return a.weight > b.weight;
+		});
+
+	os << "function,weight,score,instructions,cyclomatic,loop_depth,input_compares,memory_accesses\n";
+	for(const TargetRank& rank : ranking)
+		os << rank.function->getName() << "," << llvm::format("%.6f", rank.weight) << "," << llvm::format("%.2f", rank.score)
+		   << "," << rank.instructions << "," << rank.cyclomatic << "," << rank.loopDepth
+		   << "," << rank.inputCompares << "," << rank.memoryAccesses << "\n";
+}
+
+
+bool RunRankTargets(llvm::Module& M, const FuzzabilityInfo& fuzzability)
+{
+	std::vector<TargetRank> ranking = RankTargets(fuzzability.GetFuzzableFunctions());
+	if(RankingOut.empty())
+	{
+		WriteTargetRanking(Diagnostics(), ranking);
+		return false;
+	}
+
+	std::error_code ec;
+	llvm::raw_fd_ostream out(RankingOut, ec, llvm::sys::fs::F_Text);
+	if(ec)
+	{
+		Diagnostics() << "Error: can not write '" << RankingOut << "': " << ec.message() << "\n";
+		return false;
+	}
+	WriteTargetRanking(out, ranking);
+	return false;
+}
+
+
+namespace
+{
+
+char RankTargetsPass::ID = 0; /* Value is ignored */
+
+/* Register the new pass */
+static llvm::RegisterPass<RankTargetsPass> X(
+	"rank-targets", "Rank the fuzzable functions by how much fuzzing they are likely worth",
+	true, /* Does not modify CFG */
+	true  /* Is only analysis */
+	);
+
+} /* Namespace */
@@ -0,0 +1,32 @@
+#ifndef __TARGET_RANKING_H
+#define __TARGET_RANKING_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <vector>
+
+/**
+ * Static estimate of how much fuzzing a target is worth, so a campaign can give most cores to the parsers
+ * instead of the getters. The metrics cover everything the target reaches through direct calls.
+ */
+struct TargetRank
+{
+	llvm::Function* function;
+	uint64_t instructions;
+	uint64_t cyclomatic;     /* Sum of edges - blocks + 2 over the functions */
+	unsigned loopDepth;      /* Deepest loop nesting, counted across calls */
+	uint64_t inputCompares;  /* Compares and switches on values derived from the arguments */
+	uint64_t memoryAccesses; /* Loads and stores */
+	double score;
+	double weight;           /* Share of the score of all targets, the weights add up to 1 */
+};
+
+/* In the order of targets */
+std::vector<TargetRank> RankTargets(const std::vector<llvm::Function*>& targets);
+
+/* CSV with one line per target, highest weight first */
+void WriteTargetRanking(llvm::raw_ostream& os, std::vector<TargetRank> ranking);
+
+
+#endif // __TARGET_RANKING_H
@@ -1,6 +1,7 @@
 
 #include <llvm/ADT/Triple.h>
 
+#include "Config.h"
 #include "TypeHelper.h"
 
 llvm::Type* GetSizeType(llvm::Module* module)
@@ -9,6 +10,11 @@ llvm::Type* GetSizeType(llvm::Module* module)
 	                                                             : llvm::Type::getInt32Ty(module->getContext());
 }
 
+llvm::Type* GetInt64Type(llvm::Module* module)
+{
+	return llvm::Type::getInt64Ty(module->getContext());
+}
+
 llvm::Type* GetInt32Type(llvm::Module* module)
 {
 	return llvm::Type::getInt32Ty(module->getContext());
@@ -26,6 +32,9 @@ llvm::Type* GetInt8PtrType(llvm::Module* module)
 
 size_t GetTypeSize(const llvm::DataLayout* layout, llvm::Type* type)
 {
+	/* Opaque structs and functions are treated as chars, too */
+	if(!type->isSized())
+		return 1;
 	size_t dlSize = layout->getTypeAllocSize(type);
 	/* Void* will be treated as char* */
 	if(dlSize == 0)
@@ -33,6 +42,38 @@ size_t GetTypeSize(const llvm::DataLayout* layout, llvm::Type* type)
 	return dlSize;
 }
 
+llvm::StructType* GetNestedLayoutType(llvm::Module* module)
+{
+	/* Named types are unique in the context, create them once */
+	llvm::StructType* layoutType = module->getTypeByName(FUNCTION_PREFIX "layout");
+	if(layoutType)
+		return layoutType;
+
+	llvm::LLVMContext& ctx = module->getContext();
+	layoutType = llvm::StructType::create(ctx, FUNCTION_PREFIX "layout");
+	llvm::StructType* fieldType = llvm::StructType::create(ctx, FUNCTION_PREFIX "field");
+
+	/* Matches MackeFuzzerField and MackeFuzzerLayout of nested_decode.h */
+	fieldType->setBody(llvm::ArrayRef<llvm::Type*>(std::vector<llvm::Type*>(
+			{GetInt64Type(module), GetInt64Type(module), layoutType->getPointerTo(), GetInt8PtrType(module)})));
+	layoutType->setBody(llvm::ArrayRef<llvm::Type*>(std::vector<llvm::Type*>(
+			{GetInt64Type(module), GetInt64Type(module), fieldType->getPointerTo()})));
+	return layoutType;
+}
+
+llvm::StructType* GetNestedFieldType(llvm::Module* module)
+{
+	GetNestedLayoutType(module);
+	return module->getTypeByName(FUNCTION_PREFIX "field");
+}
+
+llvm::StructType* GetAllocListType(llvm::Module* module)
+{
+	/* Matches MackeFuzzerAllocList of nested_decode.h */
+	return llvm::StructType::get(module->getContext(), llvm::ArrayRef<llvm::Type*>(std::vector<llvm::Type*>(
+			{GetInt8PtrType(module), GetInt8PtrType(module), GetSizeType(module), GetSizeType(module)})));
+}
+
 llvm::FunctionType* GetFuzzDriverType(llvm::Module* module)
 {
 	/**
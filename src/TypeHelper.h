@@ -6,12 +6,17 @@
 #include <llvm/IR/IRBuilder.h>
 
 llvm::Type* GetSizeType(llvm::Module* module);
+llvm::Type* GetInt64Type(llvm::Module* module);
 llvm::Type* GetInt32Type(llvm::Module* module);
 llvm::Type* GetInt8Type(llvm::Module* module);
 llvm::Type* GetInt8PtrType(llvm::Module* module);
 
 size_t GetTypeSize(const llvm::DataLayout* layout, llvm::Type* type);
 
+llvm::StructType* GetNestedLayoutType(llvm::Module* module);
+llvm::StructType* GetNestedFieldType(llvm::Module* module);
+llvm::StructType* GetAllocListType(llvm::Module* module);
+
 llvm::FunctionType* GetFuzzDriverType(llvm::Module* module);
 llvm::FunctionType* GetFuzzInputGeneratorType(llvm::Module* module);
 
@@ -0,0 +1,93 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../helper_funcs/nested_decode.h"
+
+/**
+ * Runs a body shaped like the ones GuardFuzzDriver builds: a char** argument with its nested allocation
+ * list in the storage of the guard, every buffer registered as cleanup, and a target that exits.
+ * Built with -fsanitize=address, leak detection fails the test if the guard does not free everything,
+ * and a list read from the dead stack of the body is reported as well.
+ */
+
+/* From exit_guard.c */
+int macke_fuzzer_exit_guard(int (*body)(const uint8_t*, size_t), const uint8_t* data, size_t size);
+void macke_fuzzer_exit_guard_cleanup(void (*cleanup)(void*), void* arg);
+void* macke_fuzzer_exit_guard_storage(size_t size);
+int macke_fuzzer_exit_status(int* status);
+uint64_t macke_fuzzer_exit_count(void);
+void macke_fuzzer_exit(int status);
+
+/* From buffer_extract.c */
+size_t macke_fuzzer_array_byte_size(const uint8_t* src, size_t max);
+const uint8_t* macke_fuzzer_array_extract(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen);
+
+#define DELIMITER "\xFA" /* DELIMITER_CHAR of Config.h */
+
+static const MackeFuzzerLayout charLayout = { 1, 0, NULL };
+static const MackeFuzzerField stringField = { 0, MACKE_FUZZER_FIELD_DATA, &charLayout, NULL };
+static const MackeFuzzerLayout stringsLayout = { sizeof(char*), 1, &stringField };
+
+
+/* Exits on inputs whose first string starts with E */
+__attribute__((noinline)) static void Target(char** strings, size_t count)
+{
+	if(count && strings[0][0] == 'E')
+		macke_fuzzer_exit(3);
+}
+
+
+static int Body(const uint8_t* data, size_t size)
+{
+	MackeFuzzerAllocList* allocs = macke_fuzzer_exit_guard_storage(sizeof(MackeFuzzerAllocList));
+	macke_fuzzer_exit_guard_cleanup((void (*)(void*))macke_fuzzer_free_allocs, allocs);
+
+	size_t elements = macke_fuzzer_array_byte_size(data, size) / sizeof(char*);
+	char** strings = malloc(elements * sizeof(char*));
+	macke_fuzzer_exit_guard_cleanup(free, strings);
+
+	const uint8_t* next = macke_fuzzer_array_extract(data, size, (uint8_t*)strings, elements * sizeof(char*));
+	macke_fuzzer_decode_nested(next, size - (next - data), (uint8_t*)strings, elements, &stringsLayout, 4, allocs);
+
+	Target(strings, elements);
+
+	free(strings);
+	macke_fuzzer_free_allocs(allocs);
+	return 0;
+}
+
+
+static int Run(const char* input, int expectExit)
+{
+	int status = 0;
+	macke_fuzzer_exit_guard(Body, (const uint8_t*)input, strlen(input));
+	if(macke_fuzzer_exit_status(&status) != expectExit || (expectExit && status != 3))
+	{
+		fprintf(stderr, "FAIL: '%s' %s\n", input, expectExit ? "did not exit" : "exited");
+		return 1;
+	}
+	return 0;
+}
+
+
+int main(void)
+{
+	int failed = 0;
+	for(int i = 0; i < 100; ++i)
+	{
+		/* Two pointers, then the delimited strings they point to */
+		failed |= Run("0123456789abcdef" DELIMITER "Exit" DELIMITER "second" DELIMITER, 1);
+		failed |= Run("0123456789abcdef" DELIMITER "keep" DELIMITER "going" DELIMITER, 0);
+	}
+	if(macke_fuzzer_exit_count() != 100)
+	{
+		fprintf(stderr, "FAIL: %llu exits intercepted\n", (unsigned long long)macke_fuzzer_exit_count());
+		failed = 1;
+	}
+	if(!failed)
+		printf("exit guard: ok\n");
+	return failed;
+}
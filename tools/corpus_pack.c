@@ -0,0 +1,166 @@
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../helper_funcs/corpus_pack.h"
+
+/**
+ * Converts between packed corpora and the plain directories libFuzzer and afl work on.
+ */
+
+static void Usage(char** argv)
+{
+	printf("Usage: %s import <dir> <out.pack>\n"
+	       "       %s export <in.pack> <dir>\n"
+	       "       %s list <in.pack>\n", argv[0], argv[0], argv[0]);
+	exit(1);
+}
+
+
+static int Import(const char* dir, const char* packPath)
+{
+	DIR* d = opendir(dir);
+	if(!d)
+	{
+		printf("Failed to open directory '%s': %m\n", dir);
+		return 1;
+	}
+
+	MackeFuzzerPackWriter writer;
+	if(macke_fuzzer_pack_writer_open(&writer, packPath) != 0)
+	{
+		printf("Failed to open '%s': %m\n", packPath);
+		return 1;
+	}
+
+	size_t imported = 0;
+	struct dirent* ent;
+	while((ent = readdir(d)))
+	{
+		if(ent->d_name[0] == '.')
+			continue;
+
+		int fd = openat(dirfd(d), ent->d_name, O_RDONLY);
+		if(fd < 0)
+			continue;
+
+		struct stat st;
+		if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			continue;
+		}
+
+		const void* data = "";
+		if(st.st_size > 0)
+			data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(data == MAP_FAILED)
+		{
+			printf("Failed to map '%s': %m\n", ent->d_name);
+			continue;
+		}
+
+		if(macke_fuzzer_pack_append(&writer, data, st.st_size) != 0)
+		{
+			printf("Failed to append '%s': %m\n", ent->d_name);
+			return 1;
+		}
+		if(st.st_size > 0)
+			munmap((void*)data, st.st_size);
+		++imported;
+	}
+	closedir(d);
+	macke_fuzzer_pack_writer_close(&writer);
+
+	printf("Imported %lu inputs\n", imported);
+	return 0;
+}
+
+
+static int Export(const char* packPath, const char* dir)
+{
+	MackeFuzzerPack pack;
+	if(macke_fuzzer_pack_open(&pack, packPath) != 0)
+	{
+		printf("'%s' is no packed corpus\n", packPath);
+		return 1;
+	}
+
+	int dirfd = open(dir, O_DIRECTORY);
+	if(dirfd < 0)
+	{
+		printf("Failed to open directory '%s': %m\n", dir);
+		return 1;
+	}
+
+	char nameBuf[64];
+	for(size_t i = 0; i < pack.count; ++i)
+	{
+		size_t len;
+		const uint8_t* data = macke_fuzzer_pack_get(&pack, i, &len);
+		if(!data)
+			continue;
+
+		snprintf(nameBuf, sizeof(nameBuf), "input_%lu", i);
+		int fd = openat(dirfd, nameBuf, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if(fd < 0)
+		{
+			printf("Couldn't create file '%s': %m\n", nameBuf);
+			return 1;
+		}
+		while(len > 0)
+		{
+			ssize_t ret = write(fd, data, len);
+			if(ret < 0)
+			{
+				printf("Write failed with error: %m\n");
+				return 1;
+			}
+			data += ret;
+			len -= ret;
+		}
+		close(fd);
+	}
+	close(dirfd);
+
+	printf("Exported %lu inputs\n", pack.count);
+	macke_fuzzer_pack_close(&pack);
+	return 0;
+}
+
+
+static int List(const char* packPath)
+{
+	MackeFuzzerPack pack;
+	if(macke_fuzzer_pack_open(&pack, packPath) != 0)
+	{
+		printf("'%s' is no packed corpus\n", packPath);
+		return 1;
+	}
+
+	for(size_t i = 0; i < pack.count; ++i)
+		printf("%lu %llu %llu\n", i, (unsigned long long)pack.index[i].offset, (unsigned long long)pack.index[i].length);
+
+	macke_fuzzer_pack_close(&pack);
+	return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	if(argc == 4 && strcmp(argv[1], "import") == 0)
+		return Import(argv[2], argv[3]);
+	if(argc == 4 && strcmp(argv[1], "export") == 0)
+		return Export(argv[2], argv[3]);
+	if(argc == 3 && strcmp(argv[1], "list") == 0)
+		return List(argv[2]);
+	Usage(argv);
+	return 1;
+}
@@ -0,0 +1,245 @@
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/InitializePasses.h>
+#include <llvm/Pass.h>
+#include <llvm/PassRegistry.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/Compat.h"
+#include "../src/Diagnostics.h"
+
+/**
+ * Runs the preparation passes over many bitcode files in one process.
+ * Every file gets its own LLVMContext on one of the worker threads, the result is the same as
+ *     opt -load libMackeFuzzerOpt.so -renamemain -insert-fuzzdriver [-enable-asan -asan -asan-module]
+ * All options of the passes, like -fuzz-strip-unreachable, are accepted as well.
+ * A file that can not be prepared is reported and skipped, the others are still written.
+ */
+
+static llvm::cl::list<std::string> InputFiles(
+	llvm::cl::Positional,
+	llvm::cl::OneOrMore,
+	llvm::cl::desc("<input bitcode files>"));
+
+static llvm::cl::opt<std::string> OutputDir(
+	"o",
+	llvm::cl::Required,
+	llvm::cl::desc("Directory the prepared modules are written to, under the name of their input"));
+
+static llvm::cl::opt<unsigned> Jobs(
+	"j",
+	llvm::cl::desc("Number of worker threads (defaults to the number of cores)"),
+	llvm::cl::init(0));
+
+static llvm::cl::opt<bool> WithAsan(
+	"with-asan",
+	llvm::cl::desc("Also enable and insert the address sanitizer instrumentation"),
+	llvm::cl::init(false));
+
+
+static llvm::cl::opt<bool> DualBuild(
+	"dual-build",
+	llvm::cl::desc("Write <name>.fast.bc without and <name>.asan.bc with the address sanitizer, "
+	               "both with the same drivers, to fuzz the fast one and replay its inputs on the other"),
+	llvm::cl::init(false));
+
+
+/* Serializes what the workers print, the passes report to a buffer per file */
+static std::mutex outputMutex;
+
+
+/* The pipelines, by the names the passes are registered with in opt */
+static const std::vector<std::string> DriverPipeline = {"renamemain", "insert-fuzzdriver"};
+static const std::vector<std::string> AsanPipeline = {"enable-asan", "asan", "asan-module"};
+
+
+static bool RunPipeline(llvm::Module* module, const std::vector<std::string>& pipeline)
+{
+	llvm::legacy::PassManager passManager;
+	for(const std::string& name : pipeline)
+	{
+		const llvm::PassInfo* info = llvm::PassRegistry::getPassRegistry()->getPassInfo(name);
+		if(!info || !info->getNormalCtor())
+		{
+			Diagnostics() << "Error: pass " << name << " is not available.\n";
+			return false;
+		}
+		passManager.add(info->createPass());
+	}
+	passManager.run(*module);
+	return true;
+}
+
+
+/* Unlike the verifier pass, which aborts the process, this only fails the file */
+static bool VerifyModule(const llvm::Module* module, const std::string& inputPath, const char* when)
+{
+	llvm::raw_ostream& out = Diagnostics();
+	if(!llvm::verifyModule(*module, &out))
+		return true;
+	out << "Error: " << inputPath << " is not a valid module " << when << ".\n";
+	return false;
+}
+
+
+static bool WriteOutput(const llvm::Module* module, const std::string& outputPath)
+{
+	std::error_code ec;
+	llvm::raw_fd_ostream out(outputPath, ec, llvm::sys::fs::F_None);
+	if(ec)
+	{
+		Diagnostics() << "Error: can not write '" << outputPath << "': " << ec.message() << "\n";
+		return false;
+	}
+	WriteModuleBitcode(module, out);
+	return true;
+}
+
+
+/* Names of the files written for an input, in OutputDir */
+static std::vector<std::string> OutputNames(const std::string& inputPath)
+{
+	if(!DualBuild)
+		return { llvm::sys::path::filename(inputPath).str() };
+
+	std::string stem = llvm::sys::path::stem(inputPath).str();
+	return { stem + ".fast.bc", stem + ".asan.bc" };
+}
+
+
+static bool PrepareFile(const std::string& inputPath)
+{
+	llvm::LLVMContext context;
+	llvm::SMDiagnostic err;
+
+	std::unique_ptr<llvm::Module> module = llvm::parseIRFile(inputPath, err, context);
+	if(!module)
+	{
+		err.print("macke-fuzzer-prep", Diagnostics());
+		return false;
+	}
+
+	if(!VerifyModule(module.get(), inputPath, "as input"))
+		return false;
+
+	if(!RunPipeline(module.get(), DriverPipeline) || !VerifyModule(module.get(), inputPath, "after inserting the drivers"))
+		return false;
+
+	std::vector<std::string> outputs = OutputNames(inputPath);
+	if(!DualBuild)
+	{
+		if(WithAsan && (!RunPipeline(module.get(), AsanPipeline)
+				|| !VerifyModule(module.get(), inputPath, "after the asan instrumentation")))
+			return false;
+		return WriteOutput(module.get(), OutputDir + "/" + outputs[0]);
+	}
+
+	/* The drivers are inserted once, so both builds share the descriptor table and the layout hash */
+	if(!WriteOutput(module.get(), OutputDir + "/" + outputs[0]))
+		return false;
+	return RunPipeline(module.get(), AsanPipeline)
+		&& VerifyModule(module.get(), inputPath, "after the asan instrumentation")
+		&& WriteOutput(module.get(), OutputDir + "/" + outputs[1]);
+}
+
+
+/* Prepares a file on a worker thread, everything reported for it is printed in one piece */
+static bool PrepareFileReported(const std::string& inputPath)
+{
+	std::string report;
+	llvm::raw_string_ostream reportStream(report);
+	RedirectDiagnostics(&reportStream);
+	bool prepared = PrepareFile(inputPath);
+	RedirectDiagnostics(nullptr);
+
+	reportStream.flush();
+	if(!report.empty())
+	{
+		std::lock_guard<std::mutex> lock(outputMutex);
+		llvm::errs() << report;
+	}
+	return prepared;
+}
+
+
+int main(int argc, char** argv)
+{
+	/* Analyses and the sanitizer passes are looked up by name like our own passes */
+	llvm::PassRegistry& registry = *llvm::PassRegistry::getPassRegistry();
+	llvm::initializeCore(registry);
+	llvm::initializeAnalysis(registry);
+	llvm::initializeTransformUtils(registry);
+	llvm::initializeInstrumentation(registry);
+
+	llvm::cl::ParseCommandLineOptions(argc, argv, "Prepare bitcode files for fuzzing\n");
+
+	if(DualBuild && WithAsan)
+	{
+		llvm::errs() << "Error: -dual-build already writes an asan build, -with-asan is not needed\n";
+		return 1;
+	}
+
+	/* Inputs from different directories may share their name, none of them may overwrite another */
+	std::map<std::string, std::string> writtenBy;
+	bool collision = false;
+	for(const std::string& inputPath : InputFiles)
+	{
+		for(const std::string& output : OutputNames(inputPath))
+		{
+			auto inserted = writtenBy.insert(std::make_pair(output, inputPath));
+			if(!inserted.second)
+			{
+				llvm::errs() << "Error: '" << inserted.first->second << "' and '" << inputPath
+				             << "' would both be written to '" << OutputDir << "/" << output << "'\n";
+				collision = true;
+			}
+		}
+	}
+	if(collision)
+		return 1;
+
+	if(std::error_code ec = llvm::sys::fs::create_directories(OutputDir))
+	{
+		llvm::errs() << "Error: can not create '" << OutputDir << "': " << ec.message() << "\n";
+		return 1;
+	}
+
+	unsigned jobs = Jobs;
+	if(jobs == 0)
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+
+	/* The workers take the next file until all are done */
+	std::atomic<size_t> nextFile(0);
+	std::atomic<size_t> failed(0);
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < jobs && i < InputFiles.size(); ++i)
+	{
+		workers.emplace_back([&]()
+			{
+				size_t file;
+				while((file = nextFile++) < InputFiles.size())
+					if(!PrepareFileReported(InputFiles[file]))
+						++failed;
+			});
+	}
+	for(std::thread& worker : workers)
+		worker.join();
+
+	llvm::errs() << "Prepared " << InputFiles.size() - failed << " of " << InputFiles.size() << " files\n";
+	return failed ? 1 : 0;
+}
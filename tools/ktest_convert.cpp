@@ -0,0 +1,167 @@
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../helper_funcs/corpus_pack.h"
+#include "../helper_funcs/layout_schema.h"
+
+/**
+ * Converts fuzzer inputs into ktest files with nothing but the layout schema of the driver,
+ * the same result as the ktest-generator pass without loading the module into opt.
+ * The ktest files are written directly in version 3 of the format klee reads.
+ */
+
+static void Usage(char** argv)
+{
+	printf("Usage: %s [--klee-arg=<arg>]... <schema> <input file> <out.ktest>\n"
+	       "       %s [--klee-arg=<arg>]... <schema> <input dir or .pack> <out dir>\n"
+	       "The schema is a .layout file written with -fuzz-layout-dir,\n"
+	       "or the output of a fuzzer run with --print-layout=<function>\n", argv[0], argv[0]);
+	exit(1);
+}
+
+
+static bool Convert(const MackeFuzzerSchema& schema, std::vector<char*>& kleeArgs,
+		const uint8_t* data, size_t size, const std::string& outPath)
+{
+	MackeFuzzerObjects objects;
+	macke_fuzzer_schema_decode(&schema, data, size, &objects);
+	bool ret = macke_fuzzer_objects_write_ktest(&objects, outPath.c_str(), kleeArgs.size(), kleeArgs.data()) == 0;
+	macke_fuzzer_objects_free(&objects);
+
+	if(!ret)
+		printf("Failed to write '%s'\n", outPath.c_str());
+	return ret;
+}
+
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& content)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return false;
+	content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+
+static bool IsDirectory(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+int main(int argc, char** argv)
+{
+	std::vector<char*> kleeArgs;
+	std::vector<std::string> positional;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strncmp(argv[i], "--klee-arg=", 11) == 0)
+			kleeArgs.push_back(argv[i] + 11);
+		else if(argv[i][0] == '-' && argv[i][1] != 0)
+			Usage(argv);
+		else
+			positional.push_back(argv[i]);
+	}
+
+	if(positional.size() != 3)
+		Usage(argv);
+
+	const std::string& inputPath = positional[1];
+	const std::string& outPath = positional[2];
+
+	MackeFuzzerSchema schema;
+	if(macke_fuzzer_schema_load(&schema, positional[0].c_str()) != 0)
+	{
+		printf("Failed to load the layout schema '%s'\n", positional[0].c_str());
+		return 1;
+	}
+
+	size_t converted = 0, failed = 0;
+
+	/* Every entry of a packed corpus becomes input_<index>.ktest */
+	if(macke_fuzzer_pack_is_pack(inputPath.c_str()))
+	{
+		MackeFuzzerPack pack;
+		if(macke_fuzzer_pack_open(&pack, inputPath.c_str()) != 0)
+		{
+			printf("Failed to open '%s'\n", inputPath.c_str());
+			macke_fuzzer_schema_free(&schema);
+			return 1;
+		}
+
+		for(size_t i = 0; i < pack.count; ++i)
+		{
+			size_t len;
+			const uint8_t* data = macke_fuzzer_pack_get(&pack, i, &len);
+			if(data && Convert(schema, kleeArgs, data, len, outPath + "/input_" + std::to_string(i) + ".ktest"))
+				++converted;
+			else
+				++failed;
+		}
+		macke_fuzzer_pack_close(&pack);
+	}
+	/* Every file of a corpus directory becomes <name>.ktest */
+	else if(IsDirectory(inputPath))
+	{
+		DIR* d = opendir(inputPath.c_str());
+		if(!d)
+		{
+			printf("Failed to open directory '%s'\n", inputPath.c_str());
+			macke_fuzzer_schema_free(&schema);
+			return 1;
+		}
+
+		struct dirent* ent;
+		while((ent = readdir(d)))
+		{
+			if(ent->d_name[0] == '.')
+				continue;
+
+			std::vector<uint8_t> content;
+			std::string path = inputPath + "/" + ent->d_name;
+			if(IsDirectory(path) || !ReadFile(path, content))
+				continue;
+
+			if(Convert(schema, kleeArgs, content.data(), content.size(), outPath + "/" + ent->d_name + ".ktest"))
+				++converted;
+			else
+				++failed;
+		}
+		closedir(d);
+	}
+	else
+	{
+		std::vector<uint8_t> content;
+		if(!ReadFile(inputPath, content))
+		{
+			printf("Failed to read '%s'\n", inputPath.c_str());
+			macke_fuzzer_schema_free(&schema);
+			return 1;
+		}
+
+		if(Convert(schema, kleeArgs, content.data(), content.size(), outPath))
+			++converted;
+		else
+			++failed;
+	}
+
+	printf("Converted %zu inputs of %s", converted, schema.function);
+	if(failed)
+		printf(", %zu failed", failed);
+	printf("\n");
+
+	macke_fuzzer_schema_free(&schema);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,581 @@
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../helper_funcs/layout_schema.h"
+
+/**
+ * Hands the inputs of running fuzzers over to klee while the campaign runs.
+ * The queue directories are watched with inotify, new inputs are deduplicated by the hash of their content
+ * and converted with the layout schema of their function into <seed dir>/<function>/<hash>.ktest.
+ * Conversion runs in bounded batches.
+ * klee only reads its seed dirs and never removes a seed, so the daemon can not tell which seeds were used.
+ * With --max-seeds, whoever starts klee has to move the seeds it handed to klee out of the seed dir:
+ * a function pauses while its seed dir is full and its queues are rescanned once the orchestrator made room again.
+ */
+
+#define SYNC_INDEX_NAME ".macke-sync-index"
+
+struct SyncOptions
+{
+	size_t batchSize = 64;
+	unsigned batchDelayMs = 1000;
+	size_t maxPending = 10000;
+	size_t maxSeeds = 0; /* No limit */
+	bool allInputs = false;
+	std::vector<char*> kleeArgs;
+};
+
+/* One function klee gets seeds for */
+struct SyncTarget
+{
+	std::string function;
+	MackeFuzzerSchema schema;
+	std::string outDir;
+	std::unordered_set<uint64_t> hashes;
+	size_t seedCount = 0;
+	bool paused = false;
+};
+
+/* One watched queue directory of a fuzzer */
+struct SyncQueue
+{
+	std::string dir;
+	SyncTarget* target;
+	int watch = -1;
+	bool needsRescan = true;
+	std::unordered_set<std::string> seen;
+};
+
+struct PendingInput
+{
+	SyncQueue* queue;
+	std::string name;
+};
+
+struct SyncStats
+{
+	size_t synced = 0;
+	size_t duplicates = 0;
+	size_t filtered = 0;
+	size_t failed = 0;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+
+static void Usage(char** argv)
+{
+	printf("Usage: %s [options] <schema dir> <seed dir> <queue dir>:<function>...\n"
+	       "Options:\n"
+	       "  --batch=<n>          Convert at most n inputs at once (default 64)\n"
+	       "  --batch-delay=<ms>   Wait at most ms for a batch to fill (default 1000)\n"
+	       "  --max-pending=<n>    Inputs kept in memory before the queues are rescanned later (default 10000)\n"
+	       "  --max-seeds=<n>      Pause a function while its seed dir holds n ktests (default 0, no limit).\n"
+	       "                       klee never removes seeds, consumed ones have to be moved out of the seed dir\n"
+	       "  --all-inputs         Also sync afl inputs that only changed hit counts\n"
+	       "  --klee-arg=<arg>     Argument stored in the ktest files, can be repeated\n"
+	       "The schema dir holds the <function>.layout files written with -fuzz-layout-dir.\n", argv[0]);
+	exit(1);
+}
+
+
+static void StopHandler(int sig)
+{
+	(void)sig;
+	stopRequested = 1;
+}
+
+
+static uint64_t NowMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* FNV-1a, like the stack hashes of the reproducer */
+static uint64_t HashContent(const std::vector<uint8_t>& content)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(uint8_t byte : content)
+	{
+		hash ^= byte;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& content)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return false;
+	content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+
+static bool ParseNumber(const char* arg, size_t& value)
+{
+	char* end;
+	errno = 0;
+	value = strtoull(arg, &end, 10);
+	return !errno && *arg && !*end;
+}
+
+
+/**
+ * afl names every queue entry, entries that found new edges end with +cov.
+ * Other entries only changed hit counts and add little for klee. libFuzzer corpora only hold
+ * coverage increasing inputs, so their hash named files all pass.
+ */
+static bool IsCoverageIncreasing(const std::string& name)
+{
+	if(name.compare(0, 3, "id:") != 0)
+		return true;
+	return name.find("+cov") != std::string::npos || name.find(",orig:") != std::string::npos;
+}
+
+
+static size_t CountSeeds(const std::string& dir)
+{
+	DIR* d = opendir(dir.c_str());
+	if(!d)
+		return 0;
+
+	size_t count = 0;
+	struct dirent* ent;
+	while((ent = readdir(d)))
+	{
+		size_t len = strlen(ent->d_name);
+		if(ent->d_name[0] != '.' && len > 6 && strcmp(ent->d_name + len - 6, ".ktest") == 0)
+			++count;
+	}
+	closedir(d);
+	return count;
+}
+
+
+class SyncDaemon
+{
+public:
+	SyncDaemon(const std::string& seedDir, const SyncOptions& options) : seedDir(seedDir), options(options) { }
+	~SyncDaemon();
+
+	bool AddQueue(const std::string& schemaDir, const std::string& dir, const std::string& function);
+	bool Run();
+
+private:
+	void LoadIndex();
+	void Enqueue(SyncQueue* queue, const std::string& name);
+	void Rescan(SyncQueue* queue);
+	bool ReadEvents();
+	void UpdatePaused();
+	size_t Flush();
+	bool Convert(const PendingInput& input);
+
+	std::string seedDir;
+	SyncOptions options;
+	int inotifyFd = -1;
+	FILE* index = nullptr;
+
+	std::map<std::string, std::unique_ptr<SyncTarget>> targets;
+	std::vector<std::unique_ptr<SyncQueue>> queues;
+	std::map<int, SyncQueue*> watches;
+
+	std::deque<PendingInput> pending;
+	uint64_t firstPendingMs = 0;
+	SyncStats stats;
+};
+
+
+SyncDaemon::~SyncDaemon()
+{
+	for(auto& target : targets)
+		macke_fuzzer_schema_free(&target.second->schema);
+	if(index)
+		fclose(index);
+	if(inotifyFd >= 0)
+		close(inotifyFd);
+}
+
+
+bool SyncDaemon::AddQueue(const std::string& schemaDir, const std::string& dir, const std::string& function)
+{
+	std::unique_ptr<SyncTarget>& target = targets[function];
+	if(!target)
+	{
+		target.reset(new SyncTarget());
+		target->function = function;
+		target->outDir = seedDir + "/" + function;
+
+		std::string schemaPath = schemaDir + "/" + function + ".layout";
+		if(macke_fuzzer_schema_load(&target->schema, schemaPath.c_str()) != 0)
+		{
+			printf("Failed to load the layout schema '%s'\n", schemaPath.c_str());
+			targets.erase(function);
+			return false;
+		}
+
+		if(mkdir(target->outDir.c_str(), 0755) != 0 && errno != EEXIST)
+		{
+			printf("Failed to create '%s': %m\n", target->outDir.c_str());
+			return false;
+		}
+		target->seedCount = CountSeeds(target->outDir);
+	}
+
+	SyncQueue* queue = new SyncQueue();
+	queue->dir = dir;
+	queue->target = target.get();
+	queues.emplace_back(queue);
+	return true;
+}
+
+
+/* Hashes of all inputs synced by earlier runs, so a restarted daemon does not hand them out again */
+void SyncDaemon::LoadIndex()
+{
+	std::string indexPath = seedDir + "/" SYNC_INDEX_NAME;
+	std::ifstream in(indexPath);
+	std::string function;
+	std::string hash;
+	while(in >> function >> hash)
+	{
+		auto target = targets.find(function);
+		if(target != targets.end())
+			target->second->hashes.insert(strtoull(hash.c_str(), NULL, 16));
+	}
+
+	index = fopen(indexPath.c_str(), "a");
+	if(!index)
+		printf("Warning: '%s' can not be written, synced inputs are forgotten on restart\n", indexPath.c_str());
+}
+
+
+void SyncDaemon::Enqueue(SyncQueue* queue, const std::string& name)
+{
+	if(name.empty() || name[0] == '.' || queue->seen.count(name))
+		return;
+
+	if(!options.allInputs && !IsCoverageIncreasing(name))
+	{
+		queue->seen.insert(name);
+		++stats.filtered;
+		return;
+	}
+
+	/* Back-pressure: forget the input for now, the queue is rescanned when there is room again */
+	if(pending.size() >= options.maxPending || queue->target->paused)
+	{
+		queue->needsRescan = true;
+		return;
+	}
+
+	queue->seen.insert(name);
+	if(pending.empty())
+		firstPendingMs = NowMs();
+	pending.push_back({queue, name});
+}
+
+
+void SyncDaemon::Rescan(SyncQueue* queue)
+{
+	queue->needsRescan = false;
+
+	DIR* d = opendir(queue->dir.c_str());
+	if(!d)
+		return;
+
+	struct dirent* ent;
+	while((ent = readdir(d)) && !queue->needsRescan)
+		Enqueue(queue, ent->d_name);
+	closedir(d);
+}
+
+
+/* Returns false if inotify failed */
+bool SyncDaemon::ReadEvents()
+{
+	alignas(struct inotify_event) char buf[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+	for(;;)
+	{
+		ssize_t len = read(inotifyFd, buf, sizeof(buf));
+		if(len < 0)
+			return errno == EAGAIN || errno == EINTR;
+
+		for(char* ptr = buf; ptr < buf + len; )
+		{
+			const struct inotify_event* event = (const struct inotify_event*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			/* Events were dropped, only a rescan finds the lost inputs */
+			if(event->mask & IN_Q_OVERFLOW)
+			{
+				for(auto& queue : queues)
+					queue->needsRescan = true;
+				continue;
+			}
+
+			auto watch = watches.find(event->wd);
+			if(watch != watches.end() && event->len && !(event->mask & IN_ISDIR))
+				Enqueue(watch->second, event->name);
+		}
+	}
+}
+
+
+bool SyncDaemon::Convert(const PendingInput& input)
+{
+	SyncTarget* target = input.queue->target;
+
+	std::vector<uint8_t> content;
+	std::string inputPath = input.queue->dir + "/" + input.name;
+	if(!ReadFile(inputPath, content))
+	{
+		/* Temporary files renamed right after writing are gone already, their new name is queued as well */
+		if(access(inputPath.c_str(), F_OK) == 0)
+			++stats.failed;
+		return false;
+	}
+
+	uint64_t hash = HashContent(content);
+	if(!target->hashes.insert(hash).second)
+	{
+		++stats.duplicates;
+		return true;
+	}
+
+	char hashName[32];
+	snprintf(hashName, sizeof(hashName), "%016llx", (unsigned long long)hash);
+	std::string path = target->outDir + "/" + hashName + ".ktest";
+	std::string tmpPath = target->outDir + "/." + hashName + ".tmp";
+
+	MackeFuzzerObjects objects;
+	macke_fuzzer_schema_decode(&target->schema, content.data(), content.size(), &objects);
+	int ret = macke_fuzzer_objects_write_ktest(&objects, tmpPath.c_str(), options.kleeArgs.size(), options.kleeArgs.data());
+	macke_fuzzer_objects_free(&objects);
+
+	/* klee never sees half written seeds */
+	if(ret != 0 || rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		printf("Failed to write '%s': %m\n", path.c_str());
+		unlink(tmpPath.c_str());
+		target->hashes.erase(hash);
+		++stats.failed;
+		return false;
+	}
+
+	if(index)
+	{
+		fprintf(index, "%s %s\n", target->function.c_str(), hashName);
+		fflush(index);
+	}
+	++target->seedCount;
+	++stats.synced;
+	return true;
+}
+
+
+/* Pauses and resumes the functions by the seeds still in their seed dir */
+void SyncDaemon::UpdatePaused()
+{
+	if(!options.maxSeeds)
+		return;
+
+	for(auto& entry : targets)
+	{
+		SyncTarget* target = entry.second.get();
+		/* Seeds the orchestrator moved out in the meantime make room again */
+		if(target->seedCount >= options.maxSeeds)
+			target->seedCount = CountSeeds(target->outDir);
+
+		bool paused = target->seedCount >= options.maxSeeds;
+		if(paused != target->paused)
+			fprintf(stderr, paused ? "paused %s, '%s' holds %zu seeds\n" : "resumed %s, '%s' holds %zu seeds\n",
+					target->function.c_str(), target->outDir.c_str(), target->seedCount);
+		target->paused = paused;
+	}
+}
+
+
+/* Returns the number of inputs taken from pending */
+size_t SyncDaemon::Flush()
+{
+	UpdatePaused();
+
+	size_t taken = 0;
+	size_t converted = 0;
+	while(!pending.empty() && converted < options.batchSize)
+	{
+		PendingInput input = pending.front();
+		pending.pop_front();
+		++taken;
+
+		/* Inputs of paused functions do not wait in memory, the rescan after resuming finds them again */
+		SyncTarget* target = input.queue->target;
+		if(target->paused || (options.maxSeeds && target->seedCount >= options.maxSeeds))
+		{
+			input.queue->seen.erase(input.name);
+			input.queue->needsRescan = true;
+			continue;
+		}
+		Convert(input);
+		++converted;
+	}
+	firstPendingMs = NowMs();
+
+	if(converted)
+		fprintf(stderr, "synced %zu, duplicates %zu, filtered %zu, failed %zu, pending %zu\n",
+				stats.synced, stats.duplicates, stats.filtered, stats.failed, pending.size());
+	return taken;
+}
+
+
+bool SyncDaemon::Run()
+{
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotifyFd < 0)
+	{
+		printf("inotify_init1 failed: %m\n");
+		return false;
+	}
+
+	/* Watch before the first scan, so no input can slip through in between */
+	for(auto& queue : queues)
+	{
+		queue->watch = inotify_add_watch(inotifyFd, queue->dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if(queue->watch < 0)
+		{
+			printf("Failed to watch '%s': %m\n", queue->dir.c_str());
+			return false;
+		}
+		watches[queue->watch] = queue.get();
+	}
+
+	LoadIndex();
+
+	while(!stopRequested)
+	{
+		UpdatePaused();
+
+		/* Rescans are only useful while inputs fit into memory */
+		for(auto& queue : queues)
+			if(queue->needsRescan && !queue->target->paused && pending.size() < options.maxPending)
+				Rescan(queue.get());
+
+		uint64_t now = NowMs();
+		bool batchReady = pending.size() >= options.batchSize
+				|| (!pending.empty() && now - firstPendingMs >= options.batchDelayMs);
+		if(batchReady)
+		{
+			Flush();
+			continue;
+		}
+
+		/* Paused functions are checked for room once per batch delay */
+		bool anyPaused = false;
+		for(auto& target : targets)
+			anyPaused |= target.second->paused;
+
+		int timeout = !pending.empty() ? (int)(firstPendingMs + options.batchDelayMs - now)
+				: anyPaused ? (int)options.batchDelayMs : -1;
+		struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+		int ret = poll(&pfd, 1, timeout);
+		if(ret < 0 && errno != EINTR)
+		{
+			printf("poll failed: %m\n");
+			return false;
+		}
+		if(ret > 0 && !ReadEvents())
+		{
+			printf("Reading inotify events failed: %m\n");
+			return false;
+		}
+	}
+
+	/* Hand out what is left before stopping */
+	while(!pending.empty() && Flush())
+		;
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	SyncOptions options;
+	std::vector<std::string> positional;
+	for(int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		size_t number;
+		if(strncmp(arg, "--batch=", 8) == 0 && ParseNumber(arg + 8, number) && number)
+			options.batchSize = number;
+		else if(strncmp(arg, "--batch-delay=", 14) == 0 && ParseNumber(arg + 14, number))
+			options.batchDelayMs = number;
+		else if(strncmp(arg, "--max-pending=", 14) == 0 && ParseNumber(arg + 14, number) && number)
+			options.maxPending = number;
+		else if(strncmp(arg, "--max-seeds=", 12) == 0 && ParseNumber(arg + 12, number))
+			options.maxSeeds = number;
+		else if(strcmp(arg, "--all-inputs") == 0)
+			options.allInputs = true;
+		else if(strncmp(arg, "--klee-arg=", 11) == 0)
+			options.kleeArgs.push_back(argv[i] + 11);
+		else if(arg[0] == '-')
+			Usage(argv);
+		else
+			positional.push_back(arg);
+	}
+
+	if(positional.size() < 3)
+		Usage(argv);
+
+	const std::string& schemaDir = positional[0];
+	const std::string& seedDir = positional[1];
+	if(mkdir(seedDir.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		printf("Failed to create '%s': %m\n", seedDir.c_str());
+		return 1;
+	}
+
+	SyncDaemon daemon(seedDir, options);
+	for(size_t i = 2; i < positional.size(); ++i)
+	{
+		size_t colon = positional[i].rfind(':');
+		if(colon == std::string::npos || colon == 0 || colon + 1 == positional[i].size())
+			Usage(argv);
+		if(!daemon.AddQueue(schemaDir, positional[i].substr(0, colon), positional[i].substr(colon + 1)))
+			return 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = StopHandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	return daemon.Run() ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../helper_funcs/driver_stats.h"
+
+/**
+ * Prints the shared stats block of running drivers generated with -fuzz-stats.
+ * With an interval, the table is refreshed and execs/s are computed from the difference.
+ */
+
+static void Usage(char** argv)
+{
+	printf("Usage: %s <stats-file> [interval-seconds]\n", argv[0]);
+	exit(1);
+}
+
+
+static double Percent(uint64_t part, uint64_t total)
+{
+	return total ? 100.0 * part / total : 0.0;
+}
+
+
+static void PrintBlock(const MackeFuzzerStatsBlock* block, uint64_t* lastExecs, unsigned interval)
+{
+	printf("%-40s %12s %10s %10s %8s %8s %8s %8s\n",
+			"driver", "execs", "execs/s", "bytes/ex", "ptrs/ex", "esc/ex", "decode%", "target%");
+
+	for(uint32_t i = 0; i < block->capacity && i < MACKE_FUZZER_STATS_CAPACITY; ++i)
+	{
+		const MackeFuzzerStatsEntry* e = &block->entries[i];
+		if(__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) != MACKE_FUZZER_STATS_READY)
+			continue;
+
+		uint64_t execs = __atomic_load_n(&e->execs, __ATOMIC_RELAXED);
+		uint64_t decode = __atomic_load_n(&e->decodeNanos, __ATOMIC_RELAXED);
+		uint64_t target = __atomic_load_n(&e->targetNanos, __ATOMIC_RELAXED);
+		double perExec = execs ? 1.0 / execs : 0.0;
+
+		printf("%-40.40s %12llu %10.0f %10.1f %8.2f %8.2f %8.1f %8.1f\n",
+				e->name, (unsigned long long)execs,
+				interval ? (double)(execs - lastExecs[i]) / interval : 0.0,
+				__atomic_load_n(&e->bytesDecoded, __ATOMIC_RELAXED) * perExec,
+				__atomic_load_n(&e->pointerArgs, __ATOMIC_RELAXED) * perExec,
+				__atomic_load_n(&e->escapeBytes, __ATOMIC_RELAXED) * perExec,
+				Percent(decode, decode + target), Percent(target, decode + target));
+		lastExecs[i] = execs;
+	}
+	fflush(stdout);
+}
+
+
+int main(int argc, char** argv)
+{
+	if(argc < 2 || argc > 3)
+		Usage(argv);
+
+	unsigned interval = argc == 3 ? strtoul(argv[2], NULL, 10) : 0;
+
+	int fd = open(argv[1], O_RDONLY);
+	if(fd < 0)
+	{
+		printf("Failed to open '%s': %m\n", argv[1]);
+		return 1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MackeFuzzerStatsBlock))
+	{
+		printf("'%s' is no stats file\n", argv[1]);
+		return 1;
+	}
+
+	const MackeFuzzerStatsBlock* block = mmap(NULL, sizeof(MackeFuzzerStatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(block == MAP_FAILED || memcmp(block->magic, MACKE_FUZZER_STATS_MAGIC, sizeof(block->magic)) != 0)
+	{
+		printf("'%s' is no stats file\n", argv[1]);
+		return 1;
+	}
+
+	static uint64_t lastExecs[MACKE_FUZZER_STATS_CAPACITY];
+	PrintBlock(block, lastExecs, 0);
+	while(interval)
+	{
+		sleep(interval);
+		printf("\n");
+		PrintBlock(block, lastExecs, interval);
+	}
+	return 0;
+}